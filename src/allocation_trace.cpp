@@ -0,0 +1,157 @@
+#include "allocation_trace.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+const char kTraceMagic[8] = {'M', 'M', 'T', 'R', 'A', 'C', 'E', '1'};
+
+}  // namespace
+
+TraceRecorder::TraceRecorder(const std::string& path, uint64_t buffer_bytes)
+: _out(path, std::ios::binary | std::ios::trunc)
+, _start(std::chrono::steady_clock::now())
+, _last_timestamp_ns(0)
+, _event_count(0) {
+    if (_out.is_open()) {
+        _out.write(kTraceMagic, sizeof(kTraceMagic));
+        writeVarint(buffer_bytes);
+    }
+}
+
+void TraceRecorder::writeVarint(uint64_t value) {
+    // LEB128: 7 bits per byte, high bit set on every byte except the last
+    char bytes[10];
+    int count = 0;
+    do {
+        unsigned char byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        bytes[count++] = static_cast<char>(byte);
+    } while (value != 0);
+    _out.write(bytes, count);
+}
+
+void TraceRecorder::writeEventHeader(TraceOp op) {
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+    _out.put(static_cast<char>(op));
+    writeVarint(now - _last_timestamp_ns);
+    _last_timestamp_ns = now;
+    ++_event_count;
+}
+
+void TraceRecorder::writeExtents(const MemoryBlocks& blocks, const char* buffer) {
+    writeVarint(blocks.allocations.size());
+    for (const auto& tuple : blocks.allocations) {
+        // Free() can be handed pointers outside of the buffer. Those get rejected by the manager anyways, so record
+        // them as a zero-length extent at 0 rather than writing a garbage offset.
+        std::ptrdiff_t offset = tuple.first - buffer;
+        if (offset < 0) {
+            writeVarint(0);
+            writeVarint(0);
+            continue;
+        }
+        writeVarint(static_cast<uint64_t>(offset));
+        writeVarint(static_cast<uint64_t>(tuple.second));
+    }
+}
+
+void TraceRecorder::recordAlloc(uint64_t size, const MemoryBlocks& result, const char* buffer) {
+    writeEventHeader(TraceOp::ALLOC);
+    writeVarint(size);
+    _out.put(static_cast<char>(result.status));
+    writeExtents(result, buffer);
+}
+
+void TraceRecorder::recordFree(const MemoryBlocks& blocks, const char* buffer) {
+    writeEventHeader(TraceOp::FREE);
+    writeExtents(blocks, buffer);
+}
+
+TraceReader::TraceReader(const std::string& path)
+: _in(path, std::ios::binary)
+, _valid(false)
+, _buffer_bytes(0)
+, _last_timestamp_ns(0) {
+    char magic[sizeof(kTraceMagic)];
+    if (!_in.read(magic, sizeof(magic)) || std::memcmp(magic, kTraceMagic, sizeof(magic)) != 0) {
+        return;
+    }
+    uint64_t buffer_bytes;
+    if (!readVarint(buffer_bytes)) {
+        return;
+    }
+    _buffer_bytes = buffer_bytes;
+    _valid = true;
+}
+
+bool TraceReader::readVarint(uint64_t& value) {
+    value = 0;
+    int shift = 0;
+    while (shift < 64) {
+        int byte = _in.get();
+        if (byte == std::char_traits<char>::eof()) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+        shift += 7;
+    }
+    // more than 10 bytes means the file is corrupt
+    return false;
+}
+
+bool TraceReader::next(TraceEvent& event) {
+    if (!_valid) {
+        return false;
+    }
+
+    int op = _in.get();
+    if (op != static_cast<int>(TraceOp::ALLOC) && op != static_cast<int>(TraceOp::FREE)) {
+        // either a clean end of file, or garbage. Both mean we're done.
+        return false;
+    }
+    event.op = static_cast<TraceOp>(op);
+
+    uint64_t delta;
+    if (!readVarint(delta)) {
+        return false;
+    }
+    _last_timestamp_ns += delta;
+    event.timestamp_ns = _last_timestamp_ns;
+
+    event.size = 0;
+    event.status = MemoryStatus::SUCCESS;
+    if (event.op == TraceOp::ALLOC) {
+        uint64_t size;
+        if (!readVarint(size)) {
+            return false;
+        }
+        int status = _in.get();
+        if (status == std::char_traits<char>::eof()) {
+            return false;
+        }
+        event.size = size;
+        event.status = static_cast<MemoryStatus>(status);
+    }
+
+    uint64_t count;
+    if (!readVarint(count)) {
+        return false;
+    }
+    event.extents.clear();
+    for (uint64_t ii = 0; ii < count; ++ii) {
+        uint64_t offset;
+        uint64_t length;
+        if (!readVarint(offset) || !readVarint(length)) {
+            return false;
+        }
+        event.extents.push_back(std::pair(offset, length));
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "memory_manager.h"
+
+// Compact binary trace of every Alloc() & Free() a MemoryManager sees, so allocator changes can be tuned against
+// real production traffic instead of hand-written examples. Hook a TraceRecorder up with
+// MemoryManager::setTraceRecorder(), and replay the file later with trace_replay.h (or `MemoryManager replay`).
+//
+// File layout, all integers are unsigned LEB128 varints unless noted otherwise:
+//
+//   header: the 8 magic bytes "MMTRACE1", then the size of the recorded buffer in bytes
+//   event:  1 byte op (1 = Alloc, 2 = Free)
+//           nanoseconds since the previous event (since recording started, for the first event)
+//           Alloc only: requested size, then 1 byte MemoryStatus of the result
+//           number of extents, then (offset, length) per extent
+//
+// Offsets are relative to the start of the recorded buffer, so a trace can be replayed over any buffer. Small
+// numbers take 1 byte, so a typical 1-extent Alloc event costs well under 16 bytes.
+
+enum class TraceOp : unsigned char {
+    ALLOC = 1,
+    FREE = 2,
+};
+
+struct TraceEvent {
+    TraceOp op;
+
+    // Nanoseconds since the recording started
+    uint64_t timestamp_ns;
+
+    // Requested size and result status, only meaningful for ALLOC events
+    uint64_t size;
+    MemoryStatus status;
+
+    // Offset (relative to the recorded buffer) and length of every extent handed out or given back
+    std::vector<std::pair<uint64_t, uint64_t>> extents;
+};
+
+class TraceRecorder {
+  public:
+    // Opens path for writing, truncating whatever was there. Check isOpen() before handing it to a manager.
+    TraceRecorder(const std::string& path, uint64_t buffer_bytes);
+
+    bool isOpen() const { return _out.is_open() && _out.good(); }
+
+    // Called by MemoryManager, buffer is the start of the manager's buffer so we can store offsets
+    void recordAlloc(uint64_t size, const MemoryBlocks& result, const char* buffer);
+    void recordFree(const MemoryBlocks& blocks, const char* buffer);
+
+    uint64_t getEventCount() const { return _event_count; }
+
+  private:
+    void writeVarint(uint64_t value);
+    void writeEventHeader(TraceOp op);
+    void writeExtents(const MemoryBlocks& blocks, const char* buffer);
+
+    std::ofstream _out;
+    std::chrono::steady_clock::time_point _start;
+    uint64_t _last_timestamp_ns;
+    uint64_t _event_count;
+};
+
+class TraceReader {
+  public:
+    explicit TraceReader(const std::string& path);
+
+    // false if the file couldn't be opened, or doesn't start with a valid header
+    bool isOpen() const { return _valid; }
+
+    uint64_t getBufferBytes() const { return _buffer_bytes; }
+
+    // Reads the next event, returns false at the end of the trace (or on a truncated/corrupt event)
+    bool next(TraceEvent& event);
+
+  private:
+    bool readVarint(uint64_t& value);
+
+    std::ifstream _in;
+    bool _valid;
+    uint64_t _buffer_bytes;
+    uint64_t _last_timestamp_ns;
+};
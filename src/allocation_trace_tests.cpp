@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#define TESTING 1
+#define TRACE_BUFFER_SIZE 50
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "allocation_trace.h"
+#include "memory_manager.h"
+#include "trace_replay.h"
+
+class AllocationTraceTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    _path = testing::TempDir() + "memory_manager_trace_test.bin";
+  }
+
+  void TearDown() override {
+    std::remove(_path.c_str());
+  }
+
+  std::string _path;
+  char _buffer[TRACE_BUFFER_SIZE];
+  char _replay_buffer[TRACE_BUFFER_SIZE];
+};
+
+TEST_F(AllocationTraceTest, recordsAllocAndFree) {
+    {
+        TraceRecorder recorder(_path, TRACE_BUFFER_SIZE);
+        ASSERT_TRUE(recorder.isOpen());
+        MemoryManager manager(_buffer, TRACE_BUFFER_SIZE);
+        manager.setTraceRecorder(&recorder);
+
+        manager.markAllOccupied(10, 10);
+        MemoryBlocks block = manager.Alloc(15);
+        EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+        manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+3, 2 } }));
+        MemoryBlocks too_big = manager.Alloc(100);
+        EXPECT_EQ(too_big.status, MemoryStatus::INSUFFICIENT_MEMORY);
+        EXPECT_EQ(recorder.getEventCount(), 3);
+    }
+
+    TraceReader reader(_path);
+    ASSERT_TRUE(reader.isOpen());
+    EXPECT_EQ(reader.getBufferBytes(), TRACE_BUFFER_SIZE);
+
+    TraceEvent event;
+    ASSERT_TRUE(reader.next(event));
+    EXPECT_EQ(event.op, TraceOp::ALLOC);
+    EXPECT_EQ(event.size, 15);
+    EXPECT_EQ(event.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<uint64_t, uint64_t>> expectedExtents = { { 0, 10 }, { 20, 5 } };
+    EXPECT_EQ(event.extents, expectedExtents);
+    uint64_t first_timestamp = event.timestamp_ns;
+
+    ASSERT_TRUE(reader.next(event));
+    EXPECT_EQ(event.op, TraceOp::FREE);
+    expectedExtents = { { 3, 2 } };
+    EXPECT_EQ(event.extents, expectedExtents);
+    EXPECT_GE(event.timestamp_ns, first_timestamp);
+
+    ASSERT_TRUE(reader.next(event));
+    EXPECT_EQ(event.op, TraceOp::ALLOC);
+    EXPECT_EQ(event.size, 100);
+    EXPECT_EQ(event.status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_TRUE(event.extents.empty());
+
+    EXPECT_FALSE(reader.next(event));
+}
+
+TEST_F(AllocationTraceTest, rejectsFileWithoutHeader) {
+    FILE* file = std::fopen(_path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    std::fputs("not a trace", file);
+    std::fclose(file);
+
+    TraceReader reader(_path);
+    EXPECT_FALSE(reader.isOpen());
+}
+
+TEST_F(AllocationTraceTest, replayTranslatesPartialFrees) {
+    // record the X-X-X example from main.cpp, then replay it over a manager whose buffer starts out differently
+    {
+        TraceRecorder recorder(_path, 5);
+        MemoryManager manager(_buffer, 5);
+        manager.setTraceRecorder(&recorder);
+        MemoryBlocks block = manager.Alloc(5);
+        manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+1, 1 }, { _buffer+3, 1 } }));
+        manager.Alloc(2);
+    }
+
+    // bytes 0..4 are already taken in the replay, so the first Alloc(5) lands on 5..9 and the recorded free of
+    // offsets 1 & 3 has to become a free of 6 & 8, which the Alloc(2) then takes back in 2 fragments
+    MemoryManager replay_manager(_replay_buffer, 10);
+    replay_manager.markAllOccupied(0, 5);
+    TraceReader reader(_path);
+    ReplayResult result = ReplayTrace(reader, replay_manager);
+
+    EXPECT_EQ(result.events, 3);
+    EXPECT_EQ(result.allocs, 2);
+    EXPECT_EQ(result.failed_allocs, 0);
+    EXPECT_EQ(result.fragments, 3);
+    EXPECT_EQ(result.frees, 1);
+    EXPECT_EQ(result.failed_frees, 0);
+    EXPECT_EQ(result.unmapped_free_bytes, 0);
+    EXPECT_EQ(replay_manager.getAvailableBytes(), 0);
+    EXPECT_EQ(result.final_stats.free_bytes, 0);
+}
+
+TEST_F(AllocationTraceTest, replayCountsUnmappedFrees) {
+    {
+        TraceRecorder recorder(_path, TRACE_BUFFER_SIZE);
+        MemoryManager manager(_buffer, TRACE_BUFFER_SIZE);
+        manager.setTraceRecorder(&recorder);
+        MemoryBlocks block = manager.Alloc(10);
+        manager.Free(block);
+        manager.Free(block);
+    }
+
+    MemoryManager replay_manager(_replay_buffer, TRACE_BUFFER_SIZE);
+    TraceReader reader(_path);
+    ReplayResult result = ReplayTrace(reader, replay_manager);
+
+    EXPECT_EQ(result.frees, 1);
+    EXPECT_EQ(result.unmapped_free_bytes, 10);
+    EXPECT_EQ(replay_manager.getAvailableBytes(), TRACE_BUFFER_SIZE);
+}
+
+TEST_F(AllocationTraceTest, freeSpaceStats) {
+    MemoryManager manager(_buffer, TRACE_BUFFER_SIZE);
+    manager.markAllOccupied(10, 10);
+    manager.markAllOccupied(30, 5);
+
+    FreeSpaceStats stats = manager.GetFreeSpaceStats();
+    EXPECT_EQ(stats.free_bytes, 35);
+    EXPECT_EQ(stats.free_runs, 3);
+    EXPECT_EQ(stats.largest_free_run, 15);
+    EXPECT_DOUBLE_EQ(stats.fragmentation(), 1.0 - 15.0 / 35.0);
+}
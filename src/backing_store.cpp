@@ -0,0 +1,199 @@
+#include "backing_store.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+namespace {
+
+size_t roundUp(size_t value, size_t multiple) {
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+}  // namespace
+
+BackingStore::BackingStore()
+: _data(nullptr)
+, _num_bytes(0)
+, _mapped_bytes(0)
+, _huge_page_advised(false)
+, _reserved(false)
+, _committed_chunks()
+, _committed_chunk_count(0) {}
+
+BackingStore::BackingStore(size_t num_bytes, bool populate, bool huge_pages)
+: BackingStore() {
+    if (!huge_pages) {
+        map(num_bytes, PROT_READ | PROT_WRITE, populate ? MAP_POPULATE : 0, false);
+        return;
+    }
+
+    if (!map(num_bytes, PROT_READ | PROT_WRITE, 0, true)) {
+        return;
+    }
+
+    // MAP_POPULATE on the over-sized mapping would fault in the head & tail for nothing, and fault everything in
+    // as 4 KB pages before the huge page advice even got there. So populate only now, after the advice.
+    if (populate) {
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(_data, _mapped_bytes, MADV_POPULATE_WRITE) == 0) {
+            return;
+        }
+#endif
+        // older kernels, touch one byte per page. Anonymous memory is zero already, so writing a 0 changes nothing.
+        for (size_t ii = 0; ii < _mapped_bytes; ii += getPageSize()) {
+            reinterpret_cast<volatile char*>(_data)[ii] = 0;
+        }
+    }
+}
+
+BackingStore BackingStore::Reserve(size_t num_bytes, bool huge_pages) {
+    BackingStore backing;
+    if (backing.map(num_bytes, PROT_NONE, MAP_NORESERVE, huge_pages)) {
+        backing._reserved = true;
+        backing._committed_chunks = ZeroedBytes((backing._mapped_bytes + kCommitChunkSize - 1) / kCommitChunkSize);
+    }
+    return backing;
+}
+
+bool BackingStore::map(size_t num_bytes, int prot, int flags, bool huge_pages) {
+    if (num_bytes == 0) {
+        return false;
+    }
+
+    if (!huge_pages) {
+        size_t length = roundUp(num_bytes, getPageSize());
+        void* mapping = mmap(nullptr, length, prot, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        _data = static_cast<char*>(mapping);
+        _num_bytes = num_bytes;
+        _mapped_bytes = length;
+        return true;
+    }
+
+    // mmap only promises 4 KB alignment, so map an extra huge page & trim the misaligned head and the tail. The
+    // length gets rounded up to whole huge pages too, otherwise the last partial one could never be a huge page.
+    size_t length = roundUp(num_bytes, kHugePageSize);
+    size_t over_length = length + kHugePageSize;
+    void* mapping = mmap(nullptr, over_length, prot, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+    uintptr_t aligned = roundUp(start, kHugePageSize);
+    size_t head = aligned - start;
+    size_t tail = over_length - head - length;
+    if (head > 0) {
+        munmap(mapping, head);
+    }
+    if (tail > 0) {
+        munmap(reinterpret_cast<void*>(aligned + length), tail);
+    }
+
+    _data = reinterpret_cast<char*>(aligned);
+    _num_bytes = num_bytes;
+    _mapped_bytes = length;
+    _huge_page_advised = (madvise(_data, _mapped_bytes, MADV_HUGEPAGE) == 0);
+    return true;
+}
+
+bool BackingStore::commit(size_t offset, size_t length) {
+    if (!_reserved || length == 0) {
+        return true;
+    }
+
+    // one mprotect() per stretch of chunks that aren't committed yet. Neighboring committed chunks get merged back
+    // into one mapping by the kernel, so a mostly used arena ends up as a handful of mappings.
+    size_t chunk = offset / kCommitChunkSize;
+    size_t end_chunk = (offset + length + kCommitChunkSize - 1) / kCommitChunkSize;
+    while (chunk < end_chunk) {
+        if (_committed_chunks[chunk]) {
+            ++chunk;
+            continue;
+        }
+        size_t stretch_end = chunk;
+        while (stretch_end < end_chunk && !_committed_chunks[stretch_end]) {
+            ++stretch_end;
+        }
+        size_t from = chunk * kCommitChunkSize;
+        size_t to = std::min(stretch_end * kCommitChunkSize, _mapped_bytes);
+        if (mprotect(_data + from, to - from, PROT_READ | PROT_WRITE) != 0) {
+            return false;
+        }
+        for (size_t cc = chunk; cc < stretch_end; ++cc) {
+            _committed_chunks[cc] = 1;
+        }
+        _committed_chunk_count += stretch_end - chunk;
+        chunk = stretch_end;
+    }
+    return true;
+}
+
+bool BackingStore::release(size_t offset, size_t length, ReleaseMode mode) {
+    if (_data == nullptr || length == 0 || offset + length > _mapped_bytes) {
+        return false;
+    }
+    int advice;
+    switch (mode) {
+        case ReleaseMode::DONTNEED:
+            advice = MADV_DONTNEED;
+            break;
+        case ReleaseMode::FREE:
+            advice = MADV_FREE;
+            break;
+        case ReleaseMode::NONE:
+        default:
+            return false;
+    }
+    return madvise(_data + offset, length, advice) == 0;
+}
+
+size_t BackingStore::getPageSize() {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+BackingStore::~BackingStore() {
+    unmap();
+}
+
+BackingStore::BackingStore(BackingStore&& other) noexcept
+: _data(std::exchange(other._data, nullptr))
+, _num_bytes(std::exchange(other._num_bytes, 0))
+, _mapped_bytes(std::exchange(other._mapped_bytes, 0))
+, _huge_page_advised(std::exchange(other._huge_page_advised, false))
+, _reserved(std::exchange(other._reserved, false))
+, _committed_chunks(std::move(other._committed_chunks))
+, _committed_chunk_count(std::exchange(other._committed_chunk_count, 0)) {}
+
+BackingStore& BackingStore::operator=(BackingStore&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        _data = std::exchange(other._data, nullptr);
+        _num_bytes = std::exchange(other._num_bytes, 0);
+        _mapped_bytes = std::exchange(other._mapped_bytes, 0);
+        _huge_page_advised = std::exchange(other._huge_page_advised, false);
+        _reserved = std::exchange(other._reserved, false);
+        _committed_chunks = std::move(other._committed_chunks);
+        _committed_chunk_count = std::exchange(other._committed_chunk_count, 0);
+    }
+    return *this;
+}
+
+void BackingStore::unmap() {
+    if (_data != nullptr) {
+        munmap(_data, _mapped_bytes);
+        _data = nullptr;
+        _num_bytes = 0;
+        _mapped_bytes = 0;
+        _huge_page_advised = false;
+        _reserved = false;
+        _committed_chunks = ZeroedBytes();
+        _committed_chunk_count = 0;
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Memory the manager owns itself, mapped straight from the kernel with mmap() & unmapped in the destructor.
+// Move-only, so there is exactly one owner of a mapping at any time.
+//
+// populate pre-faults every page up front, so the first pass over the arena doesn't pay a page fault per 4 KB.
+// huge_pages aligns the mapping to 2 MB and advises MADV_HUGEPAGE, so (when transparent huge pages are enabled in
+// the kernel) the arena gets backed by 2 MB pages and needs 512x fewer TLB entries. Both are hints, neither can
+// make the mapping fail.
+//
+// Reserve() is the lazy version: it only reserves address space (PROT_NONE, no swap accounting), and ranges get
+// committed (made read/write) as they're first handed out. That way a 100 GB arena costs nothing until it's used.
+// Commits happen in whole kCommitChunkSize chunks, which keeps the number of distinct mappings (and so the kernel's
+// vm.max_map_count limit of ~65k) in check, at 1 per 2 MB chunk at worst.
+
+// std::allocator replacement for metadata that starts out all zeros, like the availability bitset. Memory comes from
+// calloc(), which for big sizes means fresh mmap()ed zero pages that don't cost anything until they're written, and
+// default construction is a no-op since the memory is zero already. So std::vector<T, ZeroedAllocator<T>>(n) is
+// O(1) no matter how big n is, where std::vector<T>(n, 0) writes every element up front.
+template <typename T>
+struct ZeroedAllocator {
+    using value_type = T;
+
+    ZeroedAllocator() = default;
+    template <typename U>
+    ZeroedAllocator(const ZeroedAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        void* memory = std::calloc(count, sizeof(T));
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(memory);
+    }
+    void deallocate(T* memory, size_t) { std::free(memory); }
+
+    // only for trivial types, where "zero bytes" & "default constructed" are the same thing
+    template <typename U>
+    void construct(U*) {}
+    template <typename U, typename... Args>
+    void construct(U* memory, Args&&... args) { ::new (static_cast<void*>(memory)) U(std::forward<Args>(args)...); }
+
+    template <typename U>
+    bool operator==(const ZeroedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const ZeroedAllocator<U>&) const { return false; }
+};
+
+using ZeroedBytes = std::vector<unsigned char, ZeroedAllocator<unsigned char>>;
+
+// How freed pages get handed back to the kernel, see MemoryManager::setReleasePolicy()
+enum class ReleaseMode {
+    // keep everything resident
+    NONE,
+    // MADV_DONTNEED: pages are dropped right away & read back as zeros
+    DONTNEED,
+    // MADV_FREE: the kernel drops pages only when it's short on memory, so it's cheaper when the memory gets reused
+    // soon, but the contents are either the old data or zeros
+    FREE,
+};
+
+class BackingStore {
+  public:
+    static constexpr size_t kHugePageSize = size_t(2) << 20;
+    static constexpr size_t kCommitChunkSize = kHugePageSize;
+
+    // Empty store, owns nothing
+    BackingStore();
+
+    // Maps num_bytes of anonymous memory. Check isMapped(), the mapping fails when the kernel says no.
+    explicit BackingStore(size_t num_bytes, bool populate = false, bool huge_pages = false);
+
+    // Reserves num_bytes of address space without committing any of it, see commit(). Check isMapped().
+    static BackingStore Reserve(size_t num_bytes, bool huge_pages = false);
+
+    ~BackingStore();
+
+    BackingStore(BackingStore&& other) noexcept;
+    BackingStore& operator=(BackingStore&& other) noexcept;
+    BackingStore(const BackingStore&) = delete;
+    BackingStore& operator=(const BackingStore&) = delete;
+
+    bool isMapped() const { return _data != nullptr; }
+
+    char* data() const { return _data; }
+    size_t size() const { return _num_bytes; }
+
+    // Makes sure length bytes from offset are readable & writable. A no-op unless the store came from Reserve(), and
+    // returns false when the kernel won't commit more memory.
+    bool commit(size_t offset, size_t length);
+
+    bool isReserved() const { return _reserved; }
+
+    // Whether the page at offset was ever committed, always true unless the store came from Reserve()
+    bool isCommitted(size_t offset) const { return !_reserved || _committed_chunks[offset / kCommitChunkSize] != 0; }
+
+    // Bytes that are readable & writable, which is all of them unless the store came from Reserve()
+    size_t getCommittedBytes() const { return _reserved ? std::min(_committed_chunk_count * kCommitChunkSize, _mapped_bytes) : _mapped_bytes; }
+
+    // Hands length bytes from offset back to the kernel. Both need to be multiples of getPageSize(), and the range
+    // needs to be inside the mapping (the mapped tail past size() counts). Returns false when madvise() said no.
+    bool release(size_t offset, size_t length, ReleaseMode mode);
+
+    static size_t getPageSize();
+
+    // Whether the kernel took the MADV_HUGEPAGE advice. Still no guarantee of huge pages, that's up to the kernel.
+    bool isHugePageAdvised() const { return _huge_page_advised; }
+
+  private:
+    // mmap()s num_bytes with prot, 2 MB aligned for huge_pages, and fills in the members. false if mmap() failed.
+    bool map(size_t num_bytes, int prot, int flags, bool huge_pages);
+
+    void unmap();
+
+    char* _data;
+    size_t _num_bytes;
+
+    // what actually got mapped, which is num_bytes rounded up to whole pages (or whole huge pages)
+    size_t _mapped_bytes;
+    bool _huge_page_advised;
+
+    // Reserve() only: one byte per kCommitChunkSize chunk, non-zero once committed
+    bool _reserved;
+    ZeroedBytes _committed_chunks;
+    size_t _committed_chunk_count;
+};
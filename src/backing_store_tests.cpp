@@ -0,0 +1,255 @@
+#include <gtest/gtest.h>
+
+#define TESTING 1
+
+#include <sys/mman.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "backing_store.h"
+#include "memory_manager.h"
+
+TEST(BackingStoreTest, mapsAndMoves) {
+    BackingStore backing(10000);
+    ASSERT_TRUE(backing.isMapped());
+    EXPECT_EQ(backing.size(), 10000);
+    backing.data()[9999] = 'x';
+
+    // moving hands the mapping over, the old store is left empty & won't unmap it
+    char* data = backing.data();
+    BackingStore moved(std::move(backing));
+    EXPECT_FALSE(backing.isMapped());
+    EXPECT_EQ(moved.data(), data);
+    EXPECT_EQ(moved.data()[9999], 'x');
+
+    BackingStore assigned;
+    EXPECT_FALSE(assigned.isMapped());
+    assigned = std::move(moved);
+    EXPECT_EQ(assigned.data(), data);
+}
+
+TEST(BackingStoreTest, hugePagesAreAligned) {
+    BackingStore backing(3 << 20, true, true);
+    ASSERT_TRUE(backing.isMapped());
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(backing.data()) % BackingStore::kHugePageSize, 0);
+    EXPECT_EQ(backing.size(), 3 << 20);
+
+    // populated memory is still zeroed anonymous memory, and all of it is writable
+    EXPECT_EQ(backing.data()[0], 0);
+    EXPECT_EQ(backing.data()[(3 << 20) - 1], 0);
+    backing.data()[(3 << 20) - 1] = 'x';
+}
+
+TEST(BackingStoreTest, zeroBytesMapsNothing) {
+    BackingStore backing(0);
+    EXPECT_FALSE(backing.isMapped());
+    EXPECT_EQ(MemoryManager::CreateMapped(0), nullptr);
+}
+
+TEST(BackingStoreTest, managerOwnsMapping) {
+    std::unique_ptr<MemoryManager> manager = MemoryManager::CreateMapped(1 << 20, 64, true, true);
+    ASSERT_NE(manager, nullptr);
+    EXPECT_EQ(manager->getUsableBytes(), 1 << 20);
+
+    MemoryBlocks block = manager->Alloc(1000, 4096, true);
+    ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(block.allocations.front().first) % 4096, 0);
+    block.allocations.front().first[999] = 'x';
+    EXPECT_EQ(manager->Free(block), MemoryStatus::SUCCESS);
+
+    // a moved manager keeps working on the same mapping
+    MemoryManager moved(std::move(*manager));
+    manager.reset();
+    block = moved.Alloc(10);
+    ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+    block.allocations.front().first[9] = 'y';
+    EXPECT_EQ(moved.Free(block), MemoryStatus::SUCCESS);
+}
+
+namespace {
+
+// How many pages of [data, data + length) are resident, according to the kernel
+size_t residentPages(const char* data, size_t length) {
+    size_t page_size = BackingStore::getPageSize();
+    std::vector<unsigned char> residency((length + page_size - 1) / page_size);
+    if (mincore(const_cast<char*>(data), length, residency.data()) != 0) {
+        return SIZE_MAX;
+    }
+    size_t count = 0;
+    for (unsigned char page : residency) {
+        count += page & 1;
+    }
+    return count;
+}
+
+}  // namespace
+
+TEST(BackingStoreTest, freeReleasesLongRuns) {
+    const size_t page_size = BackingStore::getPageSize();
+    std::unique_ptr<MemoryManager> manager = MemoryManager::CreateMapped(64 * page_size);
+    ASSERT_NE(manager, nullptr);
+    EXPECT_TRUE(manager->setReleasePolicy({ReleaseMode::DONTNEED, 8 * page_size, false}));
+
+    MemoryBlocks small = manager->Alloc(4 * page_size);
+    MemoryBlocks big = manager->Alloc(32 * page_size);
+    MemoryBlocks rest = manager->Alloc(28 * page_size);
+    for (const auto* blocks : { &small, &big, &rest }) {
+        ASSERT_EQ(blocks->status, MemoryStatus::SUCCESS);
+        memset(blocks->allocations.front().first, 'x', blocks->allocations.front().second);
+    }
+    char* data = small.allocations.front().first;
+    EXPECT_EQ(residentPages(data, 64 * page_size), 64);
+
+    // 4 pages is under the threshold & stays resident
+    EXPECT_EQ(manager->Free(small), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->getReleasedBytes(), 0);
+    EXPECT_EQ(residentPages(data, 64 * page_size), 64);
+
+    // 32 pages next to them makes a 36 page run, all of which goes back to the OS & reads as zeros again
+    EXPECT_EQ(manager->Free(big), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->getReleasedBytes(), 36 * page_size);
+    EXPECT_EQ(residentPages(data, 64 * page_size), 28);
+    EXPECT_EQ(data[0], 0);
+    EXPECT_TRUE(manager->isPageKnownZero(35));
+    EXPECT_FALSE(manager->isPageKnownZero(36));
+}
+
+TEST(BackingStoreTest, batchedReleaseWaitsForTrigger) {
+    const size_t page_size = BackingStore::getPageSize();
+    // 100 byte blocks, so runs start & end in the middle of pages
+    std::unique_ptr<MemoryManager> manager = MemoryManager::CreateMapped(16 * page_size, 100);
+    ASSERT_NE(manager, nullptr);
+    EXPECT_TRUE(manager->setReleasePolicy({ReleaseMode::DONTNEED, 0, true}));
+
+    MemoryBlocks first = manager->Alloc(page_size + 1);
+    MemoryBlocks middle = manager->Alloc(4 * page_size);
+    ASSERT_EQ(middle.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->Free(middle), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->getReleasedBytes(), 0);
+
+    // the first 2 pages are partly in use by first, everything from page 2 on is free
+    EXPECT_EQ(manager->ReleaseFreePages(), 14 * page_size);
+    EXPECT_FALSE(manager->isPageReleased(1));
+    EXPECT_TRUE(manager->isPageReleased(2));
+
+    // nothing left to release the second time around
+    EXPECT_EQ(manager->ReleaseFreePages(), 0);
+    EXPECT_EQ(manager->Free(first), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->ReleaseFreePages(), 2 * page_size);
+    EXPECT_EQ(manager->getReleasedBytes(), 16 * page_size);
+}
+
+TEST(BackingStoreTest, allocZeroedSkipsKnownZeroPages) {
+    const size_t page_size = BackingStore::getPageSize();
+    std::unique_ptr<MemoryManager> manager = MemoryManager::CreateMapped(8 * page_size);
+    ASSERT_NE(manager, nullptr);
+
+    // fresh pages are known zero, and stop being known zero once handed out
+    EXPECT_TRUE(manager->isPageKnownZero(0));
+    MemoryBlocks dirty = manager->Alloc(2 * page_size);
+    EXPECT_FALSE(manager->isPageKnownZero(0));
+    memset(dirty.allocations.front().first, 'x', 2 * page_size);
+    EXPECT_EQ(manager->Free(dirty), MemoryStatus::SUCCESS);
+
+    // the dirty pages get zeroed, the pristine ones after them don't need it
+    manager->setNextByteLocation(0);
+    MemoryBlocks zeroed = manager->AllocZeroed(8 * page_size);
+    ASSERT_EQ(zeroed.status, MemoryStatus::SUCCESS);
+    char* data = zeroed.allocations.front().first;
+    for (size_t ii = 0; ii < 8 * page_size; ++ii) {
+        ASSERT_EQ(data[ii], 0);
+    }
+
+    // AllocZeroed works on a caller's buffer too, it just can't skip anything
+    char buffer[64];
+    memset(buffer, 'x', sizeof(buffer));
+    MemoryManager plain(buffer, sizeof(buffer));
+    EXPECT_FALSE(plain.setReleasePolicy({ReleaseMode::DONTNEED, 0, false}));
+    MemoryBlocks block = plain.AllocZeroed(10);
+    EXPECT_EQ(buffer[9], 0);
+    EXPECT_EQ(buffer[10], 'x');
+}
+
+namespace {
+
+// Resident set size of this process in bytes
+size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    statm >> total_pages >> resident_pages;
+    return resident_pages * BackingStore::getPageSize();
+}
+
+}  // namespace
+
+TEST(BackingStoreTest, reservedArenaCommitsOnAlloc) {
+    std::unique_ptr<MemoryManager> manager = MemoryManager::CreateReserved(64 << 20, 64);
+    ASSERT_NE(manager, nullptr);
+    EXPECT_EQ(manager->getCommittedBytes(), 0);
+
+    // 1 MB at the start commits the first 2 MB chunk, and it's all writable
+    MemoryBlocks first = manager->Alloc(1 << 20);
+    ASSERT_EQ(first.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->getCommittedBytes(), BackingStore::kCommitChunkSize);
+    memset(first.allocations.front().first, 'x', 1 << 20);
+
+    // 3 MB from the 1 MB mark ends at 4 MB, so only the second chunk needs committing
+    MemoryBlocks second = manager->Alloc(3 << 20);
+    ASSERT_EQ(second.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->getCommittedBytes(), 2 * BackingStore::kCommitChunkSize);
+    memset(second.allocations.front().first, 'x', 3 << 20);
+
+    // freeing doesn't uncommit, and nothing past what was handed out got committed
+    EXPECT_EQ(manager->Free(first), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->getCommittedBytes(), 2 * BackingStore::kCommitChunkSize);
+}
+
+TEST(BackingStoreTest, reservedArenaOnlyReleasesCommittedPages) {
+    const size_t page_size = BackingStore::getPageSize();
+    std::unique_ptr<MemoryManager> manager = MemoryManager::CreateReserved(64 << 20, 64);
+    ASSERT_NE(manager, nullptr);
+    EXPECT_TRUE(manager->setReleasePolicy({ReleaseMode::DONTNEED, 0, true}));
+
+    // only the first 2 MB chunk ever got committed, so that's all there is to release out of the 64 MB
+    MemoryBlocks block = manager->Alloc(1 << 20);
+    ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+    memset(block.allocations.front().first, 'x', 1 << 20);
+    EXPECT_EQ(manager->Free(block), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->ReleaseFreePages(), BackingStore::kCommitChunkSize);
+    EXPECT_EQ(manager->getReleasedBytes(), BackingStore::kCommitChunkSize);
+    EXPECT_TRUE(manager->isPageReleased(0));
+    EXPECT_FALSE(manager->isPageReleased(BackingStore::kCommitChunkSize / page_size));
+
+    // pages committed later on are still released like any other
+    manager->setNextByteLocation((size_t(32) << 20) / 64);
+    block = manager->Alloc(page_size);
+    ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->Free(block), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager->ReleaseFreePages(), BackingStore::kCommitChunkSize);
+    EXPECT_EQ(manager->getReleasedBytes(), 2 * BackingStore::kCommitChunkSize);
+}
+
+TEST(BackingStoreTest, hugeReservedManagerIsFreeToBuild) {
+    // 16 GB at byte granularity means a 2 GB bitset, which used to get written in full by the constructor
+    const size_t num_bytes = size_t(16) << 30;
+    size_t before = residentBytes();
+    std::unique_ptr<MemoryManager> manager = MemoryManager::CreateReserved(num_bytes);
+    if (manager == nullptr) {
+        GTEST_SKIP() << "could not reserve 16 GB of address space";
+    }
+    EXPECT_LT(residentBytes() - before, size_t(64) << 20);
+
+    // the very end of the arena works fine, and only that much memory shows up
+    manager->setNextByteLocation(num_bytes - 4096);
+    MemoryBlocks block = manager->Alloc(4096);
+    ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+    memset(block.allocations.front().first, 'x', 4096);
+    EXPECT_EQ(manager->getCommittedBytes(), BackingStore::kCommitChunkSize);
+    EXPECT_LT(residentBytes() - before, size_t(64) << 20);
+}
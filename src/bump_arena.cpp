@@ -0,0 +1,103 @@
+#include "bump_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+BumpArena::BumpArena(MemoryManager& manager, size_t block_bytes)
+: _manager(manager)
+, _block_bytes(std::max<size_t>(block_bytes, 1))
+, _blocks()
+, _current(0)
+, _offset(0)
+, _reserved_bytes(0) {}
+
+BumpArena::~BumpArena() {
+    for (const auto& block : _blocks) {
+        _manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {block}));
+    }
+}
+
+size_t BumpArena::alignedOffset(size_t block, size_t offset, size_t alignment) const {
+    uintptr_t start = reinterpret_cast<uintptr_t>(_blocks[block].first);
+    uintptr_t aligned = (start + offset + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    return static_cast<size_t>(aligned - start);
+}
+
+char* BumpArena::Alloc(size_t size, size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return nullptr;
+    }
+
+    // the common case, room left in the current block
+    if (_current < _blocks.size()) {
+        size_t start = alignedOffset(_current, _offset, alignment);
+        if (start <= _blocks[_current].second && size <= _blocks[_current].second - start) {
+            _offset = start + size;
+            return _blocks[_current].first + start;
+        }
+    }
+
+    if (!advance(size, alignment)) {
+        return nullptr;
+    }
+    size_t start = alignedOffset(_current, 0, alignment);
+    _offset = start + size;
+    return _blocks[_current].first + start;
+}
+
+bool BumpArena::advance(size_t size, size_t alignment) {
+    // blocks kept from before a Rewind() first
+    size_t next = (_current < _blocks.size()) ? _current + 1 : 0;
+    for (size_t ii = next; ii < _blocks.size(); ++ii) {
+        size_t start = alignedOffset(ii, 0, alignment);
+        if (start <= _blocks[ii].second && size <= _blocks[ii].second - start) {
+            _current = ii;
+            _offset = 0;
+            return true;
+        }
+    }
+
+    // Reserve a new one, with enough slack to align inside of it. It goes right after the current block, which is
+    // safe since marks can't point past the current block, and keeps the blocks after it for later.
+    if (size > SIZE_MAX - alignment) {
+        return false;
+    }
+    size_t bytes = std::max(_block_bytes, size + alignment - 1);
+    MemoryBlocks reserved = _manager.Alloc(bytes, 1, true);
+    if (reserved.status != MemoryStatus::SUCCESS) {
+        return false;
+    }
+    _blocks.insert(_blocks.begin() + next, reserved.allocations.front());
+    _reserved_bytes += reserved.allocations.front().second;
+    _current = next;
+    _offset = 0;
+    return true;
+}
+
+void BumpArena::Rewind(const Marker& mark) {
+    _current = mark.block;
+    _offset = mark.offset;
+}
+
+size_t BumpArena::Trim() {
+    size_t keep = (_current < _blocks.size()) ? _current + 1 : 0;
+    size_t released = 0;
+    for (size_t ii = keep; ii < _blocks.size(); ++ii) {
+        _manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {_blocks[ii]}));
+        released += _blocks[ii].second;
+    }
+    _blocks.erase(_blocks.begin() + keep, _blocks.end());
+    _reserved_bytes -= released;
+    return released;
+}
+
+size_t BumpArena::getUsedBytes() const {
+    if (_current >= _blocks.size()) {
+        return 0;
+    }
+    size_t used = _offset;
+    for (size_t ii = 0; ii < _current; ++ii) {
+        used += _blocks[ii].second;
+    }
+    return used;
+}
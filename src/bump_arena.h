@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "memory_manager.h"
+
+// Stack-style arena for request-scoped temporaries, on top of a MemoryManager. The arena reserves contiguous blocks
+// from the manager, and allocations are just a pointer bump inside the current block. Nothing gets freed one by
+// one: Mark() remembers where the bump pointer is, and Rewind(mark) drops everything allocated since in O(1).
+//
+// The manager's bitset is only touched when a block gets reserved or released. Blocks stay reserved across
+// Rewind() so the next request reuses them without going back to the manager, and only Trim() (or the
+// destructor) hands the unused ones back.
+//
+// Marks work like a stack: rewinding to a mark invalidates every mark taken after it. Like MemoryManager, this is
+// NOT thread-safe, and the manager needs to outlive the arena.
+class BumpArena {
+  public:
+    // Where the bump pointer was, see Mark()
+    struct Marker {
+        size_t block;
+        size_t offset;
+    };
+
+    // Rewinds to wherever the arena was at construction when it goes out of scope
+    class Scope {
+      public:
+        explicit Scope(BumpArena& arena)
+        : _arena(arena)
+        , _mark(arena.Mark()) {}
+        ~Scope() { _arena.Rewind(_mark); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        BumpArena& _arena;
+        Marker _mark;
+    };
+
+    // block_bytes is how much gets reserved from manager at a time. Requests bigger than that get a block of
+    // their own.
+    BumpArena(MemoryManager& manager, size_t block_bytes);
+    ~BumpArena();
+
+    BumpArena(const BumpArena&) = delete;
+    BumpArena& operator=(const BumpArena&) = delete;
+
+    // size bytes aligned to alignment (a power of two), or nullptr if the manager can't give us another block
+    char* Alloc(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    Marker Mark() const { return Marker{_current, _offset}; }
+
+    // Drops everything allocated since mark was taken, O(1)
+    void Rewind(const Marker& mark);
+
+    // Drops everything
+    void Reset() { Rewind(Marker{0, 0}); }
+
+    // Hands the blocks after the current one back to the manager, returns how many bytes that was
+    size_t Trim();
+
+    // Bytes reserved from the manager, and bytes handed out since the last Reset() (alignment padding included)
+    size_t getReservedBytes() const { return _reserved_bytes; }
+    size_t getUsedBytes() const;
+
+  private:
+    // Moves _current to a block with room for size bytes at alignment, reserving one if none of the blocks after it
+    // have room. false if the manager said no.
+    bool advance(size_t size, size_t alignment);
+
+    // Where the next allocation of alignment would start in block, as an offset into it
+    size_t alignedOffset(size_t block, size_t offset, size_t alignment) const;
+
+    MemoryManager& _manager;
+    size_t _block_bytes;
+
+    // every reserved block in order, one extent each
+    std::vector<std::pair<char*, size_t>> _blocks;
+    size_t _current;
+    size_t _offset;
+    size_t _reserved_bytes;
+};
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "bump_arena.h"
+
+#define BUFFER_SIZE 4096
+#define BLOCK_BYTES 1024
+
+class BumpArenaTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    _manager.reset(new MemoryManager(_buffer, BUFFER_SIZE));
+  }
+
+  alignas(64) char _buffer[BUFFER_SIZE];
+  std::unique_ptr<MemoryManager> _manager;
+};
+
+TEST_F(BumpArenaTest, bumpsInsideOneBlock) {
+    BumpArena arena(*_manager, BLOCK_BYTES);
+    EXPECT_EQ(arena.getReservedBytes(), 0);
+
+    char* first = arena.Alloc(100, 1);
+    char* second = arena.Alloc(100, 1);
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    EXPECT_EQ(second, first + 100);
+    memset(first, 'x', 200);
+
+    // only the one block came out of the manager
+    EXPECT_EQ(arena.getReservedBytes(), BLOCK_BYTES);
+    EXPECT_EQ(arena.getUsedBytes(), 200);
+    EXPECT_EQ(_manager->getFreeBytes(), BUFFER_SIZE - BLOCK_BYTES);
+}
+
+TEST_F(BumpArenaTest, rewindReusesTheSameMemory) {
+    BumpArena arena(*_manager, BLOCK_BYTES);
+    ASSERT_NE(arena.Alloc(64), nullptr);
+
+    BumpArena::Marker mark = arena.Mark();
+    char* before = arena.Alloc(500);
+    ASSERT_NE(arena.Alloc(800), nullptr);
+    EXPECT_EQ(arena.getReservedBytes(), 2 * BLOCK_BYTES);
+
+    // back to where the mark was, with both blocks still reserved for next time
+    arena.Rewind(mark);
+    EXPECT_EQ(arena.getUsedBytes(), 64);
+    EXPECT_EQ(arena.Alloc(500), before);
+    EXPECT_NE(arena.Alloc(800), nullptr);
+    EXPECT_EQ(arena.getReservedBytes(), 2 * BLOCK_BYTES);
+    EXPECT_EQ(_manager->getFreeBytes(), BUFFER_SIZE - 2 * BLOCK_BYTES);
+
+    arena.Reset();
+    EXPECT_EQ(arena.getUsedBytes(), 0);
+}
+
+TEST_F(BumpArenaTest, scopeRewindsOnExit) {
+    BumpArena arena(*_manager, BLOCK_BYTES);
+    char* outside = arena.Alloc(10, 1);
+    ASSERT_NE(outside, nullptr);
+
+    char* inside = nullptr;
+    {
+        BumpArena::Scope scope(arena);
+        inside = arena.Alloc(300, 1);
+        ASSERT_NE(inside, nullptr);
+        {
+            BumpArena::Scope nested(arena);
+            ASSERT_NE(arena.Alloc(300, 1), nullptr);
+        }
+        EXPECT_EQ(arena.getUsedBytes(), 310);
+    }
+    EXPECT_EQ(arena.getUsedBytes(), 10);
+    EXPECT_EQ(arena.Alloc(300, 1), inside);
+}
+
+TEST_F(BumpArenaTest, alignsAllocations) {
+    BumpArena arena(*_manager, BLOCK_BYTES);
+    ASSERT_NE(arena.Alloc(1, 1), nullptr);
+    for (size_t alignment : {2, 8, 16, 64}) {
+        char* ptr = arena.Alloc(3, alignment);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+    }
+    EXPECT_EQ(arena.Alloc(8, 3), nullptr);
+    EXPECT_EQ(arena.Alloc(8, 0), nullptr);
+}
+
+TEST_F(BumpArenaTest, oversizedRequestGetsItsOwnBlock) {
+    BumpArena arena(*_manager, BLOCK_BYTES);
+    ASSERT_NE(arena.Alloc(10, 1), nullptr);
+    char* big = arena.Alloc(2 * BLOCK_BYTES, 1);
+    ASSERT_NE(big, nullptr);
+    memset(big, 'x', 2 * BLOCK_BYTES);
+    EXPECT_EQ(arena.getReservedBytes(), 3 * BLOCK_BYTES);
+    EXPECT_EQ(arena.getUsedBytes(), BLOCK_BYTES + 2 * BLOCK_BYTES);
+}
+
+TEST_F(BumpArenaTest, trimAndDestructorGiveMemoryBack) {
+    {
+        BumpArena arena(*_manager, BLOCK_BYTES);
+        ASSERT_NE(arena.Alloc(BLOCK_BYTES, 1), nullptr);
+        ASSERT_NE(arena.Alloc(BLOCK_BYTES, 1), nullptr);
+        ASSERT_NE(arena.Alloc(BLOCK_BYTES, 1), nullptr);
+        EXPECT_EQ(_manager->getFreeBytes(), BUFFER_SIZE - 3 * BLOCK_BYTES);
+
+        // keeps the first block since that's the current one after a Reset()
+        arena.Reset();
+        EXPECT_EQ(arena.Trim(), 2 * BLOCK_BYTES);
+        EXPECT_EQ(arena.getReservedBytes(), BLOCK_BYTES);
+        EXPECT_EQ(_manager->getFreeBytes(), BUFFER_SIZE - BLOCK_BYTES);
+    }
+    EXPECT_EQ(_manager->getFreeBytes(), BUFFER_SIZE);
+}
+
+TEST_F(BumpArenaTest, failsWhenTheManagerIsFull) {
+    BumpArena arena(*_manager, BLOCK_BYTES);
+    for (int ii = 0; ii < BUFFER_SIZE / BLOCK_BYTES; ++ii) {
+        ASSERT_NE(arena.Alloc(BLOCK_BYTES, 1), nullptr);
+    }
+    EXPECT_EQ(arena.Alloc(1, 1), nullptr);
+    EXPECT_EQ(arena.Alloc(SIZE_MAX, 1), nullptr);
+
+    // a failed Alloc() leaves the arena as it was
+    EXPECT_EQ(arena.getUsedBytes(), BUFFER_SIZE);
+}
@@ -0,0 +1,334 @@
+#include "concurrency_schemes.h"
+
+#include <algorithm>
+#include <chrono>
+
+std::unique_lock<std::mutex> ConcurrentAllocator::lockAndMeasure(std::mutex& mutex) {
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        return lock;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    lock.lock();
+    recordWait(std::chrono::steady_clock::now() - start);
+    return lock;
+}
+
+void ConcurrentAllocator::recordWait(std::chrono::nanoseconds waited) {
+    _lock_wait_nanos.fetch_add(waited.count(), std::memory_order_relaxed);
+    _lock_contentions.fetch_add(1, std::memory_order_relaxed);
+}
+
+SingleMutexAllocator::SingleMutexAllocator(char* buffer, size_t num_bytes, size_t block_size, AllocPolicy policy)
+: _mutex()
+, _manager(buffer, num_bytes, block_size) {
+    _manager.setAllocPolicy(policy);
+}
+
+MemoryBlocks SingleMutexAllocator::Alloc(size_t size) {
+    auto lock = lockAndMeasure(_mutex);
+    return _manager.Alloc(size);
+}
+
+MemoryStatus SingleMutexAllocator::Free(const MemoryBlocks& blocks) {
+    auto lock = lockAndMeasure(_mutex);
+    return _manager.Free(blocks);
+}
+
+FreeSpaceStats SingleMutexAllocator::GetFreeSpaceStats() {
+    auto lock = lockAndMeasure(_mutex);
+    return _manager.GetFreeSpaceStats();
+}
+
+RegionAllocator::RegionAllocator(char* buffer, size_t num_bytes, int num_regions, size_t block_size, AllocPolicy policy)
+: _buffer(buffer)
+, _num_bytes(num_bytes) {
+    if (num_regions < 1) {
+        num_regions = 1;
+    }
+    if (block_size < 1) {
+        block_size = 1;
+    }
+    // at least one block per region, otherwise the regions before the last are empty & regionOf() can't tell where
+    // anything came from
+    size_t num_blocks = num_bytes / block_size;
+    if (num_blocks < static_cast<size_t>(num_regions)) {
+        num_regions = static_cast<int>(std::max<size_t>(num_blocks, 1));
+    }
+    // keep every region boundary on a block boundary, so no block straddles two regions
+    _region_bytes = (num_bytes / num_regions / block_size) * block_size;
+    for (int ii = 0; ii < num_regions; ++ii) {
+        size_t start = ii * _region_bytes;
+        size_t count = (ii == num_regions - 1) ? (num_bytes - start) : _region_bytes;
+        _regions.push_back(std::make_unique<Region>(buffer + start, count, block_size));
+        _regions.back()->manager.setAllocPolicy(policy);
+    }
+}
+
+int RegionAllocator::regionOf(const char* ptr) const {
+    if (ptr < _buffer || ptr >= _buffer + _num_bytes) {
+        return -1;
+    }
+    // less than a block in the whole buffer, which leaves one (useless) region
+    if (_region_bytes == 0) {
+        return static_cast<int>(_regions.size()) - 1;
+    }
+    size_t index = static_cast<size_t>(ptr - _buffer) / _region_bytes;
+    size_t last = _regions.size() - 1;
+    // the last region is the one that can be slightly bigger than the rest
+    return static_cast<int>((index > last) ? last : index);
+}
+
+int RegionAllocator::homeRegion() const {
+    static std::atomic<int> next_thread_index{0};
+    thread_local int thread_index = next_thread_index.fetch_add(1, std::memory_order_relaxed);
+    return thread_index % static_cast<int>(_regions.size());
+}
+
+MemoryBlocks RegionAllocator::Alloc(size_t size) {
+    int home = homeRegion();
+    int num_regions = static_cast<int>(_regions.size());
+    MemoryBlocks result(MemoryStatus::INSUFFICIENT_MEMORY);
+
+    // start at home, then walk the other regions. Every allocation comes from exactly one region, which keeps
+    // Free() simple & means an allocation never holds two region locks at once
+    for (int ii = 0; ii < num_regions; ++ii) {
+        Region& region = *_regions[(home + ii) % num_regions];
+        auto lock = lockAndMeasure(region.mutex);
+        result = region.manager.Alloc(size);
+        if (result.status == MemoryStatus::SUCCESS) {
+            return result;
+        }
+    }
+
+    // report the status from the last region we tried, which is as good as any
+    return result;
+}
+
+MemoryStatus RegionAllocator::Free(const MemoryBlocks& blocks) {
+    MemoryStatus status = MemoryStatus::SUCCESS;
+    MemoryBlocks batch(MemoryStatus::SUCCESS);
+    int batch_region = -1;
+
+    auto flush = [&]() {
+        if (batch.allocations.empty()) {
+            return;
+        }
+        Region& region = *_regions[batch_region];
+        auto lock = lockAndMeasure(region.mutex);
+        if (region.manager.Free(batch) != MemoryStatus::SUCCESS) {
+            status = MemoryStatus::INVALID_MEMORY_LOCATIONS;
+        }
+        batch.allocations.clear();
+    };
+
+    // consecutive extents almost always share a region, so batch them up to take each lock only once
+    for (const auto& tuple : blocks.allocations) {
+        int region = regionOf(tuple.first);
+        if (region < 0) {
+            status = MemoryStatus::INVALID_MEMORY_LOCATIONS;
+            continue;
+        }
+        if (region != batch_region) {
+            flush();
+            batch_region = region;
+        }
+        batch.allocations.push_back(tuple);
+    }
+    flush();
+
+    return status;
+}
+
+FreeSpaceStats RegionAllocator::GetFreeSpaceStats() {
+    // runs touching a region boundary get counted once per region, which is close enough for reporting
+    FreeSpaceStats total = {0, 0, 0};
+    for (auto& region : _regions) {
+        auto lock = lockAndMeasure(region->mutex);
+        FreeSpaceStats stats = region->manager.GetFreeSpaceStats();
+        total.free_bytes += stats.free_bytes;
+        total.free_runs += stats.free_runs;
+        if (stats.largest_free_run > total.largest_free_run) {
+            total.largest_free_run = stats.largest_free_run;
+        }
+    }
+    return total;
+}
+
+AsyncRingAllocator::AsyncRingAllocator(char* buffer, size_t num_bytes, size_t block_size, AllocPolicy policy)
+: _buffer(buffer)
+, _num_bytes(num_bytes)
+, _manager(buffer, num_bytes, block_size)
+, _free_ring(kFreeRingSize)
+, _free_head(0)
+, _free_tail(0)
+, _failed_frees(0)
+, _stopping(false)
+, _service_sleeping(false) {
+    _manager.setAllocPolicy(policy);
+    for (size_t ii = 0; ii < kFreeRingSize; ++ii) {
+        _free_ring[ii].sequence.store(ii, std::memory_order_relaxed);
+    }
+    // the manager & the ring have to be set up before the servicing thread starts looking at them
+    _service_thread = std::thread(&AsyncRingAllocator::serviceLoop, this);
+}
+
+AsyncRingAllocator::~AsyncRingAllocator() {
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _stopping = true;
+    }
+    _request_cv.notify_one();
+    _service_thread.join();
+}
+
+MemoryBlocks AsyncRingAllocator::Alloc(size_t size) {
+    Request request{RequestKind::ALLOC, size, MemoryBlocks(), {}, 0, false};
+    submit(request);
+    return std::move(request.blocks);
+}
+
+MemoryStatus AsyncRingAllocator::Free(const MemoryBlocks& blocks) {
+    // the buffer never changes, so this much can be checked without the servicing thread
+    for (const auto& tuple : blocks.allocations) {
+        if (tuple.first < _buffer || tuple.first >= _buffer + _num_bytes) {
+            return MemoryStatus::INVALID_MEMORY_LOCATIONS;
+        }
+    }
+    if (blocks.allocations.empty()) {
+        return MemoryStatus::SUCCESS;
+    }
+
+    if (!pushFree(blocks)) {
+        // ring's full: that's this scheme's version of lock contention, so it gets counted the same way
+        auto begin = std::chrono::steady_clock::now();
+        do {
+            wakeService();
+            std::this_thread::yield();
+        } while (!pushFree(blocks));
+        recordWait(std::chrono::steady_clock::now() - begin);
+    }
+    wakeService();
+    return MemoryStatus::SUCCESS;
+}
+
+FreeSpaceStats AsyncRingAllocator::GetFreeSpaceStats() {
+    // only the servicing thread may touch the manager, so this goes through the queue like Alloc() does
+    Request request{RequestKind::STATS, 0, MemoryBlocks(), {}, 0, false};
+    submit(request);
+    return request.stats;
+}
+
+void AsyncRingAllocator::submit(Request& request) {
+    // anything this thread freed before now has claimed a position below this
+    request.free_target = _free_head.load(std::memory_order_acquire);
+    auto lock = lockAndMeasure(_queue_mutex);
+    _queue.push_back(&request);
+    _request_cv.notify_one();
+    _reply_cv.wait(lock, [&request]() { return request.done; });
+}
+
+bool AsyncRingAllocator::pushFree(const MemoryBlocks& blocks) {
+    size_t pos = _free_head.load(std::memory_order_relaxed);
+    FreeSlot* slot;
+    while (true) {
+        slot = &_free_ring[pos & (kFreeRingSize - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (_free_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // still holding a free from one lap ago
+            return false;
+        } else {
+            pos = _free_head.load(std::memory_order_relaxed);
+        }
+    }
+    slot->blocks = blocks;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void AsyncRingAllocator::wakeService() {
+    // pairs with the fence in serviceLoop(): either the servicing thread sees the free we just published before it
+    // goes to sleep, or we see it's asleep here. Taking the lock for the notify means it can't be between checking
+    // and waiting, so the wakeup can't get lost.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_service_sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _request_cv.notify_one();
+    }
+}
+
+bool AsyncRingAllocator::hasPendingFrees() const {
+    const FreeSlot& slot = _free_ring[_free_tail & (kFreeRingSize - 1)];
+    return slot.sequence.load(std::memory_order_acquire) == _free_tail + 1;
+}
+
+void AsyncRingAllocator::drainFrees(size_t target) {
+    while (true) {
+        if (!hasPendingFrees()) {
+            if (_free_tail >= target) {
+                return;
+            }
+            // claimed but not published yet, which is only ever a few instructions away
+            std::this_thread::yield();
+            continue;
+        }
+        FreeSlot& slot = _free_ring[_free_tail & (kFreeRingSize - 1)];
+        if (_manager.Free(slot.blocks) != MemoryStatus::SUCCESS) {
+            _failed_frees.fetch_add(1, std::memory_order_relaxed);
+        }
+        slot.blocks.allocations.clear();
+        slot.sequence.store(_free_tail + kFreeRingSize, std::memory_order_release);
+        ++_free_tail;
+    }
+}
+
+void AsyncRingAllocator::serviceLoop() {
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    while (true) {
+        // frees come in without the lock, see wakeService() for how their wakeups still make it here
+        _service_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        _request_cv.wait(lock, [this]() { return _stopping || !_queue.empty() || hasPendingFrees(); });
+        _service_sleeping.store(false, std::memory_order_relaxed);
+
+        // drain everything queued so far in one go, without holding the queue lock while we work the manager
+        std::deque<Request*> batch;
+        batch.swap(_queue);
+        bool stopping = _stopping;
+        lock.unlock();
+
+        // frees first, so the requests below see every free that was queued before them
+        size_t target = 0;
+        for (Request* request : batch) {
+            target = std::max(target, request->free_target);
+        }
+        drainFrees(target);
+        for (Request* request : batch) {
+            switch (request->kind) {
+                case RequestKind::ALLOC:
+                    request->blocks = _manager.Alloc(request->size);
+                    break;
+                case RequestKind::STATS:
+                    request->stats = _manager.GetFreeSpaceStats();
+                    break;
+            }
+        }
+
+        lock.lock();
+        for (Request* request : batch) {
+            request->done = true;
+        }
+        _reply_cv.notify_all();
+        if (stopping && _queue.empty()) {
+            // nobody can be calling in anymore, this just catches frees that raced the last drain
+            drainFrees(0);
+            return;
+        }
+    }
+}
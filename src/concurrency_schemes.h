@@ -0,0 +1,184 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "memory_manager.h"
+
+// MemoryManager itself is NOT thread-safe. This file has the thread-safety schemes discussed in the README, each
+// wrapping one or more MemoryManager objects behind the same Alloc/Free interface so they can be compared
+// head-to-head (see memory_manager_stress.cpp):
+//
+//   - SingleMutexAllocator: one manager, one mutex. Simple, but only 1 thread at a time gets the buffer.
+//   - RegionAllocator: the buffer is split into regions, each with its own manager & mutex. Threads start in
+//     "their" region and only wander into others when theirs can't satisfy a request.
+//   - AsyncRingAllocator: one dedicated thread owns the manager. Free() is fire-and-forget: callers drop the extents
+//     into a lock-free ring & go on their way. Alloc() needs an answer, so it hands the request over through a queue
+//     and waits for the reply. The manager is never locked, only the Alloc() queue is.
+//
+// Every scheme keeps track of how long callers spent waiting to get into the allocator, which is the number
+// that tells you whether a scheme scales or not. Every scheme also takes the AllocPolicy its managers should use.
+
+class ConcurrentAllocator {
+  public:
+    virtual ~ConcurrentAllocator() = default;
+
+    virtual MemoryBlocks Alloc(size_t size) = 0;
+    virtual MemoryStatus Free(const MemoryBlocks& blocks) = 0;
+
+    virtual const char* name() const = 0;
+
+    // Free space layout across everything this allocator manages
+    virtual FreeSpaceStats GetFreeSpaceStats() = 0;
+
+    // Total time callers spent blocked waiting on a lock, in nanoseconds, and how many times they had to wait
+    uint64_t getLockWaitNanos() const { return _lock_wait_nanos.load(std::memory_order_relaxed); }
+    uint64_t getLockContentions() const { return _lock_contentions.load(std::memory_order_relaxed); }
+
+  protected:
+    // Locks mutex, only paying for a clock read when the lock is actually contended
+    std::unique_lock<std::mutex> lockAndMeasure(std::mutex& mutex);
+
+    // For schemes that wait on something other than a mutex
+    void recordWait(std::chrono::nanoseconds waited);
+
+  private:
+    std::atomic<uint64_t> _lock_wait_nanos{0};
+    std::atomic<uint64_t> _lock_contentions{0};
+};
+
+class SingleMutexAllocator : public ConcurrentAllocator {
+  public:
+    SingleMutexAllocator(char* buffer, size_t num_bytes, size_t block_size = 1, AllocPolicy policy = AllocPolicy::NEXT_FIT);
+
+    MemoryBlocks Alloc(size_t size) override;
+    MemoryStatus Free(const MemoryBlocks& blocks) override;
+    const char* name() const override { return "mutex"; }
+    FreeSpaceStats GetFreeSpaceStats() override;
+
+  private:
+    std::mutex _mutex;
+    MemoryManager _manager;
+};
+
+class RegionAllocator : public ConcurrentAllocator {
+  public:
+    // Regions are a whole number of blocks each, and the last region picks up the leftover bytes when num_bytes
+    // doesn't split evenly. Asking for more regions than there are blocks gets one region per block.
+    RegionAllocator(char* buffer, size_t num_bytes, int num_regions, size_t block_size = 1,
+                    AllocPolicy policy = AllocPolicy::NEXT_FIT);
+
+    MemoryBlocks Alloc(size_t size) override;
+    MemoryStatus Free(const MemoryBlocks& blocks) override;
+    const char* name() const override { return "regions"; }
+    FreeSpaceStats GetFreeSpaceStats() override;
+
+  private:
+    struct Region {
+        Region(char* buffer, size_t num_bytes, size_t block_size)
+        : start(buffer)
+        , manager(buffer, num_bytes, block_size) {}
+
+        char* start;
+        std::mutex mutex;
+        MemoryManager manager;
+    };
+
+    // Which region a given pointer belongs to, or -1 if it's outside of the buffer
+    int regionOf(const char* ptr) const;
+
+    // Home region for the calling thread, so threads don't all pile into region 0
+    int homeRegion() const;
+
+    char* _buffer;
+    size_t _num_bytes;
+    size_t _region_bytes;
+    std::vector<std::unique_ptr<Region>> _regions;
+};
+
+class AsyncRingAllocator : public ConcurrentAllocator {
+  public:
+    AsyncRingAllocator(char* buffer, size_t num_bytes, size_t block_size = 1, AllocPolicy policy = AllocPolicy::NEXT_FIT);
+    ~AsyncRingAllocator() override;
+
+    MemoryBlocks Alloc(size_t size) override;
+
+    // Only checks that every extent is inside the buffer before queueing the free, and returns right away. Anything
+    // the manager rejects later on (eg a length running past the end) shows up in getFailedFrees() instead. The
+    // servicing thread works off every free queued before an Alloc() or GetFreeSpaceStats() call before answering it,
+    // so a thread always gets to reuse what it freed itself.
+    MemoryStatus Free(const MemoryBlocks& blocks) override;
+
+    const char* name() const override { return "async"; }
+    FreeSpaceStats GetFreeSpaceStats() override;
+
+    // How many queued frees the manager rejected so far
+    uint64_t getFailedFrees() const { return _failed_frees.load(std::memory_order_relaxed); }
+
+  private:
+    // Power of 2, so a position maps to a slot with a mask. When the ring is full, Free() yields until the servicing
+    // thread catches up.
+    static constexpr size_t kFreeRingSize = 1024;
+
+    enum class RequestKind {
+        ALLOC,
+        STATS,
+    };
+
+    struct Request {
+        RequestKind kind;
+        size_t size;
+        MemoryBlocks blocks;  // what got allocated
+        FreeSpaceStats stats;
+        size_t free_target;   // _free_head when the request got queued, every free before that lands first
+        bool done;
+    };
+
+    // A slot is free for the producer claiming position pos when sequence == pos, and holds a free ready for the
+    // servicing thread when sequence == pos + 1 (bounded multi-producer queue a la Vyukov, with a single consumer)
+    struct FreeSlot {
+        std::atomic<size_t> sequence;
+        MemoryBlocks blocks;
+    };
+
+    // Hands the request to the servicing thread & blocks until it has been fulfilled
+    void submit(Request& request);
+
+    // false if the ring is full
+    bool pushFree(const MemoryBlocks& blocks);
+
+    // Wakes the servicing thread up after a free, if it's asleep. Takes the queue lock only in that case.
+    void wakeService();
+
+    // Servicing thread only. drainFrees() works off every free that's in the ring, and also waits out the ones
+    // claimed before position target that their producers are still busy writing.
+    bool hasPendingFrees() const;
+    void drainFrees(size_t target);
+
+    void serviceLoop();
+
+    char* _buffer;
+    size_t _num_bytes;
+    MemoryManager _manager;
+
+    std::vector<FreeSlot> _free_ring;
+    std::atomic<size_t> _free_head;  // next position a producer claims
+    size_t _free_tail;                // next position the servicing thread takes, only ever touched by it
+    std::atomic<uint64_t> _failed_frees;
+
+    std::mutex _queue_mutex;
+    std::condition_variable _request_cv;
+    std::condition_variable _reply_cv;
+    std::deque<Request*> _queue;
+    bool _stopping;
+    std::atomic<bool> _service_sleeping;  // set by the servicing thread around its wait, see wakeService()
+
+    std::thread _service_thread;
+};
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "concurrency_schemes.h"
+
+#define SCHEME_BUFFER_SIZE 4096
+
+namespace {
+
+int getBlockSum(const MemoryBlocks& block) {
+    int sum = 0;
+    for (const auto& tuple : block.allocations) {
+        sum += tuple.second;
+    }
+    return sum;
+}
+
+}  // namespace
+
+class ConcurrencySchemesTest : public testing::TestWithParam<const char*> {
+ protected:
+  void SetUp() override {
+    std::string scheme = GetParam();
+    if (scheme == "mutex") {
+        _allocator.reset(new SingleMutexAllocator(_buffer, SCHEME_BUFFER_SIZE));
+    } else if (scheme == "regions") {
+        _allocator.reset(new RegionAllocator(_buffer, SCHEME_BUFFER_SIZE, 4));
+    } else {
+        _allocator.reset(new AsyncRingAllocator(_buffer, SCHEME_BUFFER_SIZE));
+    }
+  }
+
+  char _buffer[SCHEME_BUFFER_SIZE];
+  std::unique_ptr<ConcurrentAllocator> _allocator;
+};
+
+TEST_P(ConcurrencySchemesTest, allocThenFree) {
+    MemoryBlocks block = _allocator->Alloc(100);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(getBlockSum(block), 100);
+
+    EXPECT_EQ(_allocator->Free(block), MemoryStatus::SUCCESS);
+}
+
+TEST_P(ConcurrencySchemesTest, freeInvalidLocations) {
+    MemoryBlocks block = MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer + SCHEME_BUFFER_SIZE, 1 } });
+    EXPECT_EQ(_allocator->Free(block), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+}
+
+TEST_P(ConcurrencySchemesTest, threadsNeverShareBytes) {
+    // every thread grabs 8 x 64 bytes (the whole buffer between them), then checks nobody else scribbled on them
+    const int num_threads = 8;
+    std::vector<std::thread> threads;
+    std::vector<std::vector<MemoryBlocks>> held(num_threads);
+    for (int tt = 0; tt < num_threads; ++tt) {
+        threads.emplace_back([this, tt, &held]() {
+            for (int ii = 0; ii < 8; ++ii) {
+                MemoryBlocks block = _allocator->Alloc(64);
+                if (block.status == MemoryStatus::SUCCESS) {
+                    for (const auto& tuple : block.allocations) {
+                        std::fill(tuple.first, tuple.first + tuple.second, static_cast<char>(tt));
+                    }
+                    held[tt].push_back(block);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    int total = 0;
+    for (int tt = 0; tt < num_threads; ++tt) {
+        for (const auto& block : held[tt]) {
+            for (const auto& tuple : block.allocations) {
+                for (size_t ii = 0; ii < tuple.second; ++ii) {
+                    EXPECT_EQ(tuple.first[ii], static_cast<char>(tt));
+                }
+            }
+            total += getBlockSum(block);
+            EXPECT_EQ(_allocator->Free(block), MemoryStatus::SUCCESS);
+        }
+    }
+    EXPECT_EQ(total, SCHEME_BUFFER_SIZE);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllSchemes, ConcurrencySchemesTest, testing::Values("mutex", "regions", "async"));
+
+TEST(RegionAllocatorTest, moreRegionsThanBytes) {
+    // 4 bytes can't make 8 regions, so it's one region per byte & every free finds its region
+    char buffer[4];
+    RegionAllocator allocator(buffer, sizeof(buffer), 8);
+
+    std::vector<MemoryBlocks> blocks;
+    for (int ii = 0; ii < 4; ++ii) {
+        blocks.push_back(allocator.Alloc(1));
+        ASSERT_EQ(blocks.back().status, MemoryStatus::SUCCESS);
+    }
+    EXPECT_NE(allocator.Alloc(1).status, MemoryStatus::SUCCESS);
+    for (const auto& block : blocks) {
+        EXPECT_EQ(allocator.Free(block), MemoryStatus::SUCCESS);
+    }
+    for (int ii = 0; ii < 4; ++ii) {
+        EXPECT_EQ(allocator.Alloc(1).status, MemoryStatus::SUCCESS);
+    }
+}
+
+TEST(RegionAllocatorTest, moreRegionsThanBlocks) {
+    // 4 blocks of 16 bytes can't make 8 regions, so it's one region per block & every free finds its region
+    char buffer[64];
+    RegionAllocator allocator(buffer, sizeof(buffer), 8, 16);
+
+    std::vector<MemoryBlocks> blocks;
+    for (int ii = 0; ii < 4; ++ii) {
+        blocks.push_back(allocator.Alloc(16));
+        ASSERT_EQ(blocks.back().status, MemoryStatus::SUCCESS);
+    }
+    EXPECT_NE(allocator.Alloc(1).status, MemoryStatus::SUCCESS);
+    for (const auto& block : blocks) {
+        EXPECT_EQ(allocator.Free(block), MemoryStatus::SUCCESS);
+    }
+    EXPECT_EQ(allocator.GetFreeSpaceStats().free_bytes, 64);
+}
+
+TEST(AsyncRingAllocatorTest, freesAreQueuedAndLandBeforeTheNextAlloc) {
+    char buffer[SCHEME_BUFFER_SIZE];
+    AsyncRingAllocator allocator(buffer, SCHEME_BUFFER_SIZE);
+
+    // more frees than the ring holds, each one returning without waiting on the servicing thread
+    for (int round = 0; round < 40; ++round) {
+        std::vector<MemoryBlocks> blocks;
+        for (int ii = 0; ii < SCHEME_BUFFER_SIZE / 64; ++ii) {
+            blocks.push_back(allocator.Alloc(64));
+            ASSERT_EQ(blocks.back().status, MemoryStatus::SUCCESS);
+        }
+        for (const auto& block : blocks) {
+            EXPECT_EQ(allocator.Free(block), MemoryStatus::SUCCESS);
+        }
+    }
+    // every free above is done by the time an alloc gets serviced
+    MemoryBlocks whole = allocator.Alloc(SCHEME_BUFFER_SIZE);
+    ASSERT_EQ(whole.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(allocator.Free(whole), MemoryStatus::SUCCESS);
+
+    // running past the end passes the quick check, the manager catches it later on
+    EXPECT_EQ(allocator.Free(MemoryBlocks(MemoryStatus::SUCCESS, { { buffer + SCHEME_BUFFER_SIZE - 1, 64 } })), MemoryStatus::SUCCESS);
+    EXPECT_EQ(allocator.Alloc(SCHEME_BUFFER_SIZE).status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(allocator.getFailedFrees(), 1);
+}
+
+TEST(AsyncRingAllocatorTest, ownFreesLandEvenWhileOthersArePushing) {
+    // 4 threads each hold a quarter of the buffer at a time. A thread's own free always lands before its next alloc,
+    // and the others account for at most a quarter each (held or still in the ring), so every alloc has room.
+    char buffer[SCHEME_BUFFER_SIZE];
+    AsyncRingAllocator allocator(buffer, SCHEME_BUFFER_SIZE);
+    const int num_threads = 4;
+    std::atomic<int> failed(0);
+    std::vector<std::thread> threads;
+    for (int tt = 0; tt < num_threads; ++tt) {
+        threads.emplace_back([&allocator, &failed]() {
+            for (int round = 0; round < 2000; ++round) {
+                MemoryBlocks block = allocator.Alloc(SCHEME_BUFFER_SIZE / num_threads);
+                if (block.status != MemoryStatus::SUCCESS) {
+                    failed.fetch_add(1);
+                    continue;
+                }
+                allocator.Free(block);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(failed.load(), 0);
+    EXPECT_EQ(allocator.GetFreeSpaceStats().free_bytes, SCHEME_BUFFER_SIZE);
+}
+
+TEST(ConcurrencySchemesPolicyTest, managersUseThePolicy) {
+    // 64 blocks of 64 bytes: XXXX-X--XXX... after the frees below. Next-fit picks the hole at the front, MIN_FRAGMENTS
+    // the smallest hole that fits
+    char buffer[SCHEME_BUFFER_SIZE];
+    for (const char* scheme : { "mutex", "regions", "async" }) {
+        for (AllocPolicy policy : { AllocPolicy::NEXT_FIT, AllocPolicy::MIN_FRAGMENTS }) {
+            std::unique_ptr<ConcurrentAllocator> allocator;
+            if (std::string(scheme) == "mutex") {
+                allocator.reset(new SingleMutexAllocator(buffer, SCHEME_BUFFER_SIZE, 64, policy));
+            } else if (std::string(scheme) == "regions") {
+                allocator.reset(new RegionAllocator(buffer, SCHEME_BUFFER_SIZE, 1, 64, policy));
+            } else {
+                allocator.reset(new AsyncRingAllocator(buffer, SCHEME_BUFFER_SIZE, 64, policy));
+            }
+            MemoryBlocks first = allocator->Alloc(4 * 64);
+            ASSERT_EQ(allocator->Alloc(64).status, MemoryStatus::SUCCESS);
+            MemoryBlocks third = allocator->Alloc(2 * 64);
+            ASSERT_EQ(allocator->Alloc(SCHEME_BUFFER_SIZE - 7 * 64).status, MemoryStatus::SUCCESS);
+            ASSERT_EQ(allocator->Free(first), MemoryStatus::SUCCESS);
+            ASSERT_EQ(allocator->Free(third), MemoryStatus::SUCCESS);
+
+            MemoryBlocks block = allocator->Alloc(2 * 64);
+            ASSERT_EQ(block.status, MemoryStatus::SUCCESS) << scheme;
+            char* expected = (policy == AllocPolicy::NEXT_FIT) ? buffer : buffer + 5 * 64;
+            EXPECT_EQ(block.allocations.front().first, expected) << scheme;
+        }
+    }
+}
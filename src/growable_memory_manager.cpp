@@ -0,0 +1,149 @@
+#include "growable_memory_manager.h"
+
+#include <algorithm>
+#include <cstdint>
+
+GrowableMemoryManager::GrowableMemoryManager(size_t chunk_bytes, size_t block_size, size_t max_bytes)
+: _chunk_bytes(chunk_bytes)
+, _block_size(std::max<size_t>(block_size, 1))
+, _max_bytes(max_bytes)
+, _mapped_bytes(0)
+, _chunks()
+, _current(_chunks.end())
+, _empty_chunks(0) {}
+
+MemoryBlocks GrowableMemoryManager::Alloc(size_t size) {
+    // skipping chunks by their free byte count is only a quick reject, a chunk with enough free bytes can still be
+    // too fragmented to fit the request & then it's on to the next one
+    auto tryChunk = [&](ChunkMap::iterator it, MemoryBlocks& result) {
+        MemoryManager& chunk = *it->second;
+        if (chunk.getFreeBytes() < size) {
+            return false;
+        }
+        bool was_empty = isEmpty(chunk);
+        result = chunk.Alloc(size);
+        if (result.status != MemoryStatus::SUCCESS) {
+            return false;
+        }
+        if (was_empty && !isEmpty(chunk)) {
+            --_empty_chunks;
+        }
+        _current = it;
+        return true;
+    };
+
+    MemoryBlocks result;
+    if (_current != _chunks.end() && tryChunk(_current, result)) {
+        return result;
+    }
+    for (auto it = _chunks.begin(); it != _chunks.end(); ++it) {
+        if (it != _current && tryChunk(it, result)) {
+            return result;
+        }
+    }
+
+    auto added = addChunk(size);
+    if (added == _chunks.end()) {
+        return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+    }
+    // a fresh chunk always fits, and only stays empty (as the spare) for size 0
+    ++_empty_chunks;
+    tryChunk(added, result);
+    return result;
+}
+
+GrowableMemoryManager::ChunkMap::iterator GrowableMemoryManager::addChunk(size_t size) {
+    if (size > SIZE_MAX - _block_size) {
+        return _chunks.end();
+    }
+    size_t needed = ((size + _block_size - 1) / _block_size) * _block_size;
+    // whole pages, which is what gets mapped anyway & what counts against max_bytes
+    size_t page_size = BackingStore::getPageSize();
+    size_t num_bytes = std::max(_chunk_bytes, needed);
+    if (num_bytes > SIZE_MAX - page_size) {
+        return _chunks.end();
+    }
+    num_bytes = ((num_bytes + page_size - 1) / page_size) * page_size;
+    if (_max_bytes != 0 && (num_bytes > _max_bytes || _mapped_bytes > _max_bytes - num_bytes)) {
+        return _chunks.end();
+    }
+
+    std::unique_ptr<MemoryManager> chunk = MemoryManager::CreateMapped(num_bytes, _block_size);
+    if (chunk == nullptr) {
+        return _chunks.end();
+    }
+    _mapped_bytes += num_bytes;
+    char* start = chunk->getBuffer();
+    return _chunks.emplace(start, std::move(chunk)).first;
+}
+
+GrowableMemoryManager::ChunkMap::iterator GrowableMemoryManager::chunkOf(char* ptr) {
+    auto it = _chunks.upper_bound(ptr);
+    if (it == _chunks.begin()) {
+        return _chunks.end();
+    }
+    --it;
+    if (ptr >= it->first + it->second->getUsableBytes()) {
+        return _chunks.end();
+    }
+    return it;
+}
+
+MemoryStatus GrowableMemoryManager::Free(const MemoryBlocks& blocks) {
+    MemoryStatus status = MemoryStatus::SUCCESS;
+    MemoryBlocks batch(MemoryStatus::SUCCESS);
+    ChunkMap::iterator batch_chunk = _chunks.end();
+
+    auto flush = [&]() {
+        if (batch.allocations.empty()) {
+            return;
+        }
+        MemoryManager& chunk = *batch_chunk->second;
+        bool was_empty = isEmpty(chunk);
+        if (chunk.Free(batch) != MemoryStatus::SUCCESS) {
+            status = MemoryStatus::INVALID_MEMORY_LOCATIONS;
+        }
+        batch.allocations.clear();
+
+        if (!was_empty && isEmpty(chunk)) {
+            if (_empty_chunks == 0) {
+                ++_empty_chunks;
+                return;
+            }
+            // there's a spare already, this one goes back to the OS
+            if (_current == batch_chunk) {
+                _current = _chunks.end();
+            }
+            _mapped_bytes -= chunk.getCommittedBytes();
+            _chunks.erase(batch_chunk);
+            batch_chunk = _chunks.end();
+        }
+    };
+
+    // same batching as RegionAllocator::Free(), an Alloc() result never spans chunks so this is one Free() per call
+    for (const auto& tuple : blocks.allocations) {
+        auto it = chunkOf(tuple.first);
+        if (it == _chunks.end()) {
+            status = MemoryStatus::INVALID_MEMORY_LOCATIONS;
+            continue;
+        }
+        if (it != batch_chunk) {
+            flush();
+            batch_chunk = it;
+        }
+        batch.allocations.push_back(tuple);
+    }
+    flush();
+    return status;
+}
+
+FreeSpaceStats GrowableMemoryManager::GetFreeSpaceStats() const {
+    FreeSpaceStats total{0, 0, 0};
+    for (const auto& entry : _chunks) {
+        FreeSpaceStats stats = entry.second->GetFreeSpaceStats();
+        total.free_bytes += stats.free_bytes;
+        total.free_runs += stats.free_runs;
+        total.largest_free_run = std::max(total.largest_free_run, stats.largest_free_run);
+    }
+    return total;
+}
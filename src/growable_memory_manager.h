@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <memory>
+
+#include "memory_manager.h"
+
+// A pool of chunks instead of one fixed buffer. Each chunk is its own mapped MemoryManager (so its own bitset), and
+// when no chunk can fit a request, a new one gets mapped instead of failing. Requests bigger than a chunk get a
+// chunk of their own, sized to fit. Every request is served from a single chunk.
+//
+// Chunks that end up completely free are unmapped again, except for one spare that's kept around so a workload
+// hovering right at a chunk boundary doesn't map & unmap a chunk on every other call.
+//
+// Like MemoryManager, this is NOT thread-safe.
+class GrowableMemoryManager {
+  public:
+    // chunk_bytes is the size of every regular chunk, and max_bytes caps the total mapped across all chunks (0 for
+    // no cap). Nothing gets mapped until the first Alloc().
+    explicit GrowableMemoryManager(size_t chunk_bytes, size_t block_size = 1, size_t max_bytes = 0);
+
+    // Allocate from the existing chunks, or a new one if none of them can fit size. OUT_OF_MEMORY when a new
+    // chunk was needed, but would go over max_bytes or couldn't be mapped.
+    MemoryBlocks Alloc(size_t size);
+
+    // Free up memory from any mix of chunks, each extent goes to the chunk it came from
+    MemoryStatus Free(const MemoryBlocks& blocks);
+
+    // Summed over all chunks. free_runs counts runs per chunk, runs never merge across chunks since chunks aren't
+    // next to each other in memory.
+    FreeSpaceStats GetFreeSpaceStats() const;
+
+    size_t getNumChunks() const { return _chunks.size(); }
+
+    // Total bytes mapped across all chunks
+    size_t getMappedBytes() const { return _mapped_bytes; }
+
+  private:
+    using ChunkMap = std::map<char*, std::unique_ptr<MemoryManager>>;
+
+    // Chunk holding ptr, or _chunks.end(). One O(log chunks) lookup.
+    ChunkMap::iterator chunkOf(char* ptr);
+
+    // Maps a new chunk big enough for size, _chunks.end() if it can't
+    ChunkMap::iterator addChunk(size_t size);
+
+    static bool isEmpty(const MemoryManager& chunk) { return chunk.getFreeBytes() == chunk.getUsableBytes(); }
+
+    size_t _chunk_bytes;
+    size_t _block_size;
+    size_t _max_bytes;
+    size_t _mapped_bytes;
+
+    // keyed by chunk start, so the chunk of a pointer is the last one starting at or before it
+    ChunkMap _chunks;
+
+    // chunk the last Alloc() was served from, tried first next time (next-fit at chunk level)
+    ChunkMap::iterator _current;
+
+    // completely free chunks still mapped, at most 1 after every Free()
+    size_t _empty_chunks;
+};
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "growable_memory_manager.h"
+
+#define CHUNK_SIZE 4096
+
+TEST(GrowableMemoryManagerTest, mapsNothingUpFront) {
+    GrowableMemoryManager manager(CHUNK_SIZE);
+    EXPECT_EQ(manager.getNumChunks(), 0);
+    EXPECT_EQ(manager.getMappedBytes(), 0);
+    EXPECT_EQ(manager.GetFreeSpaceStats().free_bytes, 0);
+}
+
+TEST(GrowableMemoryManagerTest, growsInsteadOfFailing) {
+    GrowableMemoryManager manager(CHUNK_SIZE);
+
+    std::vector<MemoryBlocks> blocks;
+    for (int ii = 0; ii < 4; ++ii) {
+        blocks.push_back(manager.Alloc(3000));
+        ASSERT_EQ(blocks.back().status, MemoryStatus::SUCCESS);
+        ASSERT_EQ(blocks.back().allocations.size(), 1);
+        memset(blocks.back().allocations.front().first, 'x', 3000);
+    }
+    // 3000 doesn't fit twice in a chunk, so that's one chunk per request
+    EXPECT_EQ(manager.getNumChunks(), 4);
+    EXPECT_EQ(manager.getMappedBytes(), 4 * CHUNK_SIZE);
+
+    // the leftover 1096 bytes in every chunk still get used before mapping another one
+    MemoryBlocks small = manager.Alloc(1000);
+    ASSERT_EQ(small.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.getNumChunks(), 4);
+    EXPECT_EQ(manager.GetFreeSpaceStats().free_bytes, 4 * (CHUNK_SIZE - 3000) - 1000);
+}
+
+TEST(GrowableMemoryManagerTest, oversizedRequestGetsItsOwnChunk) {
+    GrowableMemoryManager manager(CHUNK_SIZE, 64);
+    MemoryBlocks big = manager.Alloc(3 * CHUNK_SIZE + 1);
+    ASSERT_EQ(big.status, MemoryStatus::SUCCESS);
+    ASSERT_EQ(big.allocations.size(), 1);
+    EXPECT_EQ(big.allocations.front().second, 3 * CHUNK_SIZE + 64);
+    EXPECT_EQ(manager.getNumChunks(), 1);
+}
+
+TEST(GrowableMemoryManagerTest, maxBytesCapsGrowth) {
+    GrowableMemoryManager manager(CHUNK_SIZE, 1, 2 * CHUNK_SIZE);
+    MemoryBlocks first = manager.Alloc(CHUNK_SIZE);
+    MemoryBlocks second = manager.Alloc(CHUNK_SIZE);
+    ASSERT_EQ(first.status, MemoryStatus::SUCCESS);
+    ASSERT_EQ(second.status, MemoryStatus::SUCCESS);
+
+    EXPECT_EQ(manager.Alloc(1).status, MemoryStatus::OUT_OF_MEMORY);
+    EXPECT_EQ(manager.Alloc(3 * CHUNK_SIZE).status, MemoryStatus::OUT_OF_MEMORY);
+    EXPECT_EQ(manager.getNumChunks(), 2);
+
+    // room in an existing chunk is fine again
+    EXPECT_EQ(manager.Free(first), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.Alloc(1).status, MemoryStatus::SUCCESS);
+}
+
+TEST(GrowableMemoryManagerTest, freeFindsOwningChunk) {
+    GrowableMemoryManager manager(CHUNK_SIZE);
+
+    MemoryBlocks all(MemoryStatus::SUCCESS);
+    for (int ii = 0; ii < 8; ++ii) {
+        MemoryBlocks block = manager.Alloc(CHUNK_SIZE);
+        ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+        all.allocations.push_back(block.allocations.front());
+    }
+    EXPECT_EQ(manager.getNumChunks(), 8);
+
+    // free half the chunks in one call with the extents out of order, none of them mixed up
+    MemoryBlocks half(MemoryStatus::SUCCESS, {all.allocations[5], all.allocations[1], all.allocations[7], all.allocations[3]});
+    EXPECT_EQ(manager.Free(half), MemoryStatus::SUCCESS);
+
+    // memory that was never in any chunk
+    char outside[16];
+    EXPECT_EQ(manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {{outside, 16}})), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+}
+
+TEST(GrowableMemoryManagerTest, retiresEmptyChunksButKeepsASpare) {
+    GrowableMemoryManager manager(CHUNK_SIZE);
+
+    std::vector<MemoryBlocks> blocks;
+    for (int ii = 0; ii < 4; ++ii) {
+        blocks.push_back(manager.Alloc(CHUNK_SIZE));
+        ASSERT_EQ(blocks.back().status, MemoryStatus::SUCCESS);
+    }
+    EXPECT_EQ(manager.getNumChunks(), 4);
+
+    // first one to empty out is the spare, the rest get unmapped
+    EXPECT_EQ(manager.Free(blocks[0]), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.getNumChunks(), 4);
+    EXPECT_EQ(manager.Free(blocks[1]), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.Free(blocks[2]), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.getNumChunks(), 2);
+    EXPECT_EQ(manager.getMappedBytes(), 2 * CHUNK_SIZE);
+
+    // the spare gets reused rather than mapping a new chunk, and once it's in use the next empty chunk is the spare
+    MemoryBlocks reused = manager.Alloc(CHUNK_SIZE);
+    ASSERT_EQ(reused.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.getNumChunks(), 2);
+    EXPECT_EQ(manager.Free(blocks[3]), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.getNumChunks(), 2);
+
+    // freeing into a retired chunk is caught rather than corrupting anything
+    EXPECT_EQ(manager.Free(blocks[1]), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+}
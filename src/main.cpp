@@ -2,20 +2,40 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "tclap/CmdLine.h"
 
+#include "allocation_trace.h"
+#include "backing_store.h"
+#include "concurrency_schemes.h"
 #include "memory_manager.h"
+#include "trace_replay.h"
+#include "workload.h"
 
-int main(int argc, char** argv) {
+namespace {
+
+// The original "simple example": 5 byte buffer, alloc 5, free the 2nd & 4th, then alloc 2 again
+int runDemo(const std::string& record_path) {
     std::cout << "Memory Allocation Program\n" << std::endl;
 
     char buffer[5] = {0};
     MemoryManager manager(buffer, 5);
 
+    std::unique_ptr<TraceRecorder> recorder;
+    if (!record_path.empty()) {
+        recorder.reset(new TraceRecorder(record_path, 5));
+        if (!recorder->isOpen()) {
+            std::cout << "Could not open " << record_path << " for recording" << std::endl;
+            return 1;
+        }
+        manager.setTraceRecorder(recorder.get());
+    }
+
     std::cout << "Init buffer of 5 chars" << std::endl;
     manager.Output();
 
@@ -50,3 +70,229 @@ int main(int argc, char** argv) {
 
     return 0;
 }
+
+int runReplay(const std::string& trace_path, size_t buffer_bytes, size_t block_size, const std::string& policy, int sample_every,
+              bool populate, bool huge_pages) {
+    TraceReader reader(trace_path);
+    if (!reader.isOpen()) {
+        std::cout << "Could not read trace " << trace_path << std::endl;
+        return 1;
+    }
+
+    // default to the same buffer size the trace was recorded with
+    if (buffer_bytes == 0) {
+        buffer_bytes = reader.getBufferBytes();
+    }
+    if (buffer_bytes == 0) {
+        std::cout << "Trace has no buffer size, pass --buffer-size" << std::endl;
+        return 1;
+    }
+
+    BackingStore backing(buffer_bytes, populate, huge_pages);
+    if (!backing.isMapped()) {
+        std::cout << "Could not map " << buffer_bytes << " bytes" << std::endl;
+        return 1;
+    }
+    MemoryManager manager(std::move(backing), block_size);
+    AllocPolicy alloc_policy = AllocPolicy::NEXT_FIT;
+    ParseAllocPolicy(policy, alloc_policy);
+    manager.setAllocPolicy(alloc_policy);
+
+    ReplayResult result = ReplayTrace(reader, manager, static_cast<uint64_t>(std::max(0, sample_every)));
+
+    std::cout << "Replayed " << trace_path << " (" << result.events << " events) over "
+              << buffer_bytes << " bytes in " << manager.getBlockSize() << " byte blocks with policy " << policy << std::endl;
+    std::cout << std::fixed << std::setprecision(6);
+    std::cout << "  time in Alloc:        " << result.alloc_seconds << " s" << std::endl;
+    std::cout << "  time in Free:         " << result.free_seconds << " s" << std::endl;
+    std::cout << "  allocs:               " << result.allocs << " (" << result.fragments << " fragments)" << std::endl;
+    std::cout << "  failed allocs:        " << result.failed_allocs
+              << " (recording had " << result.recorded_failed_allocs << ")" << std::endl;
+    std::cout << "  frees:                " << result.frees << std::endl;
+    std::cout << "  failed frees:         " << result.failed_frees << std::endl;
+    std::cout << "  unmapped free bytes:  " << result.unmapped_free_bytes << std::endl;
+    std::cout << std::setprecision(4);
+    std::cout << "  internal frag:        " << result.requested_bytes << " bytes requested, " << result.granted_bytes
+              << " handed out (" << ((result.granted_bytes > 0) ? 1.0 - static_cast<double>(result.requested_bytes) / result.granted_bytes : 0)
+              << " wasted)" << std::endl;
+    std::cout << "  final free bytes:     " << result.final_stats.free_bytes << " in "
+              << result.final_stats.free_runs << " runs, largest " << result.final_stats.largest_free_run << std::endl;
+    std::cout << "  final fragmentation:  " << result.final_stats.fragmentation() << std::endl;
+    std::cout << "  worst fragmentation:  " << result.worst_fragmentation << std::endl;
+
+    return 0;
+}
+
+void printLatency(const char* label, const LatencySummary& latency) {
+    std::cout << "  " << label << " latency (ns):  p50 " << latency.p50 << ", p90 " << latency.p90
+              << ", p99 " << latency.p99 << ", p99.9 " << latency.p999 << ", max " << latency.max << std::endl;
+}
+
+int runBench(size_t buffer_bytes, size_t block_size, const std::string& policy, const std::string& scheme, int threads,
+             const WorkloadConfig& config, bool populate, bool huge_pages) {
+    BackingStore buffer(buffer_bytes, populate, huge_pages);
+    if (!buffer.isMapped()) {
+        std::cout << "Could not map " << buffer_bytes << " bytes" << std::endl;
+        return 1;
+    }
+    AllocPolicy alloc_policy = AllocPolicy::NEXT_FIT;
+    ParseAllocPolicy(policy, alloc_policy);
+    std::unique_ptr<ConcurrentAllocator> allocator;
+    if (scheme == "regions") {
+        allocator.reset(new RegionAllocator(buffer.data(), buffer_bytes, threads, block_size, alloc_policy));
+    } else if (scheme == "async") {
+        allocator.reset(new AsyncRingAllocator(buffer.data(), buffer_bytes, block_size, alloc_policy));
+    } else {
+        allocator.reset(new SingleMutexAllocator(buffer.data(), buffer_bytes, block_size, alloc_policy));
+    }
+
+    WorkloadResult result = RunWorkload(*allocator, config, threads);
+
+    uint64_t ops = result.allocs + result.failed_allocs + result.frees;
+    std::cout << "Ran " << config.ops << " allocations on each of " << threads << " threads over " << buffer_bytes
+              << " bytes in " << block_size << " byte blocks with policy " << policy << " (" << allocator->name()
+              << " scheme)" << std::endl;
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "  elapsed:              " << result.seconds << " s" << std::endl;
+    std::cout << std::setprecision(0);
+    std::cout << "  throughput:           " << ((result.seconds > 0) ? ops / result.seconds : 0) << " ops/s" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "  allocs:               " << result.allocs << " (" << result.failed_allocs << " failed, "
+              << ((result.allocs > 0) ? static_cast<double>(result.fragments) / result.allocs : 0) << " fragments each)" << std::endl;
+    std::cout << "  frees:                " << result.frees << std::endl;
+    printLatency("alloc", result.alloc_latency);
+    printLatency("free ", result.free_latency);
+    std::cout << "  peak live bytes:      " << result.peak_live_bytes << std::endl;
+    std::cout << "  final live bytes:     " << result.live_bytes << " requested, " << result.live_granted_bytes
+              << " handed out" << std::endl;
+    std::cout << "  final free bytes:     " << result.stats.free_bytes << " in " << result.stats.free_runs
+              << " runs, largest " << result.stats.largest_free_run << std::endl;
+    std::cout << std::setprecision(4);
+    std::cout << "  final fragmentation:  " << result.stats.fragmentation() << std::endl;
+    std::cout << "  internal frag:        " << ((result.live_granted_bytes > 0)
+              ? 1.0 - static_cast<double>(result.live_bytes) / result.live_granted_bytes : 0) << std::endl;
+
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string command;
+    std::string record_path;
+    std::string trace_path;
+    size_t buffer_bytes;
+    size_t block_size;
+    std::string policy;
+    int sample_every;
+    bool populate;
+    bool huge_pages;
+    std::string scheme;
+    int threads;
+    WorkloadConfig workload = DefaultWorkloadConfig();
+
+    try {
+        TCLAP::CmdLine cmd("Memory Allocation Program", ' ', "1.0");
+
+        std::vector<std::string> command_names = {"demo", "replay", "bench"};
+        TCLAP::ValuesConstraint<std::string> command_constraint(command_names);
+        TCLAP::UnlabeledValueArg<std::string> command_arg("command", "What to run. demo is the original 5 byte example, "
+                                                          "replay replays a recorded trace, bench runs a synthetic workload",
+                                                          false, "demo", &command_constraint, cmd);
+
+        TCLAP::ValueArg<std::string> record_arg("r", "record", "demo: record a trace of every Alloc/Free to this file",
+                                                false, "", "path", cmd);
+        TCLAP::ValueArg<std::string> trace_arg("t", "trace", "replay: trace file to replay", false, "", "path", cmd);
+        TCLAP::ValueArg<size_t> buffer_arg("b", "buffer-size", "replay/bench: buffer size in bytes (default: the recorded "
+                                           "size for replay, 64 MB for bench)", false, 0, "bytes", cmd);
+        TCLAP::ValueArg<size_t> block_size_arg("", "block-size", "replay/bench: allocation granularity in bytes", false, 1, "bytes", cmd);
+
+        std::vector<std::string> policy_names = {"next-fit", "min-fragments", "tlsf", "segment-tree"};
+        TCLAP::ValuesConstraint<std::string> policy_constraint(policy_names);
+        TCLAP::ValueArg<std::string> policy_arg("p", "policy", "replay/bench: allocation policy to use", false,
+                                                "next-fit", &policy_constraint, cmd);
+        TCLAP::SwitchArg populate_arg("", "populate", "replay/bench: pre-fault the whole buffer before starting", cmd);
+        TCLAP::SwitchArg huge_pages_arg("", "huge-pages", "replay/bench: 2 MB align the buffer & ask for transparent huge pages", cmd);
+        TCLAP::ValueArg<int> sample_arg("", "sample-every", "replay: sample fragmentation every N events (0 = only at the end)",
+                                        false, 0, "int", cmd);
+
+        TCLAP::ValueArg<int> threads_arg("j", "threads", "bench: number of threads sharing the buffer", false, 1, "int", cmd);
+        std::vector<std::string> scheme_names = {"mutex", "regions", "async"};
+        TCLAP::ValuesConstraint<std::string> scheme_constraint(scheme_names);
+        TCLAP::ValueArg<std::string> scheme_arg("", "scheme", "bench: how threads share the buffer", false, "mutex",
+                                                &scheme_constraint, cmd);
+        std::vector<std::string> distribution_names = {"uniform", "zipf", "bimodal"};
+        TCLAP::ValuesConstraint<std::string> distribution_constraint(distribution_names);
+        TCLAP::ValueArg<std::string> distribution_arg("d", "distribution", "bench: request size distribution", false,
+                                                      "uniform", &distribution_constraint, cmd);
+        TCLAP::ValueArg<size_t> min_arg("", "min-size", "bench: smallest request in bytes", false, workload.min_size, "bytes", cmd);
+        TCLAP::ValueArg<size_t> max_arg("", "max-size", "bench: largest request in bytes", false, workload.max_size, "bytes", cmd);
+        TCLAP::ValueArg<double> skew_arg("", "zipf-skew", "bench: zipf exponent, bigger means more small requests", false,
+                                         workload.zipf_skew, "float", cmd);
+        TCLAP::ValueArg<int> small_arg("", "small-percent", "bench: percent of bimodal requests from the small mode", false,
+                                       workload.bimodal_small_percent, "int", cmd);
+        std::vector<std::string> lifetime_names = {"fixed", "exponential", "bimodal"};
+        TCLAP::ValuesConstraint<std::string> lifetime_constraint(lifetime_names);
+        TCLAP::ValueArg<std::string> lifetime_arg("l", "lifetime", "bench: allocation lifetime profile", false, "exponential",
+                                                  &lifetime_constraint, cmd);
+        TCLAP::ValueArg<int> mean_lifetime_arg("", "mean-lifetime", "bench: average number of later allocations an allocation "
+                                               "lives through, which sets the live set size", false, workload.mean_lifetime, "int", cmd);
+        TCLAP::ValueArg<int> churn_arg("", "churn", "bench: percent of steps that free a random live allocation early", false,
+                                       workload.churn_percent, "int", cmd);
+        TCLAP::ValueArg<int> ops_arg("n", "ops", "bench: allocations per thread", false, workload.ops, "int", cmd);
+        TCLAP::ValueArg<unsigned int> seed_arg("", "seed", "bench: random seed", false, workload.seed, "int", cmd);
+
+        cmd.parse(argc, argv);
+
+        command = command_arg.getValue();
+        record_path = record_arg.getValue();
+        trace_path = trace_arg.getValue();
+        buffer_bytes = buffer_arg.getValue();
+        block_size = block_size_arg.getValue();
+        policy = policy_arg.getValue();
+        sample_every = sample_arg.getValue();
+        populate = populate_arg.getValue();
+        huge_pages = huge_pages_arg.getValue();
+        scheme = scheme_arg.getValue();
+        threads = threads_arg.getValue();
+
+        ParseSizeDistribution(distribution_arg.getValue(), workload.distribution);
+        ParseLifetimeProfile(lifetime_arg.getValue(), workload.lifetime);
+        workload.min_size = min_arg.getValue();
+        workload.max_size = max_arg.getValue();
+        workload.zipf_skew = skew_arg.getValue();
+        workload.bimodal_small_percent = small_arg.getValue();
+        workload.mean_lifetime = mean_lifetime_arg.getValue();
+        workload.churn_percent = churn_arg.getValue();
+        workload.ops = ops_arg.getValue();
+        workload.seed = seed_arg.getValue();
+    } catch (TCLAP::ArgException& e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        return 1;
+    }
+
+    if (command == "replay") {
+        if (trace_path.empty()) {
+            std::cerr << "error: replay needs --trace" << std::endl;
+            return 1;
+        }
+        if (block_size == 0) {
+            std::cerr << "error: block size needs to be at least 1" << std::endl;
+            return 1;
+        }
+        return runReplay(trace_path, buffer_bytes, block_size, policy, sample_every, populate, huge_pages);
+    }
+
+    if (command == "bench") {
+        if (buffer_bytes == 0) {
+            buffer_bytes = 64 << 20;
+        }
+        if (threads < 1 || block_size == 0 || workload.min_size == 0 || workload.max_size < workload.min_size || workload.ops < 0) {
+            std::cerr << "error: bench needs at least 1 thread, a block size of at least 1, and 1 <= min-size <= max-size" << std::endl;
+            return 1;
+        }
+        return runBench(buffer_bytes, block_size, policy, scheme, threads, workload, populate, huge_pages);
+    }
+
+    return runDemo(record_path);
+}
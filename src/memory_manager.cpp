@@ -1,96 +1,720 @@
 #include "memory_manager.h"
 
+#include "allocation_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <numeric>
 #include <string>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// Block b lives at base + b * block_size. Finds the first block whose address is a multiple of alignment (a power
+// of two), along with the stride between such blocks. Returns false when no block ever lands on the boundary.
+bool findAlignedBlocks(uintptr_t base, size_t block_size, size_t alignment, size_t& first_aligned, size_t& stride) {
+    size_t gcd = std::gcd(block_size, alignment);
+    stride = alignment / gcd;
+
+    // we need block_size * b == missing (mod alignment), which only has solutions if gcd divides missing
+    size_t missing = (alignment - (base & (alignment - 1))) & (alignment - 1);
+    if (missing % gcd != 0) {
+        return false;
+    }
+
+    // Dividing everything by gcd leaves odd * b == missing / gcd (mod stride), and stride is a power of two. An odd
+    // number is its own inverse mod 8, and every Newton step x *= 2 - odd * x doubles the number of correct bits,
+    // so 5 steps get us an inverse good mod 2^64 (and hence mod stride).
+    size_t odd = block_size / gcd;
+    size_t inverse = odd;
+    for (int ii = 0; ii < 5; ++ii) {
+        inverse *= 2 - odd * inverse;
+    }
+    first_aligned = ((missing / gcd) * inverse) & (stride - 1);
+    return true;
+}
+
+// Runs fn(0) to fn(count - 1) on up to num_threads threads, the calling one included, and returns once they're all done
+template <typename Fn>
+void parallelFor(size_t count, size_t num_threads, const Fn& fn) {
+    std::atomic<size_t> next_index(0);
+    auto worker = [&]() {
+        for (size_t ii = next_index++; ii < count; ii = next_index++) {
+            fn(ii);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t tt = 1; tt < std::min(num_threads, count); ++tt) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+}  // namespace
 
-MemoryManager::MemoryManager(char* buffer, int num_bytes)
+MemoryManager::MemoryManager(char* buffer, size_t num_bytes, size_t block_size)
 : _buffer(buffer)
-, _num_bytes(num_bytes)
-, _available_bytes(num_bytes)
-, _next_byte_location(0) {
-    int num_chars = (_num_bytes / 8) + 1;
-    _availability_bitset = std::vector<unsigned char>(num_chars, 0);
+, _num_bytes(buffer ? num_bytes : 0)
+, _block_size(block_size < 1 ? 1 : block_size)
+, _num_blocks(_num_bytes / _block_size)
+, _available_blocks(_num_blocks)
+, _next_block_location(0)
+, _availability_bitset((_num_blocks >> 3) + 1)
+, _trace_recorder(nullptr)
+, _scan_threads(0)
+, _parallel_min_blocks(0)
+, _release_policy{ReleaseMode::NONE, 0, false}
+, _released_pages_count(0)
+, _track_allocations(false)
+, _allocations()
+, _alloc_policy(AllocPolicy::NEXT_FIT)
+, _free_by_start()
+, _free_by_length()
+, _tlsf()
+, _segment_tree() {}
+
+MemoryManager::MemoryManager(BackingStore&& backing, size_t block_size)
+: MemoryManager(backing.data(), backing.size(), block_size) {
+    _backing = std::move(backing);
+
+    // all zero flags, which is exactly what a fresh mapping is: zeros everywhere & nothing released
+    size_t num_pages = (_num_bytes + BackingStore::getPageSize() - 1) / BackingStore::getPageSize();
+    _page_flags = ZeroedBytes(num_pages);
+}
+
+std::unique_ptr<MemoryManager> MemoryManager::CreateMapped(size_t num_bytes, size_t block_size, bool populate, bool huge_pages) {
+    BackingStore backing(num_bytes, populate, huge_pages);
+    if (!backing.isMapped()) {
+        return nullptr;
+    }
+    return std::make_unique<MemoryManager>(std::move(backing), block_size);
+}
+
+std::unique_ptr<MemoryManager> MemoryManager::CreateReserved(size_t num_bytes, size_t block_size, bool huge_pages) {
+    BackingStore backing = BackingStore::Reserve(num_bytes, huge_pages);
+    if (!backing.isMapped()) {
+        return nullptr;
+    }
+    return std::make_unique<MemoryManager>(std::move(backing), block_size);
+}
+
+MemoryBlocks MemoryManager::Alloc(size_t size) {
+    MemoryBlocks result = allocBlocks(blocksFor(size));
+    finishAlloc(result, false);
+    trackAllocation(result);
+    if (_trace_recorder) {
+        _trace_recorder->recordAlloc(size, result, _buffer);
+    }
+    return result;
+}
+
+MemoryBlocks MemoryManager::Alloc(size_t size, size_t alignment, bool contiguous) {
+    MemoryBlocks result;
+    size_t first_aligned = 0;
+    size_t stride = 1;
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 ||
+        !findAlignedBlocks(reinterpret_cast<uintptr_t>(_buffer), _block_size, alignment, first_aligned, stride)) {
+        result = MemoryBlocks(MemoryStatus::INVALID_ALIGNMENT);
+    } else if (stride == 1 && !contiguous) {
+        // every block is aligned already, so this is a plain Alloc()
+        result = allocBlocks(blocksFor(size));
+    } else {
+        result = allocAligned(blocksFor(size), first_aligned, stride, contiguous);
+    }
+    finishAlloc(result, false);
+    trackAllocation(result);
+
+    if (_trace_recorder) {
+        _trace_recorder->recordAlloc(size, result, _buffer);
+    }
+    return result;
+}
+
+MemoryBlocks MemoryManager::allocBlocks(size_t num_blocks) {
+    switch (_alloc_policy) {
+        case AllocPolicy::MIN_FRAGMENTS:
+            return allocMinFragments(num_blocks);
+        case AllocPolicy::TLSF:
+            return allocTlsf(num_blocks);
+        case AllocPolicy::SEGMENT_TREE:
+            return allocSegmentTree(num_blocks);
+        case AllocPolicy::NEXT_FIT:
+        default:
+            return allocNextFit(num_blocks);
+    }
 }
 
-MemoryBlocks MemoryManager::Alloc(int size) {
-    if (_available_bytes == 0) {
+MemoryBlocks MemoryManager::allocTlsf(size_t num_blocks) {
+    if (_available_blocks == 0) {
         return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
     }
 
-    if (size > _available_bytes) {
+    if (num_blocks > _available_blocks) {
         return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
     }
 
-    std::vector<std::pair<char*, int>> allocations;
-    int count = 0;
+    if (num_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::SUCCESS);
+    }
 
-    int ii = _next_byte_location;
+    // the O(1) path: one free extent that fits, from the front of which the request gets carved
+    std::vector<std::pair<size_t, size_t>> runs;
+    size_t start = _tlsf->findFit(num_blocks);
+    if (start != TlsfIndex::kNone) {
+        runs.push_back(std::pair(start, num_blocks));
+        return commitRuns(runs);
+    }
 
-    while (count < size) {
-        // move until you find something available
-        while (!isAvailable(ii)) {
-            ++ii;
-            if (ii == _num_bytes) {
-                ii = 0;
+    // No single extent is big enough, so it's fragments after all: whole extents from the highest class down, until
+    // the rest fits in the next one. The bitmaps skip the empty lists, so every list visited hands out at least one
+    // fragment & this is O(fragments returned). Never a bitset scan, but that's O(free extents) when the request
+    // needs nearly all the free space, not O(1).
+    size_t remaining = num_blocks;
+    uint64_t fl_left = _tlsf->fl_bitmap;
+    while (fl_left != 0 && remaining > 0) {
+        size_t fl = static_cast<size_t>(63 - __builtin_clzll(fl_left));
+        fl_left &= ~(uint64_t(1) << fl);
+        uint32_t sl_left = _tlsf->sl_bitmaps[fl];
+        while (sl_left != 0 && remaining > 0) {
+            size_t sl = static_cast<size_t>(31 - __builtin_clz(sl_left));
+            sl_left &= ~(uint32_t(1) << sl);
+            for (size_t node = _tlsf->heads[fl][sl]; node != TlsfIndex::kNone && remaining > 0; node = _tlsf->nodes.at(node).next) {
+                size_t take = std::min(_tlsf->nodes.at(node).length, remaining);
+                runs.push_back(std::pair(node, take));
+                remaining -= take;
             }
         }
+    }
+    std::sort(runs.begin(), runs.end());
+    return commitRuns(runs);
+}
 
-        // iterate until you either hit the end of the buffer, hit something unavailable, or met the size allocation requirement in the request
-        int jj = ii;
-        int current_count = 0;
-        while (jj < _num_bytes && isAvailable(jj) && count < size) {
-            ++jj;
-            ++current_count;
-            ++count;
+MemoryBlocks MemoryManager::allocSegmentTree(size_t num_blocks) {
+    if (_available_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+    }
+
+    if (num_blocks > _available_blocks) {
+        return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+
+    if (num_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::SUCCESS);
+    }
+
+    // the lowest run that holds all of it, one walk down the tree
+    size_t start = segmentTreeFirstFit(num_blocks);
+    if (start != _num_blocks) {
+        std::vector<std::pair<size_t, size_t>> runs = { std::pair(start, num_blocks) };
+        return commitRuns(runs);
+    }
+
+    // no run is long enough, so it's next-fit fragments, with findNextAvailable() jumping used leaves through the tree
+    return allocNextFit(num_blocks);
+}
+
+MemoryBlocks MemoryManager::allocMinFragments(size_t num_blocks) {
+    if (_available_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+    }
+
+    if (num_blocks > _available_blocks) {
+        return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+
+    if (num_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::SUCCESS);
+    }
+
+    // Whole extents from the largest down, until what's left fits in one of the extents not taken yet, which then
+    // gets the best fit (smallest one that's big enough). Taking the largest first is what keeps the count minimal,
+    // and the best fit at the end leaves the big extents alone when a small one does the job. The extents taken so
+    // far are always the top of _free_by_length, so the ones still up for grabs are [begin, untaken_end).
+    std::vector<std::pair<size_t, size_t>> runs;
+    size_t remaining = num_blocks;
+    auto untaken_end = _free_by_length.end();
+    while (remaining > 0) {
+        auto fit = _free_by_length.lower_bound(std::pair(remaining, size_t(0)));
+        bool fit_untaken = (untaken_end == _free_by_length.end()) ? (fit != untaken_end) : (fit != _free_by_length.end() && *fit < *untaken_end);
+        if (fit_untaken) {
+            runs.push_back(std::pair(fit->second, remaining));
+            break;
         }
+        // _available_blocks says there's enough, so this never runs off the front
+        --untaken_end;
+        runs.push_back(std::pair(untaken_end->second, untaken_end->first));
+        remaining -= untaken_end->first;
+    }
+
+    std::sort(runs.begin(), runs.end());
+    return commitRuns(runs);
+}
+
+MemoryBlocks MemoryManager::allocNextFit(size_t num_blocks) {
+    if (_available_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+    }
+
+    if (num_blocks > _available_blocks) {
+        return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+
+    if (_scan_threads > 1 && num_blocks >= _parallel_min_blocks && _alloc_policy == AllocPolicy::NEXT_FIT) {
+        return allocNextFitParallel(num_blocks);
+    }
+
+    std::vector<std::pair<char*, size_t>> allocations;
+    size_t count = 0;
+
+    size_t ii = _next_block_location;
+
+    while (count < num_blocks) {
+        // move until you find something available. We know there is something, so wrapping around at most once is safe
+        ii = findNextAvailable(ii);
+        if (ii == _num_blocks) {
+            ii = findNextAvailable(0);
+        }
+
+        // iterate until you either hit the end of the buffer, hit something unavailable, or met the size allocation requirement in the request
+        size_t current_count = availableRunLength(ii, num_blocks - count);
+        size_t jj = ii + current_count;
+        count += current_count;
         if (current_count > 0) {
-            markAllOccupied(ii, current_count); // NOTE: This invocation updates _available_bytes and _availability_bitset
-            allocations.push_back(std::pair(_buffer + ii, current_count));
+            markAllOccupied(ii, current_count); // NOTE: This invocation updates _available_blocks and _availability_bitset
+            allocations.push_back(std::pair(_buffer + ii * _block_size, current_count * _block_size));
         }
 
         ii = jj;
         // if we end up on the right-end, jump back to left-end. Quicker to do if-check than modulus
-        if (ii == _num_bytes) {
+        if (ii == _num_blocks) {
             ii = 0;
         }
     }
 
-    if (_available_bytes > 0) {
+    if (_available_blocks > 0) {
         // move until you find something available
-        while (!isAvailable(ii)) {
-            ++ii;
-            if (ii == _num_bytes) {
-                ii = 0;
+        ii = findNextAvailable(ii);
+        if (ii == _num_blocks) {
+            ii = findNextAvailable(0);
+        }
+        _next_block_location = ii;
+    }
+
+    return MemoryBlocks(MemoryStatus::SUCCESS, allocations);
+}
+
+MemoryBlocks MemoryManager::allocNextFitParallel(size_t num_blocks) {
+    // Chunks in next-fit order, [next, end) and then [0, next), cut on multiples of chunk_blocks (itself a multiple
+    // of 64) so that two chunks never share a char of the bitset. Except for the very last one, which can end in the
+    // middle of the char where the first one starts.
+    size_t next = _next_block_location;
+    size_t chunk_blocks = ((_num_blocks + _scan_threads - 1) / _scan_threads + 63) & ~size_t(63);
+    std::vector<std::pair<size_t, size_t>> chunks;
+    auto addChunks = [&](size_t lo, size_t hi) {
+        while (lo < hi) {
+            size_t cut = std::min(hi, (lo / chunk_blocks + 1) * chunk_blocks);
+            chunks.push_back(std::pair(lo, cut));
+            lo = cut;
+        }
+    };
+    addChunks(next, _num_blocks);
+    addChunks(0, next);
+
+    // 1. how many free blocks each chunk has, all read only
+    std::vector<size_t> counts(chunks.size());
+    parallelFor(chunks.size(), _scan_threads, [&](size_t cc) {
+        counts[cc] = countAvailable(chunks[cc].first, chunks[cc].second);
+    });
+
+    // which chunk the request runs out in, and how much of it is needed there
+    size_t last = 0;
+    size_t before = 0;
+    while (before + counts[last] < num_blocks) {
+        before += counts[last];
+        ++last;
+    }
+
+    // 2. every chunk up to that one collects its runs & marks them. The bits get set directly, and _available_blocks
+    // updated once at the end, since every one of these blocks was free.
+    std::vector<std::vector<std::pair<size_t, size_t>>> runs(last + 1);
+    auto take = [&](size_t cc) {
+        size_t hi = chunks[cc].second;
+        size_t limit = (cc == last) ? num_blocks - before : counts[cc];
+        size_t taken = 0;
+        size_t ii = scanNextAvailable(chunks[cc].first, hi);
+        while (taken < limit) {
+            size_t run = availableRunLength(ii, std::min(limit - taken, hi - ii));
+            runs[cc].push_back(std::pair(ii, run));
+            taken += run;
+            ii = scanNextAvailable(ii + run, hi);
+        }
+        for (const auto& run : runs[cc]) {
+            size_t jj = run.first;
+            size_t end = run.first + run.second;
+            for (; jj < end && (jj & 7) != 0; ++jj) {
+                _availability_bitset[jj >> 3] |= static_cast<unsigned char>(1 << (jj & 7));
+            }
+            if (end - jj >= 8) {
+                std::memset(&_availability_bitset[jj >> 3], 0xFF, (end - jj) >> 3);
+                jj += (end - jj) & ~size_t(7);
+            }
+            for (; jj < end; ++jj) {
+                _availability_bitset[jj >> 3] |= static_cast<unsigned char>(1 << (jj & 7));
+            }
+        }
+    };
+    bool shares_char = (next & 63) != 0 && last == chunks.size() - 1;
+    parallelFor(shares_char ? last : last + 1, _scan_threads, take);
+    if (shares_char) {
+        take(last);
+    }
+    _available_blocks -= num_blocks;
+
+    // runs that continue across a chunk boundary are one extent, same as the single threaded walk makes them
+    std::vector<std::pair<char*, size_t>> allocations;
+    size_t end = 0;
+    for (const auto& chunk_runs : runs) {
+        for (const auto& run : chunk_runs) {
+            if (!allocations.empty() && run.first == end) {
+                allocations.back().second += run.second * _block_size;
+            } else {
+                allocations.push_back(std::pair(_buffer + run.first * _block_size, run.second * _block_size));
+            }
+            end = run.first + run.second;
+        }
+    }
+
+    if (_available_blocks > 0) {
+        size_t ii = findNextAvailable(end);
+        _next_block_location = (ii == _num_blocks) ? findNextAvailable(0) : ii;
+    }
+    return MemoryBlocks(MemoryStatus::SUCCESS, allocations);
+}
+
+void MemoryManager::setParallelScan(size_t num_threads, size_t min_bytes) {
+    _scan_threads = num_threads;
+    _parallel_min_blocks = std::max<size_t>(blocksFor(min_bytes), 1);
+}
+
+MemoryBlocks MemoryManager::AllocZeroed(size_t size) {
+    MemoryBlocks result = allocBlocks(blocksFor(size));
+    finishAlloc(result, true);
+    trackAllocation(result);
+    if (_trace_recorder) {
+        _trace_recorder->recordAlloc(size, result, _buffer);
+    }
+    return result;
+}
+
+MemoryBlocks MemoryManager::allocAligned(size_t num_blocks, size_t first_aligned, size_t stride, bool contiguous) {
+    if (_available_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+    }
+
+    if (num_blocks > _available_blocks) {
+        return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+
+    if (num_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::SUCCESS);
+    }
+
+    // Unlike allocNextFit() we can come up short (free blocks sitting before an aligned one don't count), so nothing
+    // gets marked until we know we have enough. That means the wraparound has to be done by hand: one lap over
+    // [cursor, end), then one over [0, cursor).
+    std::vector<std::pair<size_t, size_t>> runs;
+    size_t count = 0;
+    size_t cursor = _next_block_location;
+    const size_t lap_starts[2] = { cursor, 0 };
+    const size_t lap_ends[2] = { _num_blocks, cursor };
+
+    for (int lap = 0; lap < 2 && count < num_blocks; ++lap) {
+        size_t ii = findNextAlignedAvailable(lap_starts[lap], first_aligned, stride);
+        while (ii < lap_ends[lap] && count < num_blocks) {
+            if (contiguous) {
+                // candidates past the cursor were all tried in the first lap, but a run is free to cross it
+                size_t run = availableRunLength(ii, num_blocks);
+                if (run == num_blocks) {
+                    runs.push_back(std::pair(ii, run));
+                    count = run;
+                    break;
+                }
+                // block ii + run is the one that got in the way, no point trying anything before it
+                ii = findNextAlignedAvailable(ii + run + 1, first_aligned, stride);
+            } else {
+                // in the second lap, stop at the cursor so we don't hand out blocks the first lap already took
+                size_t run = availableRunLength(ii, std::min(num_blocks - count, lap_ends[lap] - ii));
+                runs.push_back(std::pair(ii, run));
+                count += run;
+                ii = findNextAlignedAvailable(ii + run, first_aligned, stride);
+            }
+        }
+    }
+
+    if (count < num_blocks) {
+        return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+
+    MemoryBlocks result = commitRuns(runs);
+
+    if (_available_blocks > 0 && !runs.empty()) {
+        size_t ii = findNextAvailable(runs.back().first + runs.back().second);
+        if (ii == _num_blocks) {
+            ii = findNextAvailable(0);
+        }
+        _next_block_location = ii;
+    }
+
+    return result;
+}
+
+MemoryBlocks MemoryManager::AllocNear(size_t size, const char* hint) {
+    std::ptrdiff_t offset = hint - _buffer;
+    if (hint == nullptr || offset < 0 || static_cast<size_t>(offset) >= getUsableBytes()) {
+        return Alloc(size);
+    }
+
+    size_t hint_block = static_cast<size_t>(offset) / _block_size;
+    size_t num_blocks = blocksFor(size);
+    MemoryBlocks result;
+    if (_alloc_policy == AllocPolicy::NEXT_FIT) {
+        // the walk skips over the used run hint is in, which puts the free blocks right after it first. The cursor
+        // goes back to where it was after, so hinted allocs don't drag everybody else's next-fit location along.
+        size_t cursor = _next_block_location;
+        _next_block_location = hint_block;
+        result = allocNextFit(num_blocks);
+        _next_block_location = cursor;
+    } else {
+        // the other policies hand out whole runs where they can, so it's the first whole run after hint, found through
+        // the policy's own index, and the policy's pick when there's no such run
+        size_t start = (num_blocks == 0 || num_blocks > _available_blocks) ? _num_blocks : firstFitFrom(hint_block, num_blocks);
+        if (start != _num_blocks) {
+            result = commitRuns({ std::pair(start, num_blocks) });
+        } else {
+            result = allocBlocks(num_blocks);
+        }
+    }
+
+    finishAlloc(result, false);
+    trackAllocation(result);
+    if (_trace_recorder) {
+        _trace_recorder->recordAlloc(size, result, _buffer);
+    }
+    return result;
+}
+
+size_t MemoryManager::firstFitFrom(size_t ii, size_t num_blocks) const {
+    if (_segment_tree) {
+        return segmentTreeFirstFitFrom(ii, num_blocks);
+    }
+
+    if (_alloc_policy == AllocPolicy::MIN_FRAGMENTS) {
+        // the free extent ii is in (if it is in one) counts from ii on, and after that the index is in address order
+        auto it = _free_by_start.upper_bound(ii);
+        if (it != _free_by_start.begin()) {
+            auto before = std::prev(it);
+            size_t end = before->first + before->second;
+            if (end > ii && end - ii >= num_blocks) {
+                return ii;
+            }
+        }
+        for (; it != _free_by_start.end(); ++it) {
+            if (it->second >= num_blocks) {
+                return it->first;
+            }
+        }
+        return _num_blocks;
+    }
+
+    // TLSF's lists aren't in address order, so this is a walk over the bitset
+    size_t jj = findNextAvailable(ii);
+    while (jj < _num_blocks) {
+        size_t run = availableRunLength(jj, num_blocks);
+        if (run == num_blocks) {
+            return jj;
+        }
+        jj = findNextAvailable(jj + run);
+    }
+    return _num_blocks;
+}
+
+MemoryBlocks MemoryManager::AllocBounded(size_t size, size_t max_fragments) {
+    MemoryBlocks result = allocBounded(blocksFor(size), max_fragments);
+    finishAlloc(result, false);
+    trackAllocation(result);
+    if (_trace_recorder) {
+        _trace_recorder->recordAlloc(size, result, _buffer);
+    }
+    return result;
+}
+
+MemoryBlocks MemoryManager::allocBounded(size_t num_blocks, size_t max_fragments) {
+    if (_available_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+    }
+
+    if (num_blocks > _available_blocks) {
+        return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+
+    if (num_blocks == 0) {
+        return MemoryBlocks(MemoryStatus::SUCCESS);
+    }
+
+    if (max_fragments == 0) {
+        return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+
+    // 1. the same next-fit walk as Alloc(), stopping after max_fragments runs. Nothing is marked until we know it
+    // fits, so the wraparound is done by hand like in allocAligned().
+    std::vector<std::pair<size_t, size_t>> runs;
+    size_t count = 0;
+    size_t cursor = _next_block_location;
+    const size_t lap_starts[2] = { cursor, 0 };
+    const size_t lap_ends[2] = { _num_blocks, cursor };
+    for (int lap = 0; lap < 2 && count < num_blocks && runs.size() < max_fragments; ++lap) {
+        size_t ii = findNextAvailable(lap_starts[lap]);
+        while (ii < lap_ends[lap] && count < num_blocks && runs.size() < max_fragments) {
+            size_t run = availableRunLength(ii, std::min(num_blocks - count, lap_ends[lap] - ii));
+            runs.push_back(std::pair(ii, run));
+            count += run;
+            ii = findNextAvailable(ii + run);
+        }
+    }
+
+    // 2. too fragmented around the cursor, so find the max_fragments largest free runs in the whole buffer (a min-heap
+    // of that size, so this needs O(max_fragments) memory no matter how many runs there are) & take them biggest first
+    if (count < num_blocks) {
+        auto longer = [](const std::pair<size_t, size_t>& aa, const std::pair<size_t, size_t>& bb) { return aa.second > bb.second; };
+        std::vector<std::pair<size_t, size_t>> largest;
+        size_t ii = findNextAvailable(0);
+        while (ii < _num_blocks) {
+            size_t run = availableRunLength(ii, _num_blocks - ii);
+            if (largest.size() < max_fragments) {
+                largest.push_back(std::pair(ii, run));
+                std::push_heap(largest.begin(), largest.end(), longer);
+            } else if (run > largest.front().second) {
+                std::pop_heap(largest.begin(), largest.end(), longer);
+                largest.back() = std::pair(ii, run);
+                std::push_heap(largest.begin(), largest.end(), longer);
             }
+            ii = findNextAvailable(ii + run);
+        }
+
+        std::sort(largest.begin(), largest.end(), longer);
+        runs.clear();
+        count = 0;
+        for (const auto& run : largest) {
+            if (count == num_blocks) {
+                break;
+            }
+            size_t take = std::min(run.second, num_blocks - count);
+            runs.push_back(std::pair(run.first, take));
+            count += take;
+        }
+        if (count < num_blocks) {
+            return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
         }
-        _next_byte_location = ii;
+        std::sort(runs.begin(), runs.end());
     }
 
+    MemoryBlocks result = commitRuns(runs);
+
+    if (_available_blocks > 0) {
+        size_t ii = findNextAvailable(runs.back().first + runs.back().second);
+        if (ii == _num_blocks) {
+            ii = findNextAvailable(0);
+        }
+        _next_block_location = ii;
+    }
+
+    return result;
+}
+
+size_t MemoryManager::findNextAlignedAvailable(size_t ii, size_t first_aligned, size_t stride) const {
+    while (true) {
+        ii = findNextAvailable(ii);
+        if (ii >= _num_blocks) {
+            return _num_blocks;
+        }
+        // round up to the next aligned block, and take it if it's free too
+        if (ii < first_aligned) {
+            ii = first_aligned;
+        } else {
+            ii = first_aligned + ((ii - first_aligned + stride - 1) / stride) * stride;
+        }
+        if (ii >= _num_blocks) {
+            return _num_blocks;
+        }
+        if (isAvailable(ii)) {
+            return ii;
+        }
+        ++ii;
+    }
+}
+
+MemoryBlocks MemoryManager::commitRuns(const std::vector<std::pair<size_t, size_t>>& runs) {
+    std::vector<std::pair<char*, size_t>> allocations;
+    allocations.reserve(runs.size());
+    for (const auto& run : runs) {
+        markAllOccupied(run.first, run.second); // NOTE: This invocation updates _available_blocks and _availability_bitset
+        allocations.push_back(std::pair(_buffer + run.first * _block_size, run.second * _block_size));
+    }
     return MemoryBlocks(MemoryStatus::SUCCESS, allocations);
 }
 
 MemoryStatus MemoryManager::Free(const MemoryBlocks& blocks) {
-    bool out_of_memory = (_available_bytes == 0);
+    // with tracking on only whole allocations, so the map never holds on to memory that's been handed back
+    if (_track_allocations && !blocks.allocations.empty() && !untrackAllocation(blocks)) {
+        return MemoryStatus::INVALID_MEMORY_LOCATIONS;
+    }
+    return freeBlocks(blocks);
+}
+
+MemoryStatus MemoryManager::freeBlocks(const MemoryBlocks& blocks) {
+    if (_trace_recorder) {
+        _trace_recorder->recordFree(blocks, _buffer);
+    }
+
+    bool out_of_memory = (_available_blocks == 0);
     bool found_bad_locations = false;
+    size_t usable_bytes = getUsableBytes();
     for (const auto& tuple : blocks.allocations) {
-        int ll = static_cast<int>(tuple.first - _buffer);
-        int rr = ll + tuple.second;
-        if (ll < 0 || ll >= _num_bytes) {
+        std::ptrdiff_t offset = tuple.first - _buffer;
+        if (offset < 0 || static_cast<size_t>(offset) >= usable_bytes) {
             found_bad_locations = true;
             continue;
         }
-        if (rr < 0 || rr > _num_bytes) {
+        size_t ll = static_cast<size_t>(offset);
+        // compare against what's left rather than computing ll + length, which could wrap around for huge lengths
+        if ((ll % _block_size) != 0 || tuple.second > usable_bytes - ll) {
             found_bad_locations = true;
             continue;
         }
+        size_t rr = ll + tuple.second;
 
-        markAllUnoccupied(ll, tuple.second);  // NOTE: This invocation updates _available_bytes and _availability_bitset
+        // rr can sit in the middle of a block (the caller passed the size they asked for), in which case we round up
+        size_t start = ll / _block_size;
+        size_t end = (rr / _block_size) + ((rr % _block_size) != 0);
+        markAllUnoccupied(start, end - start);  // NOTE: This invocation updates _available_blocks and _availability_bitset
+        if (_release_policy.mode != ReleaseMode::NONE && !_release_policy.batched) {
+            releaseAround(start, end);
+        }
     }
 
-    // If we transition from being out of memory to having some, then point _next_byte_location to something valid for the next Alloc() call
-    if (out_of_memory && _available_bytes > 0 && !found_bad_locations && !blocks.allocations.empty()) {
-        int ll = static_cast<int>(blocks.allocations.front().first - _buffer);
-        _next_byte_location = ll;
+    // If we transition from being out of memory to having some, then point _next_block_location to something valid for the next Alloc() call
+    if (out_of_memory && _available_blocks > 0 && !found_bad_locations && !blocks.allocations.empty()) {
+        size_t ll = static_cast<size_t>(blocks.allocations.front().first - _buffer);
+        _next_block_location = ll / _block_size;
     }
 
     if (found_bad_locations) {
@@ -100,9 +724,290 @@ MemoryStatus MemoryManager::Free(const MemoryBlocks& blocks) {
     return MemoryStatus::SUCCESS;
 }
 
-bool MemoryManager::isAvailable(int ii) const {
-    int index = ii / 8;
-    int offset = ii % 8;
+MemoryStatus MemoryManager::Free(const CompactBlocks& blocks) {
+    MemoryBlocks expanded = FromCompact(blocks);
+    if (expanded.allocations.size() != blocks.size()) {
+        return MemoryStatus::INVALID_MEMORY_LOCATIONS;
+    }
+    return Free(expanded);
+}
+
+CompactBlocks MemoryManager::ToCompact(const MemoryBlocks& blocks) const {
+    CompactBlocks result(blocks.status);
+    result.offsets.reserve(blocks.allocations.size());
+    result.lengths.reserve(blocks.allocations.size());
+    size_t usable_bytes = getUsableBytes();
+    for (const auto& tuple : blocks.allocations) {
+        std::ptrdiff_t offset = tuple.first - _buffer;
+        if (offset < 0 || static_cast<size_t>(offset) >= usable_bytes || (static_cast<size_t>(offset) % _block_size) != 0 ||
+            tuple.second > usable_bytes - static_cast<size_t>(offset)) {
+            return CompactBlocks(MemoryStatus::INVALID_MEMORY_LOCATIONS);
+        }
+        size_t start = static_cast<size_t>(offset) / _block_size;
+        size_t count = blocksFor(tuple.second);
+        if (start > UINT32_MAX || count > UINT32_MAX) {
+            return CompactBlocks(MemoryStatus::INVALID_MEMORY_LOCATIONS);
+        }
+        result.offsets.push_back(static_cast<uint32_t>(start));
+        result.lengths.push_back(static_cast<uint32_t>(count));
+    }
+    return result;
+}
+
+MemoryBlocks MemoryManager::FromCompact(const CompactBlocks& blocks) const {
+    if (blocks.offsets.size() != blocks.lengths.size()) {
+        return MemoryBlocks(MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    }
+    MemoryBlocks result(blocks.status);
+    result.allocations.reserve(blocks.size());
+    for (size_t ii = 0; ii < blocks.size(); ++ii) {
+        // compare against what's left rather than adding, same as Free()
+        if (blocks.offsets[ii] >= _num_blocks || blocks.lengths[ii] > _num_blocks - blocks.offsets[ii]) {
+            return MemoryBlocks(MemoryStatus::INVALID_MEMORY_LOCATIONS);
+        }
+        result.allocations.push_back(std::pair(_buffer + size_t(blocks.offsets[ii]) * _block_size, size_t(blocks.lengths[ii]) * _block_size));
+    }
+    return result;
+}
+
+MemoryStatus MemoryManager::Free(char* ptr) {
+    if (ptr == nullptr) {
+        return MemoryStatus::SUCCESS;
+    }
+    if (!_track_allocations || ptr < _buffer || ptr >= _buffer + getUsableBytes()) {
+        return MemoryStatus::INVALID_MEMORY_LOCATIONS;
+    }
+    auto it = _allocations.find(static_cast<size_t>(ptr - _buffer) / _block_size);
+    if (it == _allocations.end() || _buffer + it->first * _block_size != ptr) {
+        return MemoryStatus::INVALID_MEMORY_LOCATIONS;
+    }
+
+    MemoryBlocks blocks(MemoryStatus::SUCCESS);
+    blocks.allocations.reserve(1 + it->second.more_extents.size());
+    blocks.allocations.push_back(std::pair(ptr, it->second.first_bytes));
+    blocks.allocations.insert(blocks.allocations.end(), it->second.more_extents.begin(), it->second.more_extents.end());
+    // Free() drops the map entry too
+    return Free(blocks);
+}
+
+bool MemoryManager::setAllocationTracking(bool enabled) {
+    if (enabled && !_track_allocations && _available_blocks != _num_blocks) {
+        return false;
+    }
+    _track_allocations = enabled;
+    if (!enabled) {
+        _allocations.clear();
+    }
+    return true;
+}
+
+bool MemoryManager::Owns(const char* ptr) const {
+    if (ptr < _buffer || ptr >= _buffer + getUsableBytes()) {
+        return false;
+    }
+    return !isAvailable(static_cast<size_t>(ptr - _buffer) / _block_size);
+}
+
+size_t MemoryManager::SizeOf(const char* ptr) const {
+    if (!_track_allocations || ptr < _buffer || ptr >= _buffer + getUsableBytes()) {
+        return 0;
+    }
+    auto it = _allocations.find(static_cast<size_t>(ptr - _buffer) / _block_size);
+    if (it == _allocations.end() || _buffer + it->first * _block_size != ptr) {
+        return 0;
+    }
+    return it->second.total_bytes;
+}
+
+void MemoryManager::trackAllocation(const MemoryBlocks& blocks) {
+    if (!_track_allocations || blocks.status != MemoryStatus::SUCCESS || blocks.allocations.empty()) {
+        return;
+    }
+    // lengths in the map are rounded up to blocks, since that's what the allocation really holds
+    AllocationEntry entry{blocksFor(blocks.allocations.front().second) * _block_size, 0, {}};
+    entry.total_bytes = entry.first_bytes;
+    for (size_t ii = 1; ii < blocks.allocations.size(); ++ii) {
+        size_t bytes = blocksFor(blocks.allocations[ii].second) * _block_size;
+        entry.more_extents.push_back(std::pair(blocks.allocations[ii].first, bytes));
+        entry.total_bytes += bytes;
+    }
+    _allocations[static_cast<size_t>(blocks.allocations.front().first - _buffer) / _block_size] = std::move(entry);
+}
+
+bool MemoryManager::untrackAllocation(const MemoryBlocks& blocks) {
+    if (!_track_allocations || blocks.allocations.empty()) {
+        return false;
+    }
+    const char* ptr = blocks.allocations.front().first;
+    if (ptr < _buffer || ptr >= _buffer + getUsableBytes() || (static_cast<size_t>(ptr - _buffer) % _block_size) != 0) {
+        return false;
+    }
+    auto it = _allocations.find(static_cast<size_t>(ptr - _buffer) / _block_size);
+    if (it == _allocations.end()) {
+        return false;
+    }
+
+    // extent for extent what the entry has, lengths compared in blocks like Free() rounds them
+    const AllocationEntry& entry = it->second;
+    if (blocks.allocations.size() != 1 + entry.more_extents.size() ||
+        blocksFor(blocks.allocations.front().second) * _block_size != entry.first_bytes) {
+        return false;
+    }
+    for (size_t ii = 1; ii < blocks.allocations.size(); ++ii) {
+        const auto& extent = entry.more_extents[ii - 1];
+        if (blocks.allocations[ii].first != extent.first || blocksFor(blocks.allocations[ii].second) * _block_size != extent.second) {
+            return false;
+        }
+    }
+    _allocations.erase(it);
+    return true;
+}
+
+MemoryStatus MemoryManager::Realloc(MemoryBlocks& blocks, size_t new_size, bool contiguous) {
+    if (!_track_allocations) {
+        return resize(blocks, new_size, contiguous);
+    }
+    // blocks might move or change shape, so out with the old entry & in with whatever blocks is afterwards (which
+    // is the old allocation again if resize() failed). Only whole allocations, same as Free().
+    bool was_tracked = untrackAllocation(blocks);
+    if (!was_tracked && !blocks.allocations.empty()) {
+        return MemoryStatus::INVALID_MEMORY_LOCATIONS;
+    }
+    MemoryStatus status = resize(blocks, new_size, contiguous);
+    if (was_tracked || status == MemoryStatus::SUCCESS) {
+        trackAllocation(blocks);
+    }
+    return status;
+}
+
+MemoryStatus MemoryManager::resize(MemoryBlocks& blocks, size_t new_size, bool contiguous) {
+    size_t usable_bytes = getUsableBytes();
+    size_t current_blocks = 0;
+    for (const auto& tuple : blocks.allocations) {
+        std::ptrdiff_t offset = tuple.first - _buffer;
+        if (offset < 0 || static_cast<size_t>(offset) >= usable_bytes || (static_cast<size_t>(offset) % _block_size) != 0 ||
+            tuple.second > usable_bytes - static_cast<size_t>(offset)) {
+            return MemoryStatus::INVALID_MEMORY_LOCATIONS;
+        }
+        current_blocks += blocksFor(tuple.second);
+    }
+
+    // several extents can't become one without moving, whatever the size
+    if (contiguous && blocks.allocations.size() > 1 && new_size > 0) {
+        return relocate(blocks, new_size);
+    }
+
+    size_t new_blocks = blocksFor(new_size);
+    if (new_blocks <= current_blocks) {
+        shrinkTo(blocks, new_blocks);
+        return MemoryStatus::SUCCESS;
+    }
+    size_t extra_blocks = new_blocks - current_blocks;
+    if (extra_blocks > _available_blocks) {
+        return (_available_blocks == 0) ? MemoryStatus::OUT_OF_MEMORY : MemoryStatus::INSUFFICIENT_MEMORY;
+    }
+
+    // 1. the blocks right after the last extent, which keeps it one extent & needs no copy
+    MemoryBlocks added(MemoryStatus::SUCCESS);
+    size_t extended = 0;
+    if (!blocks.allocations.empty() && (!contiguous || blocks.allocations.size() == 1)) {
+        const auto& last = blocks.allocations.back();
+        size_t end = static_cast<size_t>(last.first - _buffer) / _block_size + blocksFor(last.second);
+        if (end < _num_blocks) {
+            extended = availableRunLength(end, extra_blocks);
+        }
+        if (extended > 0 && (extended == extra_blocks || !contiguous)) {
+            markAllOccupied(end, extended);
+            added.allocations.push_back(std::pair(_buffer + end * _block_size, extended * _block_size));
+        } else {
+            extended = 0;
+        }
+    }
+
+    // 2. whatever is still missing as extra fragments, unless it has to stay one extent
+    if (extended < extra_blocks && !contiguous) {
+        MemoryBlocks more = allocBlocks(extra_blocks - extended);
+        if (more.status != MemoryStatus::SUCCESS) {
+            if (extended > 0) {
+                markAllUnoccupied(static_cast<size_t>(added.allocations.front().first - _buffer) / _block_size, extended);
+            }
+            return more.status;
+        }
+        added.allocations.insert(added.allocations.end(), more.allocations.begin(), more.allocations.end());
+        extended = extra_blocks;
+    }
+
+    // 3. last resort, a whole new extent & copying everything over
+    if (extended < extra_blocks) {
+        return relocate(blocks, new_size);
+    }
+
+    finishAlloc(added, false);
+    if (added.status != MemoryStatus::SUCCESS) {
+        return added.status;
+    }
+    if (_trace_recorder) {
+        _trace_recorder->recordAlloc(extra_blocks * _block_size, added, _buffer);
+    }
+
+    auto next = added.allocations.begin();
+    if (!blocks.allocations.empty() && next->first == blocks.allocations.back().first + blocksFor(blocks.allocations.back().second) * _block_size) {
+        blocks.allocations.back().second = blocksFor(blocks.allocations.back().second) * _block_size + next->second;
+        ++next;
+    }
+    blocks.allocations.insert(blocks.allocations.end(), next, added.allocations.end());
+    blocks.status = MemoryStatus::SUCCESS;
+    return MemoryStatus::SUCCESS;
+}
+
+MemoryStatus MemoryManager::relocate(MemoryBlocks& blocks, size_t new_size) {
+    MemoryBlocks moved = Alloc(new_size, 1, true);
+    if (moved.status != MemoryStatus::SUCCESS) {
+        return moved.status;
+    }
+    char* destination = moved.allocations.front().first;
+    size_t left = moved.allocations.front().second;
+    for (const auto& tuple : blocks.allocations) {
+        size_t count = std::min(tuple.second, left);
+        std::memcpy(destination, tuple.first, count);
+        destination += count;
+        left -= count;
+    }
+    if (!blocks.allocations.empty()) {
+        freeBlocks(blocks);
+    }
+    blocks = moved;
+    return MemoryStatus::SUCCESS;
+}
+
+void MemoryManager::shrinkTo(MemoryBlocks& blocks, size_t num_blocks) {
+    // everything past the first num_blocks gets freed, as one range per extent (the one the cut falls in included)
+    MemoryBlocks tail(MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> kept;
+    size_t count = 0;
+    for (const auto& tuple : blocks.allocations) {
+        size_t extent_blocks = blocksFor(tuple.second);
+        if (count >= num_blocks) {
+            tail.allocations.push_back(tuple);
+            continue;
+        }
+        size_t keep = std::min(extent_blocks, num_blocks - count);
+        kept.push_back(std::pair(tuple.first, keep * _block_size));
+        if (keep < extent_blocks) {
+            tail.allocations.push_back(std::pair(tuple.first + keep * _block_size, (extent_blocks - keep) * _block_size));
+        }
+        count += keep;
+    }
+    if (!tail.allocations.empty()) {
+        freeBlocks(tail);
+    }
+    blocks.allocations = std::move(kept);
+    blocks.status = MemoryStatus::SUCCESS;
+}
+
+bool MemoryManager::isAvailable(size_t ii) const {
+    size_t index = ii >> 3;
+    size_t offset = ii & 7;
     unsigned char mask = (1 << offset);
     if (_availability_bitset[index] & mask) {
         return false;
@@ -110,40 +1015,590 @@ bool MemoryManager::isAvailable(int ii) const {
     return true;
 }
 
-void MemoryManager::markOccupied(int ii, bool aa) {
-    int index = ii / 8;
-    int offset = ii % 8;
+void MemoryManager::markOccupied(size_t ii, bool aa) {
+    if (setBit(ii, aa) && _alloc_policy != AllocPolicy::NEXT_FIT) {
+        aa ? indexOccupy(ii, ii + 1) : indexRelease(ii, ii + 1);
+    }
+}
+
+bool MemoryManager::setBit(size_t ii, bool aa) {
+    size_t index = ii >> 3;
+    size_t offset = ii & 7;
     unsigned char mask = (1 << offset);
     unsigned char snapshot = _availability_bitset[index];
     if (aa) {
         _availability_bitset[index] |= mask;
         if (snapshot != _availability_bitset[index]) {
-            --_available_bytes;
+            --_available_blocks;
+            return true;
         }
     } else {
         mask = ~mask;
         _availability_bitset[index] &= mask;
         if (snapshot != _availability_bitset[index]) {
-            ++_available_bytes;
+            ++_available_blocks;
+            return true;
         }
     }
+    return false;
+}
+
+void MemoryManager::markAllOccupied(size_t start, size_t count) {
+    markRange(start, count, true);
 }
 
-void MemoryManager::markAllOccupied(int start, int count) {
-    for (int ii = start; ii < start+count; ++ii) {
-        markOccupied(ii, true);
+void MemoryManager::markAllUnoccupied(size_t start, size_t count) {
+    markRange(start, count, false);
+}
+
+void MemoryManager::markRange(size_t start, size_t count, bool aa) {
+    // the index only hears about the bits that actually flipped, one call per stretch of them. So a double free or
+    // marking something that's already used can't make it double count, and the index always sees [start, end)
+    // ranges that were entirely used (or entirely free) before.
+    bool indexed = (_alloc_policy != AllocPolicy::NEXT_FIT);
+    size_t end = start + count;
+    size_t changed_start = start;
+    auto unchanged = [&](size_t ii) {
+        if (indexed && changed_start < ii) {
+            aa ? indexOccupy(changed_start, ii) : indexRelease(changed_start, ii);
+        }
+        changed_start = ii + 1;
+    };
+
+    size_t ii = start;
+    while (ii < end && (ii & 7) != 0) {
+        if (!setBit(ii, aa)) {
+            unchanged(ii);
+        }
+        ++ii;
+    }
+    // whole chars in one go, so the bitset side is count / 8 steps rather than count
+    const unsigned char target = aa ? 0xFF : 0;
+    for (; ii + 8 <= end; ii += 8) {
+        unsigned char flipped = _availability_bitset[ii >> 3] ^ target;
+        _availability_bitset[ii >> 3] = target;
+        size_t num_flipped = static_cast<size_t>(__builtin_popcount(flipped));
+        if (aa) {
+            _available_blocks -= num_flipped;
+        } else {
+            _available_blocks += num_flipped;
+        }
+        if (indexed && flipped != 0xFF) {
+            for (size_t bb = 0; bb < 8; ++bb) {
+                if ((flipped & (1 << bb)) == 0) {
+                    unchanged(ii + bb);
+                }
+            }
+        }
+    }
+    for (; ii < end; ++ii) {
+        if (!setBit(ii, aa)) {
+            unchanged(ii);
+        }
+    }
+    if (indexed && changed_start < end) {
+        aa ? indexOccupy(changed_start, end) : indexRelease(changed_start, end);
+    }
+}
+
+void MemoryManager::setAllocPolicy(AllocPolicy policy) {
+    if (policy == _alloc_policy) {
+        return;
+    }
+    _alloc_policy = policy;
+    _free_by_start.clear();
+    _free_by_length.clear();
+    _tlsf.reset();
+    _segment_tree.reset();
+    if (policy == AllocPolicy::NEXT_FIT) {
+        return;
+    }
+    if (policy == AllocPolicy::SEGMENT_TREE) {
+        size_t needed = (_num_blocks + SegmentTree::kLeafBlocks - 1) / SegmentTree::kLeafBlocks;
+        _segment_tree = std::make_unique<SegmentTree>();
+        _segment_tree->num_leaves = 1;
+        while (_segment_tree->num_leaves < needed) {
+            _segment_tree->num_leaves *= 2;
+        }
+        _segment_tree->nodes.assign(2 * _segment_tree->num_leaves, SegmentTree::Node{0, 0, 0, 0, 0});
+        // every leaf, then every parent
+        updateSegmentTree(0, _num_blocks);
+        return;
+    }
+    if (policy == AllocPolicy::TLSF) {
+        _tlsf = std::make_unique<TlsfIndex>();
+    }
+    // the one full scan, from here on markAll*() keep the index up to date
+    size_t ii = findNextAvailable(0);
+    while (ii < _num_blocks) {
+        size_t run = availableRunLength(ii, _num_blocks - ii);
+        if (_tlsf) {
+            _tlsf->insert(ii, run);
+        } else {
+            addFreeExtent(ii, run);
+        }
+        ii = findNextAvailable(ii + run);
+    }
+}
+
+void MemoryManager::indexOccupy(size_t start, size_t end) {
+    if (_segment_tree) {
+        updateSegmentTree(start, end);
+        return;
+    }
+    if (_tlsf) {
+        // [start, end) was all free, so it sits inside exactly one free extent. Alloc() always takes the front of
+        // one, so that's a single lookup. Anything else (aligned & bounded allocs, tests) walks back to its start.
+        size_t extent_start = _tlsf->contains(start) ? start : freeRunStart(start, start);
+        size_t extent_end = extent_start + _tlsf->lengthOf(extent_start);
+        _tlsf->remove(extent_start);
+        if (extent_start < start) {
+            _tlsf->insert(extent_start, start - extent_start);
+        }
+        if (extent_end > end) {
+            _tlsf->insert(end, extent_end - end);
+        }
+        return;
+    }
+
+    // every extent overlapping [start, end) loses that part, keeping whatever sticks out on either side
+    auto it = _free_by_start.upper_bound(start);
+    if (it != _free_by_start.begin() && std::prev(it)->first + std::prev(it)->second > start) {
+        --it;
+    }
+    size_t head_start = 0, head_length = 0, tail_start = 0, tail_length = 0;
+    while (it != _free_by_start.end() && it->first < end) {
+        size_t extent_end = it->first + it->second;
+        if (it->first < start) {
+            head_start = it->first;
+            head_length = start - it->first;
+        }
+        if (extent_end > end) {
+            tail_start = end;
+            tail_length = extent_end - end;
+        }
+        auto next = std::next(it);
+        removeFreeExtent(it);
+        it = next;
+    }
+    if (head_length > 0) {
+        addFreeExtent(head_start, head_length);
+    }
+    if (tail_length > 0) {
+        addFreeExtent(tail_start, tail_length);
     }
 }
 
-void MemoryManager::markAllUnoccupied(int start, int count) {
-    for (int ii = start; ii < start+count; ++ii) {
-        markOccupied(ii, false);
+void MemoryManager::indexRelease(size_t start, size_t end) {
+    if (_segment_tree) {
+        updateSegmentTree(start, end);
+        return;
     }
+    if (_tlsf) {
+        // immediate coalescing: [start, end) was all used, so the only possible neighbors are the extent ending
+        // right at start & the one starting right at end, one hash lookup each
+        size_t left = _tlsf->startEndingAt(start);
+        if (left != TlsfIndex::kNone) {
+            _tlsf->remove(left);
+            start = left;
+        }
+        if (_tlsf->contains(end)) {
+            size_t right_length = _tlsf->lengthOf(end);
+            _tlsf->remove(end);
+            end += right_length;
+        }
+        _tlsf->insert(start, end - start);
+        return;
+    }
+
+    // merge with every extent overlapping or touching [start, end), so extents are always maximal runs
+    auto it = _free_by_start.upper_bound(start);
+    if (it != _free_by_start.begin() && std::prev(it)->first + std::prev(it)->second >= start) {
+        --it;
+    }
+    while (it != _free_by_start.end() && it->first <= end) {
+        start = std::min(start, it->first);
+        end = std::max(end, it->first + it->second);
+        auto next = std::next(it);
+        removeFreeExtent(it);
+        it = next;
+    }
+    addFreeExtent(start, end - start);
+}
+
+void MemoryManager::addFreeExtent(size_t start, size_t length) {
+    _free_by_start.emplace(start, length);
+    _free_by_length.emplace(length, start);
+}
+
+void MemoryManager::removeFreeExtent(std::map<size_t, size_t>::iterator it) {
+    _free_by_length.erase(std::pair(it->second, it->first));
+    _free_by_start.erase(it);
+}
+
+void MemoryManager::TlsfIndex::mapping(size_t length, size_t& fl, size_t& sl) {
+    // below kSlCount every length gets its own list in class 0. Above, fl is the power of two & sl splits it into
+    // kSlCount equal slices.
+    if (length < kSlCount) {
+        fl = 0;
+        sl = length;
+        return;
+    }
+    size_t msb = 63 - static_cast<size_t>(__builtin_clzll(length));
+    fl = msb - kSlBits + 1;
+    sl = (length >> (msb - kSlBits)) - kSlCount;
+}
+
+size_t MemoryManager::TlsfIndex::findFit(size_t length) const {
+    size_t fl, sl;
+    mapping(length, fl, sl);
+
+    // the head of length's own list fits more often than not, and costs one compare to find out
+    size_t head = heads[fl][sl];
+    if (head != kNone && nodes.at(head).length >= length) {
+        return head;
+    }
+
+    // otherwise any list in a higher class fits, since its smallest possible length beats our class's largest
+    uint32_t sl_map = (sl + 1 < kSlCount) ? (sl_bitmaps[fl] & (~uint32_t(0) << (sl + 1))) : 0;
+    if (sl_map == 0) {
+        uint64_t fl_map = (fl + 1 < kFlCount) ? (fl_bitmap & (~uint64_t(0) << (fl + 1))) : 0;
+        if (fl_map == 0) {
+            return kNone;
+        }
+        fl = static_cast<size_t>(__builtin_ctzll(fl_map));
+        sl_map = sl_bitmaps[fl];
+    }
+    sl = static_cast<size_t>(__builtin_ctz(sl_map));
+    return heads[fl][sl];
+}
+
+void MemoryManager::TlsfIndex::insert(size_t start, size_t length) {
+    size_t fl, sl;
+    mapping(length, fl, sl);
+    size_t head = heads[fl][sl];
+    nodes[start] = Node{length, kNone, head};
+    if (head != kNone) {
+        nodes[head].prev = start;
+    }
+    heads[fl][sl] = start;
+    sl_bitmaps[fl] |= uint32_t(1) << sl;
+    fl_bitmap |= uint64_t(1) << fl;
+    ends[start + length] = start;
+}
+
+void MemoryManager::TlsfIndex::remove(size_t start) {
+    auto it = nodes.find(start);
+    const Node& node = it->second;
+    size_t fl, sl;
+    mapping(node.length, fl, sl);
+    if (node.prev != kNone) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[fl][sl] = node.next;
+        if (node.next == kNone) {
+            sl_bitmaps[fl] &= ~(uint32_t(1) << sl);
+            if (sl_bitmaps[fl] == 0) {
+                fl_bitmap &= ~(uint64_t(1) << fl);
+            }
+        }
+    }
+    if (node.next != kNone) {
+        nodes[node.next].prev = node.prev;
+    }
+    ends.erase(start + node.length);
+    nodes.erase(it);
+}
+
+size_t MemoryManager::TlsfIndex::startEndingAt(size_t end) const {
+    auto it = ends.find(end);
+    return (it == ends.end()) ? kNone : it->second;
+}
+
+size_t MemoryManager::findNextAvailable(size_t ii) const {
+    if (!_segment_tree || ii >= _num_blocks) {
+        return scanNextAvailable(ii, _num_blocks);
+    }
+
+    // the rest of ii's own leaf the usual way
+    const SegmentTree& tree = *_segment_tree;
+    size_t leaf = ii / SegmentTree::kLeafBlocks;
+    size_t leaf_end = std::min((leaf + 1) * SegmentTree::kLeafBlocks, _num_blocks);
+    size_t found = scanNextAvailable(ii, leaf_end);
+    if (found < leaf_end) {
+        return found;
+    }
+
+    // then up until there's a right sibling with something free, and down along the leftmost such children
+    size_t node = tree.num_leaves + leaf;
+    while (node > 1 && ((node & 1) != 0 || tree.nodes[node + 1].free == 0)) {
+        node /= 2;
+    }
+    if (node == 1) {
+        return _num_blocks;
+    }
+    ++node;
+    while (node < tree.num_leaves) {
+        node = (tree.nodes[2 * node].free > 0) ? 2 * node : 2 * node + 1;
+    }
+    size_t start = (node - tree.num_leaves) * SegmentTree::kLeafBlocks;
+    return scanNextAvailable(start, std::min(start + SegmentTree::kLeafBlocks, _num_blocks));
+}
+
+size_t MemoryManager::scanNextAvailable(size_t ii, size_t end) const {
+    // bit by bit until we're lined up with a char, then a whole char at a time while it's all 1s (all used)
+    while (ii < end && (ii & 7) != 0) {
+        if (isAvailable(ii)) {
+            return ii;
+        }
+        ++ii;
+    }
+    while (ii < end && _availability_bitset[ii >> 3] == 0xFF) {
+        ii += 8;
+    }
+    while (ii < end) {
+        if (isAvailable(ii)) {
+            return ii;
+        }
+        ++ii;
+    }
+    return end;
+}
+
+uint64_t MemoryManager::usedWord(size_t ww) const {
+    uint64_t used = 0;
+    for (size_t bb = 0; bb < 8; ++bb) {
+        size_t index = ww * 8 + bb;
+        unsigned char byte = (index < _availability_bitset.size()) ? _availability_bitset[index] : 0xFF;
+        used |= uint64_t(byte) << (8 * bb);
+    }
+    // the padding bits in the last char are 0s, they need to read as used
+    size_t first = ww * 64;
+    if (first + 64 > _num_blocks) {
+        size_t valid = (first < _num_blocks) ? _num_blocks - first : 0;
+        used |= ~uint64_t(0) << valid;
+    }
+    return used;
+}
+
+size_t MemoryManager::countAvailable(size_t lo, size_t hi) const {
+    size_t count = 0;
+    while (lo < hi) {
+        size_t bit = lo & 63;
+        size_t width = std::min(hi - lo, 64 - bit);
+        uint64_t mask = (width == 64) ? ~uint64_t(0) : ((uint64_t(1) << width) - 1) << bit;
+        count += static_cast<size_t>(__builtin_popcountll(~usedWord(lo >> 6) & mask));
+        lo += width;
+    }
+    return count;
+}
+
+size_t MemoryManager::GetFreeBytesInRange(size_t begin, size_t end) const {
+    end = std::min(end, getUsableBytes());
+    if (begin >= end) {
+        return 0;
+    }
+    size_t lo = begin / _block_size;
+    size_t hi = blocksFor(end);
+
+    size_t count = 0;
+    constexpr size_t kLeafBlocks = SegmentTree::kLeafBlocks;
+    if (_segment_tree && hi - lo > 2 * kLeafBlocks) {
+        // popcounts for the partial leaves at either end, and the usual bottom-up range sum for the whole ones
+        size_t first_leaf = (lo + kLeafBlocks - 1) / kLeafBlocks;
+        size_t last_leaf = hi / kLeafBlocks;
+        count = countAvailable(lo, first_leaf * kLeafBlocks) + countAvailable(last_leaf * kLeafBlocks, hi);
+        const SegmentTree& tree = *_segment_tree;
+        for (size_t left = tree.num_leaves + first_leaf, right = tree.num_leaves + last_leaf; left < right; left /= 2, right /= 2) {
+            if (left & 1) {
+                count += tree.nodes[left++].free;
+            }
+            if (right & 1) {
+                count += tree.nodes[--right].free;
+            }
+        }
+    } else {
+        count = countAvailable(lo, hi);
+    }
+
+    // blocks sticking out of the range only count for the part inside it
+    size_t bytes = count * _block_size;
+    if (isAvailable(lo)) {
+        bytes -= begin - lo * _block_size;
+    }
+    if (isAvailable(hi - 1)) {
+        bytes -= hi * _block_size - end;
+    }
+    return bytes;
+}
+
+void MemoryManager::updateSegmentTree(size_t start, size_t end) {
+    if (start >= end) {
+        return;
+    }
+    SegmentTree& tree = *_segment_tree;
+    constexpr size_t kWordsPerLeaf = SegmentTree::kLeafBlocks / 64;
+    size_t first = start / SegmentTree::kLeafBlocks;
+    size_t last = (end - 1) / SegmentTree::kLeafBlocks;
+    for (size_t leaf = first; leaf <= last; ++leaf) {
+        SegmentTree::Node node{0, 0, 0, 0, 0};
+        for (size_t ww = 0; ww < kWordsPerLeaf; ++ww) {
+            node = SegmentTree::merge(node, ww * 64, SegmentTree::fromWord(usedWord(leaf * kWordsPerLeaf + ww)), 64);
+        }
+        tree.nodes[tree.num_leaves + leaf] = node;
+    }
+
+    // and the parents, a level at a time
+    size_t lo = tree.num_leaves + first;
+    size_t hi = tree.num_leaves + last;
+    size_t child_length = SegmentTree::kLeafBlocks;
+    while (lo > 1) {
+        lo /= 2;
+        hi /= 2;
+        for (size_t ii = lo; ii <= hi; ++ii) {
+            tree.nodes[ii] = SegmentTree::merge(tree.nodes[2 * ii], child_length, tree.nodes[2 * ii + 1], child_length);
+        }
+        child_length *= 2;
+    }
+}
+
+size_t MemoryManager::segmentTreeFirstFit(size_t num_blocks) const {
+    const SegmentTree& tree = *_segment_tree;
+    if (tree.nodes[1].longest < num_blocks) {
+        return _num_blocks;
+    }
+    return segmentTreeFirstFitIn(1, 0, tree.num_leaves * SegmentTree::kLeafBlocks, num_blocks);
+}
+
+size_t MemoryManager::segmentTreeFirstFitFrom(size_t ii, size_t num_blocks) const {
+    // runs starting in the rest of ii's own leaf the usual way, never probing past the leaf. A run that reaches the
+    // leaf's end might go on into the next ones, so it becomes the carry of the walk below instead.
+    const SegmentTree& tree = *_segment_tree;
+    size_t leaf = ii / SegmentTree::kLeafBlocks;
+    size_t leaf_end = std::min((leaf + 1) * SegmentTree::kLeafBlocks, _num_blocks);
+    size_t carry = 0;
+    size_t jj = scanNextAvailable(ii, leaf_end);
+    while (jj < leaf_end) {
+        size_t run = availableRunLength(jj, std::min(num_blocks, leaf_end - jj));
+        if (run == num_blocks) {
+            return jj;
+        }
+        if (jj + run == leaf_end) {
+            carry = run;
+            break;
+        }
+        jj = scanNextAvailable(jj + run, leaf_end);
+    }
+
+    // then the nodes covering all the later leaves, left to right (the left edge of a bottom-up range query), with
+    // carry the free run reaching into each one from the nodes before it
+    size_t base = (leaf + 1) * SegmentTree::kLeafBlocks;
+    size_t length = SegmentTree::kLeafBlocks;
+    for (size_t lo = tree.num_leaves + leaf + 1, hi = 2 * tree.num_leaves; lo < hi; lo /= 2, hi /= 2, length *= 2) {
+        if ((lo & 1) != 0) {
+            const SegmentTree::Node& node = tree.nodes[lo];
+            if (carry + node.prefix >= num_blocks) {
+                return base - carry;
+            }
+            if (node.longest >= num_blocks) {
+                return segmentTreeFirstFitIn(lo, base, length, num_blocks);
+            }
+            carry = (node.prefix == length) ? carry + length : node.suffix;
+            base += length;
+            ++lo;
+        }
+    }
+    return _num_blocks;
+}
+
+size_t MemoryManager::segmentTreeFirstFitIn(size_t node, size_t base, size_t length, size_t num_blocks) const {
+    // Left child if it has a run that long, else a run across the middle if that's long enough, else the right
+    // child. Whichever comes first is the lowest such run.
+    const SegmentTree& tree = *_segment_tree;
+    while (node < tree.num_leaves) {
+        size_t half = length / 2;
+        const SegmentTree::Node& left = tree.nodes[2 * node];
+        const SegmentTree::Node& right = tree.nodes[2 * node + 1];
+        if (left.longest >= num_blocks) {
+            node = 2 * node;
+        } else if (left.suffix + right.prefix >= num_blocks) {
+            return base + half - left.suffix;
+        } else {
+            node = 2 * node + 1;
+            base += half;
+        }
+        length = half;
+    }
+
+    // the run is inside this leaf
+    size_t end = std::min(base + SegmentTree::kLeafBlocks, _num_blocks);
+    size_t ii = scanNextAvailable(base, end);
+    while (ii < end) {
+        size_t run = availableRunLength(ii, std::min(num_blocks, end - ii));
+        if (run == num_blocks) {
+            return ii;
+        }
+        ii = scanNextAvailable(ii + run, end);
+    }
+    return _num_blocks;
+}
+
+MemoryManager::SegmentTree::Node MemoryManager::SegmentTree::merge(const Node& left, size_t left_length, const Node& right,
+                                                                   size_t right_length) {
+    Node node;
+    node.free = left.free + right.free;
+    node.prefix = (left.prefix == left_length) ? left_length + right.prefix : left.prefix;
+    node.suffix = (right.suffix == right_length) ? right_length + left.suffix : right.suffix;
+    node.longest = std::max({left.longest, right.longest, left.suffix + right.prefix});
+    // a run across the middle got counted once on each side
+    node.runs = left.runs + right.runs - ((left.suffix > 0 && right.prefix > 0) ? 1 : 0);
+    return node;
+}
+
+MemoryManager::SegmentTree::Node MemoryManager::SegmentTree::fromWord(uint64_t used) {
+    if (used == 0) {
+        return Node{64, 64, 64, 64, 1};
+    }
+    uint64_t free_bits = ~used;
+    Node node{static_cast<size_t>(__builtin_popcountll(free_bits)), static_cast<size_t>(__builtin_ctzll(used)),
+              static_cast<size_t>(__builtin_clzll(used)), 0, 0};
+    // one step per run of 0s, shifting 1s in on top so every run ends
+    while (free_bits != 0) {
+        size_t start = static_cast<size_t>(__builtin_ctzll(free_bits));
+        size_t length = static_cast<size_t>(__builtin_ctzll(~(free_bits >> start)));
+        node.longest = std::max(node.longest, length);
+        ++node.runs;
+        if (start + length >= 64) {
+            break;
+        }
+        free_bits &= ~uint64_t(0) << (start + length);
+    }
+    return node;
+}
+
+size_t MemoryManager::availableRunLength(size_t ii, size_t limit) const {
+    // same trick as findNextAvailable(), but skipping chars that are all 0s (all unused). The padding bits past
+    // _num_blocks in the last char are 0s too, hence clamping against end rather than trusting the char.
+    size_t end = (limit < _num_blocks - ii) ? ii + limit : _num_blocks;
+    size_t jj = ii;
+    while (jj < end && (jj & 7) != 0) {
+        if (!isAvailable(jj)) {
+            return jj - ii;
+        }
+        ++jj;
+    }
+    while (jj + 8 <= end && _availability_bitset[jj >> 3] == 0) {
+        jj += 8;
+    }
+    while (jj < end && isAvailable(jj)) {
+        ++jj;
+    }
+    return jj - ii;
 }
 
 void MemoryManager::Output() const {
     std::string ss = "";
-    for (int ii = 0; ii < _num_bytes; ++ii) {
+    for (size_t ii = 0; ii < _num_blocks; ++ii) {
         if (isAvailable(ii)) {
             ss += "-";
         } else {
@@ -152,3 +1607,191 @@ void MemoryManager::Output() const {
     }
     std::cout << ss << std::endl;
 }
+
+FreeSpaceStats MemoryManager::GetFreeSpaceStats() const {
+    FreeSpaceStats stats = {0, 0, 0};
+    if (_segment_tree) {
+        // the root has it all
+        const SegmentTree::Node& root = _segment_tree->nodes[1];
+        stats.free_bytes = _available_blocks * _block_size;
+        stats.free_runs = root.runs;
+        stats.largest_free_run = root.longest * _block_size;
+        return stats;
+    }
+    if (_tlsf) {
+        // the highest non-empty class has the largest extent, somewhere in its list
+        stats.free_bytes = _available_blocks * _block_size;
+        stats.free_runs = _tlsf->nodes.size();
+        if (_tlsf->fl_bitmap != 0) {
+            size_t fl = 63 - static_cast<size_t>(__builtin_clzll(_tlsf->fl_bitmap));
+            size_t sl = 31 - static_cast<size_t>(__builtin_clz(_tlsf->sl_bitmaps[fl]));
+            for (size_t node = _tlsf->heads[fl][sl]; node != TlsfIndex::kNone; node = _tlsf->nodes.at(node).next) {
+                stats.largest_free_run = std::max(stats.largest_free_run, _tlsf->nodes.at(node).length * _block_size);
+            }
+        }
+        return stats;
+    }
+    if (_alloc_policy == AllocPolicy::MIN_FRAGMENTS) {
+        // the index has all of it already, no scan needed
+        stats.free_bytes = _available_blocks * _block_size;
+        stats.free_runs = _free_by_start.size();
+        stats.largest_free_run = _free_by_length.empty() ? 0 : _free_by_length.rbegin()->first * _block_size;
+        return stats;
+    }
+    size_t ii = findNextAvailable(0);
+    while (ii < _num_blocks) {
+        size_t run = availableRunLength(ii, _num_blocks - ii);
+        ++stats.free_runs;
+        stats.free_bytes += run;
+        if (run > stats.largest_free_run) {
+            stats.largest_free_run = run;
+        }
+        ii = findNextAvailable(ii + run);
+    }
+
+    // everything above was counted in blocks
+    stats.free_bytes *= _block_size;
+    stats.largest_free_run *= _block_size;
+    return stats;
+}
+
+bool MemoryManager::setReleasePolicy(const ReleasePolicy& policy) {
+    if (!_backing.isMapped()) {
+        return false;
+    }
+    _release_policy = policy;
+    return true;
+}
+
+size_t MemoryManager::ReleaseFreePages() {
+    if (_release_policy.mode == ReleaseMode::NONE) {
+        return 0;
+    }
+    size_t released = 0;
+    size_t ii = findNextAvailable(0);
+    while (ii < _num_blocks) {
+        size_t run = availableRunLength(ii, _num_blocks - ii);
+        released += releaseRun(ii, ii + run);
+        ii = findNextAvailable(ii + run);
+    }
+    return released;
+}
+
+size_t MemoryManager::freeRunStart(size_t ii, size_t limit) const {
+    // mirror image of availableRunLength(): bit by bit until we're lined up with a char, then a whole char at a time
+    // while it's all 0s (all unused), then bit by bit again
+    size_t stop = (limit < ii) ? ii - limit : 0;
+    size_t jj = ii;
+    while (jj > stop && (jj & 7) != 0) {
+        if (!isAvailable(jj - 1)) {
+            return jj;
+        }
+        --jj;
+    }
+    while (jj >= stop + 8 && _availability_bitset[(jj >> 3) - 1] == 0) {
+        jj -= 8;
+    }
+    while (jj > stop && isAvailable(jj - 1)) {
+        --jj;
+    }
+    return jj;
+}
+
+void MemoryManager::finishAlloc(MemoryBlocks& result, bool zero_fill) {
+    if (!_backing.isMapped()) {
+        if (zero_fill) {
+            for (const auto& tuple : result.allocations) {
+                std::memset(tuple.first, 0, tuple.second);
+            }
+        }
+        return;
+    }
+
+    for (const auto& tuple : result.allocations) {
+        if (!_backing.commit(static_cast<size_t>(tuple.first - _buffer), tuple.second)) {
+            // give every block back, the caller can't use half an allocation. Whatever did get committed stays
+            // committed, which is harmless.
+            for (const auto& undo : result.allocations) {
+                markAllUnoccupied(static_cast<size_t>(undo.first - _buffer) / _block_size, undo.second / _block_size);
+            }
+            result = MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+            return;
+        }
+    }
+    touchPages(result, zero_fill);
+}
+
+void MemoryManager::touchPages(const MemoryBlocks& blocks, bool zero_fill) {
+    const size_t page_size = BackingStore::getPageSize();
+    for (const auto& tuple : blocks.allocations) {
+        size_t ll = static_cast<size_t>(tuple.first - _buffer);
+        size_t rr = ll + tuple.second;
+        for (size_t page = ll / page_size; page * page_size < rr; ++page) {
+            if (zero_fill && (_page_flags[page] & kPageDirty)) {
+                size_t from = std::max(ll, page * page_size);
+                size_t to = std::min(rr, (page + 1) * page_size);
+                std::memset(_buffer + from, 0, to - from);
+            }
+            if (_page_flags[page] & kPageReleased) {
+                --_released_pages_count;
+            }
+            _page_flags[page] = kPageDirty;
+        }
+    }
+}
+
+size_t MemoryManager::releaseRun(size_t start, size_t end) {
+    const size_t page_size = BackingStore::getPageSize();
+    if ((end - start) * _block_size < _release_policy.threshold_bytes) {
+        return 0;
+    }
+
+    // only the pages that are free from end to end. Past the last block, the leftover bytes are never handed out,
+    // so a run reaching the end gets the (page rounded) rest of the mapping too.
+    size_t ll = start * _block_size;
+    size_t rr = (end == _num_blocks) ? _page_flags.size() * page_size : end * _block_size;
+    size_t first_page = (ll + page_size - 1) / page_size;
+    size_t end_page = rr / page_size;
+
+    // one madvise() per stretch of pages that aren't released yet. On a reserved buffer, pages that were never
+    // committed have nothing to give back (& madvise() on PROT_NONE memory would only make them look released),
+    // so they're skipped like released ones.
+    auto releasable = [this, page_size](size_t pp) {
+        return !(_page_flags[pp] & kPageReleased) && _backing.isCommitted(pp * page_size);
+    };
+    size_t released = 0;
+    size_t page = first_page;
+    while (page < end_page) {
+        if (!releasable(page)) {
+            ++page;
+            continue;
+        }
+        size_t stretch_end = page;
+        while (stretch_end < end_page && releasable(stretch_end)) {
+            ++stretch_end;
+        }
+        if (_backing.release(page * page_size, (stretch_end - page) * page_size, _release_policy.mode)) {
+            for (size_t pp = page; pp < stretch_end; ++pp) {
+                // MADV_FREE pages may come back with their old contents, so only DONTNEED makes them known zero
+                if (_release_policy.mode == ReleaseMode::DONTNEED) {
+                    _page_flags[pp] = kPageReleased;
+                } else {
+                    _page_flags[pp] |= kPageReleased;
+                }
+            }
+            _released_pages_count += stretch_end - page;
+            released += (stretch_end - page) * page_size;
+        }
+        page = stretch_end;
+    }
+    return released;
+}
+
+void MemoryManager::releaseAround(size_t start, size_t end) {
+    // Only need to know whether the run around [start, end) reaches the threshold, so don't look any further out
+    // than that. Keeps Free() from walking a run of gigabytes every time a few bytes get freed next to it.
+    size_t limit = blocksFor(_release_policy.threshold_bytes + BackingStore::getPageSize());
+    size_t run_start = freeRunStart(start, limit);
+    size_t run_end = end + availableRunLength(end, limit);
+    releaseRun(run_start, run_end);
+}
@@ -1,6 +1,15 @@
 #pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
 #include <vector>
 
+#include "backing_store.h"
+
 #ifdef TESTING
 #define TESTING_VISIBLE public
 #else
@@ -45,14 +54,15 @@ enum class MemoryStatus {
     INSUFFICIENT_MEMORY,
     OUT_OF_MEMORY,
     INVALID_MEMORY_LOCATIONS,
+    INVALID_ALIGNMENT,
 };
 
 struct MemoryBlocks {
     // Indicates if our allocation attempt succeeded, or what went wrong
     MemoryStatus status;
 
-    // Each allocation contains a char* pointing to the allocated spot, and an int for how many continuous chars you get access to at this char* location
-    std::vector<std::pair<char*, int>> allocations;
+    // Each allocation contains a char* pointing to the allocated spot, and a size_t for how many continuous chars you get access to at this char* location
+    std::vector<std::pair<char*, size_t>> allocations;
 
     MemoryBlocks()
     : status(MemoryStatus::UNKNOWN)
@@ -62,54 +72,532 @@ struct MemoryBlocks {
     : status(s)
     , allocations() {}
 
-    MemoryBlocks(MemoryStatus s, const std::vector<std::pair<char*, int>>& a)
+    MemoryBlocks(MemoryStatus s, const std::vector<std::pair<char*, size_t>>& a)
     : status(s)
     , allocations(a) {}
 };
 
+// Compact version of MemoryBlocks: each extent is a 32-bit block offset from the start of the buffer & a 32-bit
+// length in blocks, 8 bytes per extent instead of 16. Stored as two parallel arrays (structure of arrays), so a pass
+// over just the offsets or just the lengths touches half the memory. Only means something together with the
+// manager that made it, see MemoryManager::ToCompact() & FromCompact().
+struct CompactBlocks {
+    MemoryStatus status;
+
+    // offsets[ii] & lengths[ii] are extent ii, both in blocks
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+
+    CompactBlocks()
+    : status(MemoryStatus::UNKNOWN)
+    , offsets()
+    , lengths() {}
+
+    CompactBlocks(MemoryStatus s)
+    : status(s)
+    , offsets()
+    , lengths() {}
+
+    size_t size() const { return offsets.size(); }
+};
+
+// Snapshot of how the free space in a manager is laid out, see MemoryManager::GetFreeSpaceStats()
+struct FreeSpaceStats {
+    size_t free_bytes;
+
+    // Number of maximal runs of free bytes, and the length of the longest one
+    size_t free_runs;
+    size_t largest_free_run;
+
+    // 0 when all the free space is one continuous run, creeping towards 1 as it gets chopped into small pieces
+    double fragmentation() const {
+        if (free_bytes == 0) {
+            return 0.0;
+        }
+        return 1.0 - static_cast<double>(largest_free_run) / free_bytes;
+    }
+};
+
+// When & how a manager that owns its buffer gives free pages back to the OS, see MemoryManager::setReleasePolicy()
+struct ReleasePolicy {
+    ReleaseMode mode;
+
+    // Hysteresis: only free runs of at least this many bytes get released, so the small holes that churn all the time
+    // stay resident instead of bouncing between madvise() & page faults. Rounded up to whole pages, and a run only
+    // gives back the whole pages inside of it.
+    size_t threshold_bytes;
+
+    // false releases from inside Free(), as soon as a run crosses the threshold. true leaves Free() alone, and
+    // releases only when ReleaseFreePages() gets called (from a timer, an idle loop, a background thread holding
+    // the same lock as Alloc/Free, ...).
+    bool batched;
+};
+
+// Where Alloc(size) looks for free blocks, see MemoryManager::setAllocPolicy()
+enum class AllocPolicy {
+    // first free blocks from where the last allocation ended, wrapping around. Fast & no extra memory, but takes
+    // whatever fragments it runs into.
+    NEXT_FIT,
+    // as few fragments as possible: the largest free extents first, and the smallest one that fits for the rest
+    MIN_FRAGMENTS,
+    // Two-Level Segregated Fit: free extents in size-class lists found through 2 levels of bitmaps, so finding an
+    // extent that fits is O(1) (a couple of bit scans) & so is merging on free. For hard latency bounds, as long as
+    // requests fit in one free extent (see setAllocPolicy() for what it costs otherwise).
+    TLSF,
+    // first fit through a segment tree of free counts & free run lengths over the bitset, so finding the lowest run
+    // that fits (or jumping over a used stretch) is O(log n) instead of a bitset walk. Marking what it found is still
+    // proportional to the request size, see setAllocPolicy().
+    SEGMENT_TREE,
+};
+
+class TraceRecorder;
+
 class MemoryManager {
   public:
     // buffer is a large chunk of contiguous memory.
     // num_bytes is the size of the buffer.
-    MemoryManager(char* buffer, int num_bytes);
+    // block_size is the allocation granularity: the buffer is handed out in whole blocks of this many bytes, and
+    // each bit in the bitset tracks one block. Bigger blocks shrink the bitset & speed up scans by the same factor,
+    // at the cost of internal fragmentation (requests get rounded up to whole blocks). If num_bytes isn't a multiple
+    // of block_size, the leftover tail bytes are never handed out. Values below 1 are treated as 1.
+    // Everything is size_t so one manager can cover well past 2 GB (one per NUMA node on a big host, say).
+    // A null buffer makes an empty manager whatever num_bytes says, so every Alloc() comes back OUT_OF_MEMORY.
+    MemoryManager(char* buffer, size_t num_bytes, size_t block_size = 1);
+
+    // Same as above, except the manager owns its buffer & unmaps it when it goes away. Managers are move-only
+    // because of this (moving one is fine, the mapping doesn't move with it).
+    explicit MemoryManager(BackingStore&& backing, size_t block_size = 1);
+
+    // Managers used to be copyable, and a copy shared the caller's buffer with its own bitset, so the two handed out
+    // the same bytes. That's a bug waiting to happen & can't work at all for an owned mapping, so copies are gone
+    // for every manager. Hold one by unique_ptr, or move it.
+    MemoryManager(const MemoryManager&) = delete;
+    MemoryManager& operator=(const MemoryManager&) = delete;
+    MemoryManager(MemoryManager&&) = default;
+    MemoryManager& operator=(MemoryManager&&) = default;
+
+    // Maps num_bytes itself (see BackingStore for what populate & huge_pages do), nullptr if the mapping failed
+    static std::unique_ptr<MemoryManager> CreateMapped(size_t num_bytes, size_t block_size = 1, bool populate = false,
+                                                       bool huge_pages = false);
+
+    // Only reserves num_bytes of address space, and commits it as Alloc() first hands it out (see
+    // BackingStore::Reserve()). Construction is O(1) no matter the size, and memory use follows what's actually in
+    // use. Alloc() returns OUT_OF_MEMORY if the kernel refuses to commit, with nothing allocated.
+    static std::unique_ptr<MemoryManager> CreateReserved(size_t num_bytes, size_t block_size = 1, bool huge_pages = false);
+
+    // Allocate memory of size 'size'. Use malloc() like semantics. size gets rounded up to whole blocks, and the
+    // returned lengths reflect that.
+    MemoryBlocks Alloc(size_t size);
 
-    // Allocate memory of size 'size'. Use malloc() like semantics.
-    MemoryBlocks Alloc(int size);
+    // Same as above, except every returned extent starts on an address that is a multiple of alignment (which has
+    // to be a power of two, otherwise it's INVALID_ALIGNMENT). With contiguous set, you get exactly one extent or
+    // nothing. Aligned runs are looked for in the bitset directly, so nothing gets over-allocated & trimmed. This
+    // can fail with INSUFFICIENT_MEMORY even when there are enough free bytes, if not enough of them sit behind an
+    // aligned block. It's also INVALID_ALIGNMENT when no block in the buffer can ever start on the boundary (eg a
+    // buffer that is itself misaligned w.r.t. a block_size that is a multiple of alignment).
+    MemoryBlocks Alloc(size_t size, size_t alignment, bool contiguous = false);
 
-    // Free up previously allocated memory.  Use free() like semantics.
+    // Same as Alloc(size), except you get at most max_fragments extents, or nothing at all (INSUFFICIENT_MEMORY, with
+    // the bitset untouched). The usual next-fit walk gets the first shot; if it would need more extents than that,
+    // the max_fragments largest free runs in the buffer are used instead, biggest first. Costs a full bitset scan
+    // in that case, so it's slower than Alloc() on a fragmented buffer, but never hands back hundreds of slivers.
+    MemoryBlocks AllocBounded(size_t size, size_t max_fragments);
+
+    // Same as Alloc(size), except the search starts at hint (any pointer into the buffer, typically into an earlier
+    // allocation) instead of the next-fit location: the free blocks right after the used run hint sits in come first,
+    // so appending to one buffer keeps its pieces next to each other. With NEXT_FIT it's next-fit from there like
+    // Alloc(), and the next-fit location that Alloc() uses stays where it was. The other policies take the first free
+    // run at or after hint that holds the whole request, found through their index (a bitset walk for TLSF, whose
+    // lists aren't in address order), and fall back to their own Alloc() pick when there's none. nullptr or a hint
+    // outside the buffer is just Alloc(size). A separate name for the same reason as AllocBounded(): Alloc(size, 0)
+    // would be ambiguous.
+    MemoryBlocks AllocNear(size_t size, const char* hint);
+
+    // Same as Alloc(size), except the memory is zeroed. On a manager that owns its buffer, pages that are known to
+    // still be zero (never handed out since they were mapped or released with DONTNEED) skip the memset.
+    MemoryBlocks AllocZeroed(size_t size);
+
+    // Free up previously allocated memory.  Use free() like semantics. Every allocation has to start on a block
+    // boundary (otherwise it's INVALID_MEMORY_LOCATIONS), and lengths get rounded up to whole blocks, so passing
+    // either the requested size or the rounded-up one frees the same blocks.
     MemoryStatus Free(const MemoryBlocks& blocks);
 
+    // Same as Free() on FromCompact(blocks)
+    MemoryStatus Free(const CompactBlocks& blocks);
+
+    // Converting between the two representations, which is just a subtraction & divide (or multiply & add) per
+    // extent. Compact blocks need every offset & length to fit in 32 bits, which is a given as long as the manager
+    // has at most 2^32 - 1 blocks (see canUseCompactBlocks(), eg block_size 64 covers 256 GB). Extents that don't
+    // convert (outside the buffer, not on a block boundary, too big) make the result INVALID_MEMORY_LOCATIONS with
+    // no extents. Lengths come back rounded up to whole blocks.
+    CompactBlocks ToCompact(const MemoryBlocks& blocks) const;
+    MemoryBlocks FromCompact(const CompactBlocks& blocks) const;
+    bool canUseCompactBlocks() const { return _num_blocks <= UINT32_MAX; }
+
+    // free() like: releases the whole allocation (every extent of it) that starts at ptr, without having to keep the
+    // MemoryBlocks around. Needs allocation tracking on, see setAllocationTracking(). INVALID_MEMORY_LOCATIONS for
+    // anything that isn't the start of a live allocation, and nullptr is a no-op like free(nullptr).
+    MemoryStatus Free(char* ptr);
+
+    // Turns the allocation map behind Free(char*) & SizeOf() on or off. Every Alloc then records its extents in a
+    // hash map keyed by its first block, so lookups are O(1) on average at the cost of one map entry per live
+    // allocation. Can only be turned on while nothing is allocated (false otherwise), since allocations from before
+    // would be missing from the map. With tracking on, Free() and Realloc() only take whole allocations, exactly what
+    // Alloc/Realloc returned (Free(char*) always is one). Anything else, like part of an allocation, is
+    // INVALID_MEMORY_LOCATIONS and frees nothing, since the map would describe memory that's been handed back.
+    // Realloc() to a smaller size is how to give back part of one.
+    bool setAllocationTracking(bool enabled);
+    bool isTrackingAllocations() const { return _track_allocations; }
+
+    // Whether ptr points into memory that's handed out right now, anywhere inside an allocation. O(1), one bitset
+    // lookup, and works with or without allocation tracking.
+    bool Owns(const char* ptr) const;
+
+    // Bytes in the allocation starting at ptr (all extents, rounded up to blocks), 0 if there is none or allocation
+    // tracking is off. O(1) on average.
+    size_t SizeOf(const char* ptr) const;
+
+    // Resizes blocks (the result of an earlier Alloc) to new_size, in place where possible:
+    //   - shrinking frees everything past new_size, one range per extent, and never moves anything
+    //   - growing first takes the free blocks right after the last extent, then adds more extents (next-fit, same as
+    //     Alloc), and only copies when contiguous is set & the last extent can't grow enough in place. Then
+    //     everything gets copied into one new extent & the old extents freed.
+    //   - with contiguous set, blocks made of several extents always get copied into one, whatever new_size is
+    // blocks gets updated on SUCCESS, and stays exactly as it was otherwise. Lengths come back rounded up to whole
+    // blocks like Alloc's, and new_size 0 frees everything.
+    MemoryStatus Realloc(MemoryBlocks& blocks, size_t new_size, bool contiguous = false);
+
     void Output() const;
 
+    // Walks the whole bitset, so this is O(num_bytes) (except with AllocPolicy::MIN_FRAGMENTS or SEGMENT_TREE, where
+    // the index makes it O(1)). Meant for reporting, not for hot paths.
+    FreeSpaceStats GetFreeSpaceStats() const;
+
+    // Free bytes in [begin, end), as offsets into the buffer. Blocks sticking out of either end only count for their
+    // bytes inside the range. O(log n) with AllocPolicy::SEGMENT_TREE, a popcount over the range otherwise.
+    size_t GetFreeBytesInRange(size_t begin, size_t end) const;
+
+    // Switches how Alloc(size) (and AllocZeroed(), and Realloc() growth past the last extent) picks blocks.
+    // MIN_FRAGMENTS keeps an ordered index of the free extents (by address for merging, by length for picking) that
+    // every bitset update keeps in sync, so picking never scans the bitset: a request takes O(fragments * log extents).
+    // The price is 2 tree nodes per free extent & slower Alloc/Free on a lightly fragmented buffer. Switching to it
+    // builds the index with one scan, switching away drops it. Starts out as NEXT_FIT.
+    //
+    // TLSF keeps the free extents in segregated lists instead (hash maps from start & end block to extent, no trees),
+    // and finds an extent that fits in O(1): the head of the request's own size class, or else the first non-empty
+    // class above it, found with one bit scan per bitmap level. The request is carved from the front of that extent,
+    // and Free() merges with both neighbors right away, also O(1). Only when no single extent is big enough does
+    // it fall back to fragments, whole extents from the largest class down, which is O(fragments returned) and so up
+    // to O(free extents). Marking the blocks in the bitset comes on top, O(size / 8) like for every policy.
+    //
+    // SEGMENT_TREE keeps a summary per 512 blocks of bitset (free count, free run at either end, longest free run &
+    // number of runs) in a complete binary tree, each node the merge of its two children. The lowest run that fits a
+    // request is one walk down the tree, O(log n). When no run is long enough it's next-fit fragments like NEXT_FIT,
+    // except getting past a used stretch goes through the tree too. Every bitset update flips its bits a char at a
+    // time, then redoes the leaves it touched (8 words each) & their parents. So an Alloc or Free of size blocks
+    // costs O(log n + size / 8) in all, not O(log n). About as much memory as the bitset itself.
+    void setAllocPolicy(AllocPolicy policy);
+    AllocPolicy getAllocPolicy() const { return _alloc_policy; }
+
+    // Opt-in parallel scan for huge requests: with AllocPolicy::NEXT_FIT, Alloc() (and AllocZeroed()) of at least
+    // min_bytes splits the bitset into num_threads chunks in next-fit order, counts the free blocks in every chunk on
+    // its own thread, and then has each chunk up to the one where the request runs out collect & mark its runs, also
+    // in parallel. Same extents as the single threaded walk, just done by num_threads threads, which get started for
+    // each such call (nothing runs in between). Only pays off for requests in the hundreds of MB and up. num_threads
+    // 0 or 1 turns it off, which is where it starts out. This doesn't make the manager any more thread-safe.
+    void setParallelScan(size_t num_threads, size_t min_bytes);
+
+    // Every Alloc() & Free() gets logged to recorder until this is called again with nullptr. The manager does
+    // NOT take ownership of recorder, it needs to outlive the manager (or be detached first).
+    void setTraceRecorder(TraceRecorder* recorder) { _trace_recorder = recorder; }
+
+    // Only does something for managers that own their buffer (it's false & ignored otherwise), since a caller's
+    // buffer might not even be anonymous memory. Starts out as ReleaseMode::NONE.
+    bool setReleasePolicy(const ReleasePolicy& policy);
+
+    // Releases every free run at or above the policy's threshold right now, returns how many bytes got released.
+    // O(num_bytes) like GetFreeSpaceStats(), this is the batched trigger.
+    size_t ReleaseFreePages();
+
+    // Bytes of the buffer that are committed, see CreateReserved(). Caller buffers count as fully committed.
+    size_t getCommittedBytes() const { return _backing.isMapped() ? _backing.getCommittedBytes() : _num_bytes; }
+
+    // Bytes currently handed back to the OS
+    size_t getReleasedBytes() const { return _released_pages_count * BackingStore::getPageSize(); }
+
+    size_t getBlockSize() const { return _block_size; }
+
+    // Start of the managed buffer
+    char* getBuffer() const { return _buffer; }
+
+    // Bytes not handed out right now, O(1). Says nothing about how they're laid out, see GetFreeSpaceStats() for that.
+    size_t getFreeBytes() const { return _available_blocks * _block_size; }
+
+    // Bytes that can actually be handed out, ie num_bytes rounded down to whole blocks
+    size_t getUsableBytes() const { return _num_blocks * _block_size; }
+
   TESTING_VISIBLE:
+    // NOTE: Everything below works in blocks, not bytes (same thing unless you passed a block_size above 1).
+
     // return true if bit ii is a 0 (unused), false otherwise. Putting this in comment, since it caused
     // massive team confusion at a previous job of mine...
-    bool isAvailable(int ii) const;
+    bool isAvailable(size_t ii) const;
 
     // humor me, aa being true means mark bit ii as 1 (used), aa being false means mark bit ii as 0 (unused).
     // my brain was going to melt if I did NOT write the comment about when to mark a bit as 1 or 0.
-    void markOccupied(int ii, bool aa);
+    void markOccupied(size_t ii, bool aa);
 
-    void markAllOccupied(int start, int count);
+    void markAllOccupied(size_t start, size_t count);
 
-    void markAllUnoccupied(int start, int count);
+    void markAllUnoccupied(size_t start, size_t count);
 
     // These methods below exist ONLY for testing
 
-    int getAvailableBytes() const { return _available_bytes; }
-    int getNextByteLocation() const { return _next_byte_location; }
-    std::vector<unsigned char> getAvailabilityBitset() const { return _availability_bitset; }
-    void setNextByteLocation(int val) { _next_byte_location = val; }
-    int size() const { return _num_bytes; }
+    size_t getAvailableBytes() const { return _available_blocks * _block_size; }
+    size_t getNextByteLocation() const { return _next_block_location; }
+    std::vector<unsigned char> getAvailabilityBitset() const {
+        return std::vector<unsigned char>(_availability_bitset.begin(), _availability_bitset.end());
+    }
+    void setNextByteLocation(size_t val) { _next_block_location = val; }
+    size_t size() const { return _num_blocks; }
+    bool isPageKnownZero(size_t page) const { return (_page_flags[page] & kPageDirty) == 0; }
+    bool isPageReleased(size_t page) const { return (_page_flags[page] & kPageReleased) != 0; }
+    std::vector<std::pair<size_t, size_t>> getFreeExtents() const {
+        if (_tlsf) {
+            std::vector<std::pair<size_t, size_t>> extents;
+            for (const auto& node : _tlsf->nodes) {
+                extents.push_back(std::pair(node.first, node.second.length));
+            }
+            std::sort(extents.begin(), extents.end());
+            return extents;
+        }
+        return std::vector<std::pair<size_t, size_t>>(_free_by_start.begin(), _free_by_start.end());
+    }
 
   private:
+    // size in bytes, rounded up to whole blocks. Written this way so it can't overflow for sizes near SIZE_MAX.
+    size_t blocksFor(size_t size) const { return (size / _block_size) + ((size % _block_size) != 0); }
+
+    // Alloc()'s search for num_blocks blocks, whichever the policy says
+    MemoryBlocks allocBlocks(size_t num_blocks);
+
+    // The next-fit walk (with wraparound) over _availability_bitset that backs Alloc(), works in blocks
+    MemoryBlocks allocNextFit(size_t num_blocks);
+
+    // allocNextFit() split over _scan_threads threads, see setParallelScan()
+    MemoryBlocks allocNextFitParallel(size_t num_blocks);
+
+    // Next-fit search for runs starting on blocks first_aligned + k*stride, see Alloc(size, alignment, contiguous).
+    // Runs are collected before anything gets marked, so a failed search leaves the bitset untouched.
+    MemoryBlocks allocAligned(size_t num_blocks, size_t first_aligned, size_t stride, bool contiguous);
+
+    // AllocPolicy::MIN_FRAGMENTS, straight from the free extent index
+    MemoryBlocks allocMinFragments(size_t num_blocks);
+
+    // AllocPolicy::TLSF, straight from the segregated free lists
+    MemoryBlocks allocTlsf(size_t num_blocks);
+
+    // AllocPolicy::SEGMENT_TREE, first fit from the tree or else next-fit fragments
+    MemoryBlocks allocSegmentTree(size_t num_blocks);
+
+    // The search behind AllocBounded(), in blocks. Marks nothing unless it succeeds.
+    MemoryBlocks allocBounded(size_t num_blocks, size_t max_fragments);
+
+    // First available block at or after ii that is also first_aligned + k*stride, or _num_blocks if there is none
+    size_t findNextAlignedAvailable(size_t ii, size_t first_aligned, size_t stride) const;
+
+    // AllocNear()'s search under the policies other than NEXT_FIT: the lowest block at or after ii starting a run of
+    // num_blocks available blocks, or _num_blocks if there is none
+    size_t firstFitFrom(size_t ii, size_t num_blocks) const;
+
+    // Marks the (start block, block count) runs occupied, and turns them into extents
+    MemoryBlocks commitRuns(const std::vector<std::pair<size_t, size_t>>& runs);
+
+    // Realloc() without the allocation map bookkeeping
+    MemoryStatus resize(MemoryBlocks& blocks, size_t new_size, bool contiguous);
+
+    // Free() minus the allocation map check, for Realloc()'s own frees of parts of an allocation
+    MemoryStatus freeBlocks(const MemoryBlocks& blocks);
+
+    // Allocation map upkeep: adds blocks as one allocation, and drops the allocation blocks is, returning whether
+    // there was one. blocks has to match the entry extent for extent (lengths rounded to blocks), otherwise the
+    // entry stays. Both are no-ops with tracking off.
+    void trackAllocation(const MemoryBlocks& blocks);
+    bool untrackAllocation(const MemoryBlocks& blocks);
+
+    // Realloc()'s last resort: blocks' contents copied into one new extent of new_size, and the old extents freed
+    MemoryStatus relocate(MemoryBlocks& blocks, size_t new_size);
+
+    // Realloc() down to num_blocks
+    void shrinkTo(MemoryBlocks& blocks, size_t num_blocks);
+
+    // How far back the free run ending right before block ii reaches, looking at most limit blocks back
+    size_t freeRunStart(size_t ii, size_t limit) const;
+
+    // Everything an allocation needs after the bitset work: committing its pages on a reserved buffer (undoing
+    // the allocation if that fails), updating the page flags, and zero filling for AllocZeroed()
+    void finishAlloc(MemoryBlocks& result, bool zero_fill);
+
+    // Pages the caller is about to get are no longer zero or released. With zero_fill, the ones not known to be
+    // zero get memset first.
+    void touchPages(const MemoryBlocks& blocks, bool zero_fill);
+
+    // Releases the whole pages inside the free blocks [start, end) if that run is long enough, returns bytes released
+    size_t releaseRun(size_t start, size_t end);
+
+    // Called by Free() on blocks [start, end) it just freed, in the non-batched mode
+    void releaseAround(size_t start, size_t end);
+
+    // markOccupied() minus the free extent index upkeep, true if the bit actually changed
+    bool setBit(size_t ii, bool aa);
+
+    // markAll*() for aa = occupied / unoccupied, telling the index about every stretch of bits that flipped. Whole
+    // chars get set in one go, so this is O(count / 8) plus the index upkeep, which for the segment tree is
+    // O(count / 512 + log n).
+    void markRange(size_t start, size_t count, bool aa);
+
+    // Free extent index upkeep (either kind): blocks [start, end) just became used or free, all of them
+    void indexOccupy(size_t start, size_t end);
+    void indexRelease(size_t start, size_t end);
+    void addFreeExtent(size_t start, size_t length);
+    void removeFreeExtent(std::map<size_t, size_t>::iterator it);
+
+    // First available block at or after ii, or _num_blocks if there is none. Skips fully used chars 8 blocks at a time,
+    // and whole leaves of used blocks through the segment tree when there is one.
+    size_t findNextAvailable(size_t ii) const;
+
+    // findNextAvailable() without the tree, looking only at blocks before end (end if there is none)
+    size_t scanNextAvailable(size_t ii, size_t end) const;
+
+    // Blocks 64*ww to 64*ww + 63 as a word, 1 meaning used. Blocks past the end of the buffer read as used.
+    uint64_t usedWord(size_t ww) const;
+
+    // Available blocks in [lo, hi), a popcount per word
+    size_t countAvailable(size_t lo, size_t hi) const;
+
+    // Segment tree upkeep: leaves covering blocks [start, end) recomputed from the bitset, and their parents after
+    void updateSegmentTree(size_t start, size_t end);
+
+    // Lowest block starting a run of num_blocks available blocks, or _num_blocks if there is none
+    size_t segmentTreeFirstFit(size_t num_blocks) const;
+
+    // Same, but only runs starting at block ii or later count
+    size_t segmentTreeFirstFitFrom(size_t ii, size_t num_blocks) const;
+
+    // segmentTreeFirstFit() within the subtree at node, which covers length blocks from base & has a run that long
+    size_t segmentTreeFirstFitIn(size_t node, size_t base, size_t length, size_t num_blocks) const;
+
+    // How many blocks starting at ii are available, capped at limit. Skips fully unused chars 8 blocks at a time.
+    size_t availableRunLength(size_t ii, size_t limit) const;
+
     char* _buffer;
-    int _num_bytes;
+    size_t _num_bytes;
+    size_t _block_size;
+    size_t _num_blocks;
+
+    size_t _available_blocks;
+    size_t _next_block_location;
+
+    // for each bit here, 0 means unused, 1 means used. Zero pages until written, so a huge manager costs nothing up front.
+    ZeroedBytes _availability_bitset;
+
+    TraceRecorder* _trace_recorder;
+
+    // parallel scan is off below 2 threads, see setParallelScan()
+    size_t _scan_threads;
+    size_t _parallel_min_blocks;
+
+    // empty unless the manager owns its buffer
+    BackingStore _backing;
+
+    // One byte of flags per page of an owned buffer (empty otherwise). All zeros means the page reads as zeros &
+    // is resident (or at least not released by us), which is how a fresh mapping starts out.
+    static constexpr unsigned char kPageDirty = 1;
+    static constexpr unsigned char kPageReleased = 2;
+
+    ReleasePolicy _release_policy;
+    ZeroedBytes _page_flags;
+    size_t _released_pages_count;
+
+    // One live allocation in the map. Most allocations are a single extent, which then needs no extra heap memory.
+    struct AllocationEntry {
+        size_t first_bytes;
+        size_t total_bytes;
+        std::vector<std::pair<char*, size_t>> more_extents;
+    };
+
+    bool _track_allocations;
+    // keyed by the first block of the allocation
+    std::unordered_map<size_t, AllocationEntry> _allocations;
+
+    AllocPolicy _alloc_policy;
+    // MIN_FRAGMENTS only: every maximal free run, as start -> length & as (length, start) pairs, both in blocks
+    std::map<size_t, size_t> _free_by_start;
+    std::set<std::pair<size_t, size_t>> _free_by_length;
+
+    // TLSF only: the segregated free lists. All in blocks, and lists are linked through the extents' start blocks.
+    struct TlsfIndex {
+        static constexpr size_t kNone = SIZE_MAX;
+        // 16 second level lists per power of two, so an extent is at most 1/16th bigger than its class's minimum
+        static constexpr size_t kSlBits = 4;
+        static constexpr size_t kSlCount = size_t(1) << kSlBits;
+        static constexpr size_t kFlCount = 64 - kSlBits + 1;
+
+        struct Node {
+            size_t length;
+            size_t prev;
+            size_t next;
+        };
+
+        uint64_t fl_bitmap = 0;
+        uint32_t sl_bitmaps[kFlCount] = {};
+        size_t heads[kFlCount][kSlCount];
+
+        // start -> extent, and end (one past the last block) -> start for merging with the left neighbor
+        std::unordered_map<size_t, Node> nodes;
+        std::unordered_map<size_t, size_t> ends;
+
+        TlsfIndex() { std::fill(&heads[0][0], &heads[0][0] + kFlCount * kSlCount, kNone); }
+
+        // The (first level, second level) list for an extent of length blocks
+        static void mapping(size_t length, size_t& fl, size_t& sl);
+
+        // Start of a free extent of at least length blocks, or kNone
+        size_t findFit(size_t length) const;
+
+        void insert(size_t start, size_t length);
+        void remove(size_t start);
+        bool contains(size_t start) const { return nodes.count(start) != 0; }
+        size_t lengthOf(size_t start) const { return nodes.at(start).length; }
+        // Start of the free extent ending right before block end, or kNone
+        size_t startEndingAt(size_t end) const;
+    };
+    // 8 KB of list heads, so it only exists while the policy is TLSF
+    std::unique_ptr<TlsfIndex> _tlsf;
+
+    // SEGMENT_TREE only: nodes[1] is the root, node ii has children 2*ii & 2*ii + 1, and leaf ll is node
+    // num_leaves + ll. Leaves past the end of the buffer are all used (all zeros).
+    struct SegmentTree {
+        static constexpr size_t kLeafBlocks = 512;
+
+        // all in blocks, over the node's blocks
+        struct Node {
+            size_t free;
+            size_t prefix;
+            size_t suffix;
+            size_t longest;
+            size_t runs;
+        };
 
-    int _available_bytes;
-    int _next_byte_location;
+        // a power of two
+        size_t num_leaves;
+        std::vector<Node> nodes;
 
-    // for each bit here, 0 means unused, 1 means used
-    std::vector<unsigned char> _availability_bitset;
+        // Node covering left's blocks (left_length of them) followed by right's
+        static Node merge(const Node& left, size_t left_length, const Node& right, size_t right_length);
 
+        // Node for the 64 blocks in a usedWord()
+        static Node fromWord(uint64_t used);
+    };
+    std::unique_ptr<SegmentTree> _segment_tree;
 };
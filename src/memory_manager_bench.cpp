@@ -0,0 +1,363 @@
+#include <benchmark/benchmark.h>
+
+// Needed so the benchmarks can poke at isAvailable() & markOccupied() directly, same trick as the unit tests
+#define TESTING 1
+
+#include <sys/mman.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "backing_store.h"
+#include "memory_manager.h"
+#include "static_memory_manager.h"
+
+// Microbenchmarks for MemoryManager. These are meant to answer "did my allocator change help or hurt?", so
+// each benchmark isolates one variable (buffer size, occupancy, fragmentation, request size) and keeps the
+// rest fixed. Run with --benchmark_filter=<regex> to pick a subset, since the large buffer sizes take a while.
+
+namespace {
+
+// Buffers are left uninitialized on purpose. The kernel hands us zero pages lazily, so a huge buffer only
+// costs real memory for the pages MemoryManager actually hands out (the bitset is a different story).
+std::unique_ptr<char[]> makeBuffer(size_t num_bytes) {
+    return std::unique_ptr<char[]>(new char[num_bytes]);
+}
+
+// For the benchmarks where the buffer is bigger than the machine's memory might be. Alloc() and Free() never touch
+// the buffer itself, so reserved address space with nothing committed (MAP_NORESERVE) is all they need.
+class ReservedBuffer {
+  public:
+    explicit ReservedBuffer(size_t num_bytes)
+    : _num_bytes(num_bytes) {
+        void* reserved = mmap(nullptr, num_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        _data = (reserved == MAP_FAILED) ? nullptr : static_cast<char*>(reserved);
+    }
+    ~ReservedBuffer() {
+        if (_data) {
+            munmap(_data, _num_bytes);
+        }
+    }
+    ReservedBuffer(const ReservedBuffer&) = delete;
+    ReservedBuffer& operator=(const ReservedBuffer&) = delete;
+
+    char* data() const { return _data; }
+
+  private:
+    char* _data;
+    size_t _num_bytes;
+};
+
+// Skips the benchmark when even the reservation fails, check data() before using it
+std::unique_ptr<ReservedBuffer> reserveBuffer(benchmark::State& state, size_t num_bytes) {
+    auto buffer = std::make_unique<ReservedBuffer>(num_bytes);
+    if (!buffer->data()) {
+        state.SkipWithError("could not reserve the address space for the buffer");
+    }
+    return buffer;
+}
+
+// Occupy roughly `percent` of the manager in runs of `run_length` bytes, scattered with a fixed seed so
+// every run of the benchmark sees the same layout.
+void scatterOccupied(MemoryManager& manager, int percent, size_t run_length) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> dist(0, 99);
+    for (size_t ii = 0; ii + run_length <= manager.size(); ii += run_length) {
+        if (dist(rng) < percent) {
+            manager.markAllOccupied(ii, run_length);
+        }
+    }
+}
+
+// Alloc + Free of a fixed 64 byte request, as the managed buffer grows from 1 KB upwards.
+void BM_AllocFree_BufferSize(benchmark::State& state) {
+    size_t num_bytes = static_cast<size_t>(state.range(0));
+    auto buffer = reserveBuffer(state, num_bytes);
+    if (!buffer->data()) {
+        return;
+    }
+    MemoryManager manager(buffer->data(), num_bytes);
+
+    for (auto _ : state) {
+        MemoryBlocks blocks = manager.Alloc(64);
+        benchmark::DoNotOptimize(blocks);
+        manager.Free(blocks);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+// Stops at 256 MB, which already takes a 32 MB bitset. BM_AllocFree_HugeBuffer covers the bigger arenas.
+BENCHMARK(BM_AllocFree_BufferSize)->RangeMultiplier(16)->Range(1 << 10, 1 << 28);
+
+// Same as above with 4 KB blocks, which is how you'd actually run a manager over a 64 GB+ arena
+void BM_AllocFree_HugeBuffer(benchmark::State& state) {
+    size_t num_bytes = static_cast<size_t>(state.range(0));
+    auto buffer = reserveBuffer(state, num_bytes);
+    if (!buffer->data()) {
+        return;
+    }
+    MemoryManager manager(buffer->data(), num_bytes, 4096);
+
+    for (auto _ : state) {
+        MemoryBlocks blocks = manager.Alloc(64);
+        benchmark::DoNotOptimize(blocks);
+        manager.Free(blocks);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AllocFree_HugeBuffer)->Arg(int64_t(1) << 32)->Arg(int64_t(1) << 36);
+
+// Alloc + Free of 256 bytes on a 1 MB buffer that is already `percent` occupied. The next-fit cursor is reset
+// to 0 on every iteration, so this measures how much the scan suffers from walking over occupied space.
+void BM_AllocFree_Occupancy(benchmark::State& state) {
+    const size_t num_bytes = 1 << 20;
+    auto buffer = makeBuffer(num_bytes);
+    MemoryManager manager(buffer.get(), num_bytes);
+    scatterOccupied(manager, static_cast<int>(state.range(0)), 64);
+
+    for (auto _ : state) {
+        manager.setNextByteLocation(0);
+        MemoryBlocks blocks = manager.Alloc(256);
+        benchmark::DoNotOptimize(blocks);
+        manager.Free(blocks);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AllocFree_Occupancy)->DenseRange(0, 90, 15)->Arg(99);
+
+// The X-X-X pattern from main.cpp, scaled up: every `stride`-th byte is occupied, so every allocation is chopped
+// into fragments of (stride - 1) bytes. stride=2 is the exact alternating pattern of the original example.
+void BM_AllocFree_Fragmented(benchmark::State& state) {
+    const size_t num_bytes = 1 << 20;
+    const size_t stride = static_cast<size_t>(state.range(0));
+    auto buffer = makeBuffer(num_bytes);
+    MemoryManager manager(buffer.get(), num_bytes);
+    for (size_t ii = 0; ii < num_bytes; ii += stride) {
+        manager.markOccupied(ii, true);
+    }
+
+    for (auto _ : state) {
+        manager.setNextByteLocation(1);
+        MemoryBlocks blocks = manager.Alloc(1024);
+        benchmark::DoNotOptimize(blocks);
+        manager.Free(blocks);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * 1024);
+}
+BENCHMARK(BM_AllocFree_Fragmented)->Arg(2)->Arg(4)->Arg(16)->Arg(64)->Arg(1024);
+
+// Same 1 MB buffer, with one byte used every stride bytes plus a single clear 64 KB hole at the end, under each
+// Alloc policy (0 = NEXT_FIT, 1 = MIN_FRAGMENTS, 2 = TLSF, 3 = SEGMENT_TREE). "fragments" is how many extents one
+// 1 KB Alloc came back in.
+void BM_AllocFree_Policy(benchmark::State& state) {
+    const size_t num_bytes = 1 << 20;
+    const size_t hole = 1 << 16;
+    const size_t stride = static_cast<size_t>(state.range(0));
+    auto buffer = makeBuffer(num_bytes);
+    MemoryManager manager(buffer.get(), num_bytes);
+    for (size_t ii = 0; ii < num_bytes - hole; ii += stride) {
+        manager.markOccupied(ii, true);
+    }
+    const AllocPolicy policies[] = { AllocPolicy::NEXT_FIT, AllocPolicy::MIN_FRAGMENTS, AllocPolicy::TLSF,
+                                    AllocPolicy::SEGMENT_TREE };
+    manager.setAllocPolicy(policies[state.range(1)]);
+
+    size_t fragments = 0;
+    for (auto _ : state) {
+        manager.setNextByteLocation(1);
+        MemoryBlocks blocks = manager.Alloc(1024);
+        fragments = blocks.allocations.size();
+        benchmark::DoNotOptimize(blocks);
+        manager.Free(blocks);
+    }
+    state.counters["fragments"] = static_cast<double>(fragments);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AllocFree_Policy)->ArgsProduct({{4, 64, 1024}, {0, 1, 2, 3}});
+
+// Alloc + Free on an empty 64 MB buffer as the request grows from 1 byte to 1 MB.
+void BM_AllocFree_RequestSize(benchmark::State& state) {
+    const size_t num_bytes = 1 << 26;
+    const size_t request = static_cast<size_t>(state.range(0));
+    auto buffer = makeBuffer(num_bytes);
+    MemoryManager manager(buffer.get(), num_bytes);
+
+    for (auto _ : state) {
+        MemoryBlocks blocks = manager.Alloc(request);
+        benchmark::DoNotOptimize(blocks);
+        manager.Free(blocks);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * request);
+}
+BENCHMARK(BM_AllocFree_RequestSize)->RangeMultiplier(8)->Range(1, 1 << 20);
+
+// Alloc + Free of 256 bytes on a 4 KB scratch arena with 64 byte blocks, the runtime-sized manager (0) against
+// the compile-time sized one (1), where the bitset is one word inside the object.
+void BM_AllocFree_Static(benchmark::State& state) {
+    const size_t num_bytes = 4096;
+    const size_t block_size = 64;
+    if (state.range(0) == 0) {
+        auto buffer = makeBuffer(num_bytes);
+        MemoryManager manager(buffer.get(), num_bytes, block_size);
+        for (auto _ : state) {
+            MemoryBlocks blocks = manager.Alloc(256);
+            benchmark::DoNotOptimize(blocks);
+            manager.Free(blocks);
+        }
+    } else {
+        auto manager = std::make_unique<StaticMemoryManager<num_bytes, block_size>>();
+        for (auto _ : state) {
+            MemoryBlocks blocks = manager->Alloc(256);
+            benchmark::DoNotOptimize(blocks);
+            manager->Free(blocks);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AllocFree_Static)->Arg(0)->Arg(1);
+
+// One Alloc of 40% of a 1 GB buffer (2^28 blocks of 4 bytes, half occupied in scattered runs) as the number of
+// scan threads grows, see setParallelScan(). 1 is the single threaded walk. Only the Alloc is timed.
+void BM_Alloc_ParallelScan(benchmark::State& state) {
+    const size_t num_bytes = size_t(1) << 30;
+    auto buffer = reserveBuffer(state, num_bytes);
+    if (!buffer->data()) {
+        return;
+    }
+    MemoryManager manager(buffer->data(), num_bytes, 4);
+    scatterOccupied(manager, 50, 1024);
+    manager.setParallelScan(static_cast<size_t>(state.range(0)), 1);
+    const size_t request = manager.getFreeBytes() * 4 / 5;
+
+    for (auto _ : state) {
+        MemoryBlocks blocks = manager.Alloc(request);
+        benchmark::DoNotOptimize(blocks);
+        state.PauseTiming();
+        manager.Free(blocks);
+        manager.setNextByteLocation(0);
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * request);
+}
+BENCHMARK(BM_Alloc_ParallelScan)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond);
+
+// Alloc + Free of 4 KB on a 64 MB buffer that is half occupied in scattered 4 KB runs, as the block size grows.
+// Bigger blocks mean a smaller bitset & fewer scan steps, which is the whole point of the block size.
+void BM_AllocFree_BlockSize(benchmark::State& state) {
+    const size_t num_bytes = 1 << 26;
+    const size_t block_size = static_cast<size_t>(state.range(0));
+    auto buffer = makeBuffer(num_bytes);
+    MemoryManager manager(buffer.get(), num_bytes, block_size);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> dist(0, 1);
+    const size_t run_blocks = 4096 / block_size;
+    for (size_t ii = 0; ii + run_blocks <= manager.size(); ii += run_blocks) {
+        if (dist(rng)) {
+            manager.markAllOccupied(ii, run_blocks);
+        }
+    }
+
+    for (auto _ : state) {
+        manager.setNextByteLocation(0);
+        MemoryBlocks blocks = manager.Alloc(4096);
+        benchmark::DoNotOptimize(blocks);
+        manager.Free(blocks);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AllocFree_BlockSize)->RangeMultiplier(4)->Range(1, 4096);
+
+// Alloc + Free of 4 KB with a given alignment on a 1 MB buffer that is half occupied in scattered 64 byte runs.
+// range(1) picks contiguous mode. Alignment 1 is the plain Alloc() path, for comparison.
+void BM_AllocFree_Aligned(benchmark::State& state) {
+    const size_t num_bytes = 1 << 20;
+    const size_t alignment = static_cast<size_t>(state.range(0));
+    const bool contiguous = state.range(1) != 0;
+    auto buffer = makeBuffer(num_bytes);
+    MemoryManager manager(buffer.get(), num_bytes);
+    scatterOccupied(manager, 50, 64);
+
+    for (auto _ : state) {
+        manager.setNextByteLocation(0);
+        MemoryBlocks blocks = manager.Alloc(4096, alignment, contiguous);
+        benchmark::DoNotOptimize(blocks);
+        manager.Free(blocks);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AllocFree_Aligned)->ArgsProduct({{1, 16, 64, 4096}, {0, 1}});
+
+// Sets up a fresh 256 MB arena and writes to every 4 KB allocation once, which is the first-touch cost a new arena
+// pays. range(0) picks the backing: 0 = new[], 1 = mmap, 2 = mmap + MAP_POPULATE, 3 = 2 MB aligned + MADV_HUGEPAGE,
+// 4 = huge pages + populate. Setup (including pre-faulting) is timed too, since that's where populate moves the cost.
+void BM_FirstTouch(benchmark::State& state) {
+    const size_t num_bytes = 1 << 28;
+    const int64_t backing_kind = state.range(0);
+
+    for (auto _ : state) {
+        std::unique_ptr<char[]> heap;
+        std::unique_ptr<MemoryManager> manager;
+        if (backing_kind == 0) {
+            heap = makeBuffer(num_bytes);
+            manager = std::make_unique<MemoryManager>(heap.get(), num_bytes, 4096);
+        } else {
+            manager = MemoryManager::CreateMapped(num_bytes, 4096, backing_kind == 2 || backing_kind == 4, backing_kind >= 3);
+            if (!manager) {
+                state.SkipWithError("could not map the buffer");
+                return;
+            }
+        }
+
+        for (;;) {
+            MemoryBlocks blocks = manager->Alloc(4096);
+            if (blocks.status != MemoryStatus::SUCCESS) {
+                break;
+            }
+            blocks.allocations.front().first[0] = 1;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * num_bytes);
+}
+BENCHMARK(BM_FirstTouch)->DenseRange(0, 4)->Unit(benchmark::kMillisecond);
+
+// The two bit-twiddling primitives everything else is built from, on their own.
+void BM_IsAvailable(benchmark::State& state) {
+    const size_t num_bytes = 1 << 20;
+    auto buffer = makeBuffer(num_bytes);
+    MemoryManager manager(buffer.get(), num_bytes);
+    scatterOccupied(manager, 50, 8);
+
+    size_t ii = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.isAvailable(ii));
+        ii = (ii + 1 == num_bytes) ? 0 : ii + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IsAvailable);
+
+void BM_MarkOccupied(benchmark::State& state) {
+    const size_t num_bytes = 1 << 20;
+    auto buffer = makeBuffer(num_bytes);
+    MemoryManager manager(buffer.get(), num_bytes);
+
+    size_t ii = 0;
+    bool aa = true;
+    for (auto _ : state) {
+        manager.markOccupied(ii, aa);
+        ++ii;
+        if (ii == num_bytes) {
+            ii = 0;
+            aa = !aa;
+        }
+    }
+    benchmark::DoNotOptimize(manager.getAvailableBytes());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MarkOccupied);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,18 @@
+#include "memory_manager_resource.h"
+
+#include <algorithm>
+#include <new>
+
+void* MemoryManagerResource::do_allocate(size_t bytes, size_t alignment) {
+    // 0 bytes still needs a unique pointer, so it gets a block like malloc(0) would
+    MemoryBlocks result = _manager.Alloc(std::max<size_t>(bytes, 1), alignment, true);
+    if (result.status != MemoryStatus::SUCCESS) {
+        throw std::bad_alloc();
+    }
+    return result.allocations.front().first;
+}
+
+void MemoryManagerResource::do_deallocate(void* p, size_t bytes, size_t) {
+    // Free() rounds up to whole blocks the same way Alloc() did, so the size the container asked for is enough
+    _manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {{static_cast<char*>(p), std::max<size_t>(bytes, 1)}}));
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+
+#include "memory_manager.h"
+
+// std::pmr::memory_resource over a MemoryManager, so std::pmr containers (vector, string, unordered_map, ...) can
+// live in the arena without any changes to the code using them:
+//
+//   MemoryManagerResource resource(manager);
+//   std::pmr::vector<int> values(&resource);
+//
+// Every allocation is one contiguous, aligned extent (Alloc(size, alignment, true)), since containers need exactly
+// that. Running out of arena throws std::bad_alloc, which is what memory_resource promises & what containers
+// expect, unlike the status codes everywhere else.
+//
+// The manager is NOT owned, and needs to outlive the resource & everything allocated from it. Like MemoryManager,
+// this is NOT thread-safe, so containers sharing a resource can't be used from several threads at once.
+class MemoryManagerResource : public std::pmr::memory_resource {
+  public:
+    explicit MemoryManagerResource(MemoryManager& manager)
+    : _manager(manager) {}
+
+    MemoryManager& getManager() const { return _manager; }
+
+  protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+
+    // Two resources are interchangeable only if they're the same object, since each Free() has to go to the
+    // manager the memory came from
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+  private:
+    MemoryManager& _manager;
+};
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "memory_manager_resource.h"
+
+#define RESOURCE_BUFFER_SIZE 65536
+
+class MemoryManagerResourceTest : public testing::Test {
+ protected:
+  MemoryManagerResourceTest()
+  : _manager(_buffer, RESOURCE_BUFFER_SIZE, 16)
+  , _resource(_manager) {}
+
+  alignas(64) char _buffer[RESOURCE_BUFFER_SIZE];
+  MemoryManager _manager;
+  MemoryManagerResource _resource;
+};
+
+TEST_F(MemoryManagerResourceTest, containersLiveInTheArena) {
+  {
+    std::pmr::vector<int> values(&_resource);
+    for (int ii = 0; ii < 1000; ++ii) {
+        values.push_back(ii);
+    }
+    EXPECT_GE(reinterpret_cast<char*>(values.data()), _buffer);
+    EXPECT_LT(reinterpret_cast<char*>(values.data()), _buffer + RESOURCE_BUFFER_SIZE);
+
+    std::pmr::string text("long enough to not fit the small string buffer of any std::string", &_resource);
+    EXPECT_GE(text.data(), _buffer);
+    EXPECT_LT(text.data(), _buffer + RESOURCE_BUFFER_SIZE);
+
+    std::pmr::unordered_map<int, int> squares(&_resource);
+    for (int ii = 0; ii < 100; ++ii) {
+        squares[ii] = ii * ii;
+    }
+    EXPECT_EQ(squares[12], 144);
+    EXPECT_EQ(values[999], 999);
+    EXPECT_LT(_manager.getFreeBytes(), RESOURCE_BUFFER_SIZE);
+  }
+
+  // every container gave everything back on the way out
+  EXPECT_EQ(_manager.getFreeBytes(), RESOURCE_BUFFER_SIZE);
+}
+
+TEST_F(MemoryManagerResourceTest, respectsAlignment) {
+  for (size_t alignment : {1, 8, 16, 64, 256}) {
+    void* p = _resource.allocate(100, alignment);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignment, 0);
+    _resource.deallocate(p, 100, alignment);
+  }
+  EXPECT_EQ(_manager.getFreeBytes(), RESOURCE_BUFFER_SIZE);
+}
+
+TEST_F(MemoryManagerResourceTest, zeroBytesIsAUniquePointer) {
+  void* first = _resource.allocate(0);
+  void* second = _resource.allocate(0);
+  EXPECT_NE(first, second);
+  _resource.deallocate(first, 0);
+  _resource.deallocate(second, 0);
+  EXPECT_EQ(_manager.getFreeBytes(), RESOURCE_BUFFER_SIZE);
+}
+
+TEST_F(MemoryManagerResourceTest, exhaustionThrows) {
+  // fragment the arena so there's plenty free, but no contiguous run big enough
+  std::vector<void*> pieces;
+  std::vector<void*> kept;
+  for (int ii = 0; ii < RESOURCE_BUFFER_SIZE / 32; ++ii) {
+      pieces.push_back(_resource.allocate(16));
+      kept.push_back(_resource.allocate(16));
+  }
+  for (void* p : pieces) {
+      _resource.deallocate(p, 16);
+  }
+  EXPECT_EQ(_manager.getFreeBytes(), RESOURCE_BUFFER_SIZE / 2);
+  EXPECT_THROW(static_cast<void>(_resource.allocate(32)), std::bad_alloc);
+
+  std::pmr::vector<char> values(&_resource);
+  EXPECT_THROW(values.resize(1000), std::bad_alloc);
+}
+
+TEST_F(MemoryManagerResourceTest, equalOnlyToItself) {
+  MemoryManagerResource other(_manager);
+  EXPECT_TRUE(_resource.is_equal(_resource));
+  EXPECT_FALSE(_resource.is_equal(other));
+}
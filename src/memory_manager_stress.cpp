@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tclap/CmdLine.h"
+
+#include "concurrency_schemes.h"
+#include "memory_manager.h"
+#include "workload.h"
+
+// Multi-threaded stress harness. For every combination of scheme (see concurrency_schemes.h), workload and thread
+// count it hammers one shared allocator and reports throughput, latency percentiles, lock wait time and how often
+// memory got freed by a different thread than the one that allocated it. Results come out as JSON so they can be
+// diffed or plotted between runs.
+//
+// Workloads:
+//   - random: every thread randomly mixes Alloc & Free on its own live set. A configurable share of the frees are
+//     handed over to another thread through a shared exchange, to get some cross-thread frees in the mix.
+//   - producer-consumer: half the threads only Alloc and hand blocks over, the other half only Free. Every free is
+//     a cross-thread free, which is the worst case for per-thread locality.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+    size_t buffer_bytes;
+    size_t block_size;
+    std::string policy;  // command line name, see ParseAllocPolicy()
+    size_t min_size;
+    size_t max_size;
+    int ops_per_thread;
+    int max_live;
+    int cross_free_percent;
+    int regions;
+};
+
+struct OwnedBlocks {
+    MemoryBlocks blocks;
+    int owner;
+};
+
+// Blocks in flight between threads. Harness overhead, deliberately kept out of the allocator's lock statistics.
+class Exchange {
+  public:
+    void push(OwnedBlocks&& item) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _items.push_back(std::move(item));
+    }
+
+    bool pop(OwnedBlocks& item) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_items.empty()) {
+            return false;
+        }
+        item = std::move(_items.back());
+        _items.pop_back();
+        return true;
+    }
+
+    std::vector<OwnedBlocks> drain() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return std::move(_items);
+    }
+
+  private:
+    std::mutex _mutex;
+    std::vector<OwnedBlocks> _items;
+};
+
+struct ThreadResult {
+    std::vector<uint64_t> latencies;
+    uint64_t allocs = 0;
+    uint64_t frees = 0;
+    uint64_t failed_allocs = 0;
+    uint64_t cross_thread_frees = 0;
+    std::vector<OwnedBlocks> leftovers;
+};
+
+struct RunResult {
+    std::string scheme;
+    std::string workload;
+    int threads;
+    double seconds;
+    uint64_t ops;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failed_allocs;
+    uint64_t cross_thread_frees;
+    uint64_t lock_wait_nanos;
+    uint64_t lock_contentions;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+uint64_t elapsedNanos(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+void timedAlloc(ConcurrentAllocator& allocator, size_t size, int self, ThreadResult& result, std::vector<OwnedBlocks>& live) {
+    auto start = Clock::now();
+    MemoryBlocks blocks = allocator.Alloc(size);
+    result.latencies.push_back(elapsedNanos(start));
+    if (blocks.status == MemoryStatus::SUCCESS) {
+        ++result.allocs;
+        live.push_back({std::move(blocks), self});
+    } else {
+        ++result.failed_allocs;
+    }
+}
+
+void timedFree(ConcurrentAllocator& allocator, const OwnedBlocks& item, int self, ThreadResult& result) {
+    auto start = Clock::now();
+    allocator.Free(item.blocks);
+    result.latencies.push_back(elapsedNanos(start));
+    ++result.frees;
+    if (item.owner != self) {
+        ++result.cross_thread_frees;
+    }
+}
+
+void randomWorker(ConcurrentAllocator& allocator, const Config& config, Exchange& exchange, int self, ThreadResult& result) {
+    std::mt19937 rng(1234 + self);
+    std::uniform_int_distribution<size_t> size_dist(config.min_size, config.max_size);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::vector<OwnedBlocks> live;
+    result.latencies.reserve(config.ops_per_thread);
+
+    for (int op = 0; op < config.ops_per_thread; ++op) {
+        bool do_alloc = live.empty() || (static_cast<int>(live.size()) < config.max_live && percent(rng) < 50);
+        if (do_alloc) {
+            timedAlloc(allocator, size_dist(rng), self, result, live);
+            continue;
+        }
+
+        // prefer freeing something another thread handed over, so cross-thread frees actually happen
+        OwnedBlocks item;
+        if (exchange.pop(item)) {
+            timedFree(allocator, item, self, result);
+            continue;
+        }
+
+        std::uniform_int_distribution<size_t> pick(0, live.size() - 1);
+        size_t index = pick(rng);
+        std::swap(live[index], live.back());
+        item = std::move(live.back());
+        live.pop_back();
+        if (percent(rng) < config.cross_free_percent) {
+            exchange.push(std::move(item));
+        } else {
+            timedFree(allocator, item, self, result);
+        }
+    }
+    result.leftovers = std::move(live);
+}
+
+void producerWorker(ConcurrentAllocator& allocator, const Config& config, Exchange& exchange, int self, ThreadResult& result) {
+    std::mt19937 rng(1234 + self);
+    std::uniform_int_distribution<size_t> size_dist(config.min_size, config.max_size);
+    std::vector<OwnedBlocks> produced;
+    result.latencies.reserve(config.ops_per_thread);
+
+    for (int op = 0; op < config.ops_per_thread; ++op) {
+        timedAlloc(allocator, size_dist(rng), self, result, produced);
+        if (!produced.empty()) {
+            exchange.push(std::move(produced.back()));
+            produced.pop_back();
+        }
+    }
+}
+
+void consumerWorker(ConcurrentAllocator& allocator, const Config& config, Exchange& exchange,
+                    const std::atomic<int>& producers_left, int self, ThreadResult& result) {
+    result.latencies.reserve(config.ops_per_thread);
+    OwnedBlocks item;
+    while (true) {
+        if (exchange.pop(item)) {
+            timedFree(allocator, item, self, result);
+        } else if (producers_left.load(std::memory_order_acquire) == 0) {
+            // producers are done, but one might have pushed right before we checked, so drain once more
+            if (!exchange.pop(item)) {
+                return;
+            }
+            timedFree(allocator, item, self, result);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+std::unique_ptr<ConcurrentAllocator> makeAllocator(const std::string& scheme, char* buffer, const Config& config, int threads) {
+    AllocPolicy policy = AllocPolicy::NEXT_FIT;
+    ParseAllocPolicy(config.policy, policy);
+    if (scheme == "mutex") {
+        return std::make_unique<SingleMutexAllocator>(buffer, config.buffer_bytes, config.block_size, policy);
+    }
+    if (scheme == "regions") {
+        int regions = (config.regions > 0) ? config.regions : threads;
+        return std::make_unique<RegionAllocator>(buffer, config.buffer_bytes, regions, config.block_size, policy);
+    }
+    return std::make_unique<AsyncRingAllocator>(buffer, config.buffer_bytes, config.block_size, policy);
+}
+
+uint64_t percentile(std::vector<uint64_t>& samples, double pp) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(pp * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+RunResult runOnce(const std::string& scheme, const std::string& workload, int threads, const Config& config, char* buffer) {
+    auto allocator = makeAllocator(scheme, buffer, config, threads);
+    Exchange exchange;
+    std::vector<ThreadResult> results(threads);
+    std::vector<std::thread> workers;
+
+    // with a single thread, producer-consumer degenerates into a producer followed by a consumer on the same thread
+    int producers = (workload == "producer-consumer") ? std::max(1, threads / 2) : 0;
+    std::atomic<int> producers_left(producers);
+
+    auto start = Clock::now();
+    if (workload == "producer-consumer" && threads == 1) {
+        producerWorker(*allocator, config, exchange, 0, results[0]);
+        producers_left = 0;
+        consumerWorker(*allocator, config, exchange, producers_left, 0, results[0]);
+    } else {
+        for (int tt = 0; tt < threads; ++tt) {
+            workers.emplace_back([&, tt]() {
+                if (workload == "random") {
+                    randomWorker(*allocator, config, exchange, tt, results[tt]);
+                } else if (tt < producers) {
+                    producerWorker(*allocator, config, exchange, tt, results[tt]);
+                    producers_left.fetch_sub(1, std::memory_order_release);
+                } else {
+                    consumerWorker(*allocator, config, exchange, producers_left, tt, results[tt]);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    RunResult run{scheme, workload, threads, seconds, 0, 0, 0, 0, 0,
+                  allocator->getLockWaitNanos(), allocator->getLockContentions(), 0, 0, 0, 0};
+    std::vector<uint64_t> latencies;
+    for (auto& result : results) {
+        run.allocs += result.allocs;
+        run.frees += result.frees;
+        run.failed_allocs += result.failed_allocs;
+        run.cross_thread_frees += result.cross_thread_frees;
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        // give everything back so the next run starts from an empty buffer (not part of the measurement)
+        for (const auto& item : result.leftovers) {
+            allocator->Free(item.blocks);
+        }
+    }
+    for (const auto& item : exchange.drain()) {
+        allocator->Free(item.blocks);
+    }
+
+    run.ops = latencies.size();
+    run.p50 = percentile(latencies, 0.50);
+    run.p99 = percentile(latencies, 0.99);
+    run.p999 = percentile(latencies, 0.999);
+    run.max = latencies.empty() ? 0 : *std::max_element(latencies.begin(), latencies.end());
+    return run;
+}
+
+void writeJson(std::ostream& out, const Config& config, const std::vector<RunResult>& runs) {
+    out << "{\n";
+    out << "  \"config\": {\"buffer_bytes\": " << config.buffer_bytes
+        << ", \"block_size\": " << config.block_size
+        << ", \"policy\": \"" << config.policy << "\""
+        << ", \"min_size\": " << config.min_size
+        << ", \"max_size\": " << config.max_size
+        << ", \"ops_per_thread\": " << config.ops_per_thread
+        << ", \"max_live\": " << config.max_live
+        << ", \"cross_free_percent\": " << config.cross_free_percent << "},\n";
+    out << "  \"runs\": [\n";
+    for (size_t ii = 0; ii < runs.size(); ++ii) {
+        const RunResult& run = runs[ii];
+        double throughput = (run.seconds > 0) ? run.ops / run.seconds : 0;
+        double cross_rate = (run.frees > 0) ? static_cast<double>(run.cross_thread_frees) / run.frees : 0;
+        double wait_per_op = (run.ops > 0) ? static_cast<double>(run.lock_wait_nanos) / run.ops : 0;
+        out << "    {\"scheme\": \"" << run.scheme << "\""
+            << ", \"workload\": \"" << run.workload << "\""
+            << ", \"threads\": " << run.threads
+            << ", \"seconds\": " << run.seconds
+            << ", \"ops\": " << run.ops
+            << ", \"ops_per_second\": " << throughput
+            << ", \"allocs\": " << run.allocs
+            << ", \"failed_allocs\": " << run.failed_allocs
+            << ", \"frees\": " << run.frees
+            << ", \"cross_thread_frees\": " << run.cross_thread_frees
+            << ", \"cross_thread_free_rate\": " << cross_rate
+            << ", \"lock_wait_ns\": " << run.lock_wait_nanos
+            << ", \"lock_wait_ns_per_op\": " << wait_per_op
+            << ", \"lock_contentions\": " << run.lock_contentions
+            << ", \"latency_ns\": {\"p50\": " << run.p50
+            << ", \"p99\": " << run.p99
+            << ", \"p999\": " << run.p999
+            << ", \"max\": " << run.max << "}}"
+            << ((ii + 1 < runs.size()) ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}" << std::endl;
+}
+
+// 1, 2, 4, ... up to and including max_threads, so scaling curves have a sane number of points on a 64-core box
+std::vector<int> threadCounts(int max_threads) {
+    std::vector<int> counts;
+    for (int tt = 1; tt < max_threads; tt *= 2) {
+        counts.push_back(tt);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    std::vector<std::string> schemes;
+    std::vector<std::string> workloads;
+    int max_threads;
+    std::string output_path;
+
+    try {
+        TCLAP::CmdLine cmd("Multi-threaded contention & scaling harness for MemoryManager", ' ', "1.0");
+
+        std::vector<std::string> scheme_names = {"mutex", "regions", "async", "all"};
+        TCLAP::ValuesConstraint<std::string> scheme_constraint(scheme_names);
+        TCLAP::ValueArg<std::string> scheme_arg("s", "scheme", "Thread-safety scheme to test", false, "all", &scheme_constraint, cmd);
+
+        std::vector<std::string> workload_names = {"random", "producer-consumer", "all"};
+        TCLAP::ValuesConstraint<std::string> workload_constraint(workload_names);
+        TCLAP::ValueArg<std::string> workload_arg("w", "workload", "Workload to run", false, "all", &workload_constraint, cmd);
+
+        TCLAP::ValueArg<int> threads_arg("t", "threads", "Maximum number of threads, runs 1, 2, 4, ... up to this", false,
+                                         static_cast<int>(std::max(1u, std::thread::hardware_concurrency())), "int", cmd);
+        TCLAP::ValueArg<size_t> buffer_arg("b", "buffer-size", "Size of the shared buffer in bytes", false, 64 << 20, "bytes", cmd);
+        TCLAP::ValueArg<size_t> block_size_arg("", "block-size", "Allocation granularity of every manager in bytes", false, 1, "bytes", cmd);
+        std::vector<std::string> policy_names = {"next-fit", "min-fragments", "tlsf", "segment-tree"};
+        TCLAP::ValuesConstraint<std::string> policy_constraint(policy_names);
+        TCLAP::ValueArg<std::string> policy_arg("p", "policy", "Allocation policy of every manager", false, "next-fit",
+                                                &policy_constraint, cmd);
+        TCLAP::ValueArg<size_t> min_arg("", "min-size", "Smallest request size in bytes", false, 16, "bytes", cmd);
+        TCLAP::ValueArg<size_t> max_arg("", "max-size", "Largest request size in bytes", false, 4096, "bytes", cmd);
+        TCLAP::ValueArg<int> ops_arg("n", "ops", "Alloc/Free operations per thread", false, 100000, "int", cmd);
+        TCLAP::ValueArg<int> live_arg("", "max-live", "Most live allocations a random-workload thread holds at once", false, 256, "int", cmd);
+        TCLAP::ValueArg<int> cross_arg("", "cross-free", "Percent of random-workload frees handed to another thread", false, 10, "int", cmd);
+        TCLAP::ValueArg<int> regions_arg("", "regions", "Number of regions for the regions scheme (default: one per thread)", false, 0, "int", cmd);
+        TCLAP::ValueArg<std::string> output_arg("o", "output", "Write JSON here instead of stdout", false, "", "path", cmd);
+
+        cmd.parse(argc, argv);
+
+        config = {buffer_arg.getValue(), block_size_arg.getValue(), policy_arg.getValue(), min_arg.getValue(),
+                  max_arg.getValue(), ops_arg.getValue(), live_arg.getValue(), cross_arg.getValue(), regions_arg.getValue()};
+        max_threads = threads_arg.getValue();
+        output_path = output_arg.getValue();
+
+        if (scheme_arg.getValue() == "all") {
+            schemes = {"mutex", "regions", "async"};
+        } else {
+            schemes = {scheme_arg.getValue()};
+        }
+        if (workload_arg.getValue() == "all") {
+            workloads = {"random", "producer-consumer"};
+        } else {
+            workloads = {workload_arg.getValue()};
+        }
+    } catch (TCLAP::ArgException& e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        return 1;
+    }
+
+    if (config.buffer_bytes == 0 || config.block_size == 0 || config.min_size == 0 || config.max_size < config.min_size ||
+        max_threads < 1) {
+        std::cerr << "error: buffer size, block size, request sizes and thread count need to be positive, with min-size <= max-size"
+                  << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<char[]> buffer(new char[config.buffer_bytes]);
+    std::vector<RunResult> runs;
+    for (const auto& scheme : schemes) {
+        for (const auto& workload : workloads) {
+            for (int threads : threadCounts(max_threads)) {
+                std::cerr << "running " << scheme << " / " << workload << " / " << threads << " threads" << std::endl;
+                runs.push_back(runOnce(scheme, workload, threads, config, buffer.get()));
+            }
+        }
+    }
+
+    if (output_path.empty()) {
+        writeJson(std::cout, config, runs);
+    } else {
+        std::ofstream out(output_path);
+        if (!out) {
+            std::cerr << "error: could not open " << output_path << std::endl;
+            return 1;
+        }
+        writeJson(out, config, runs);
+    }
+
+    return 0;
+}
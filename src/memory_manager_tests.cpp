@@ -3,6 +3,10 @@
 #define TESTING 1
 #define BUFFER_SIZE 50
 
+#include <sys/mman.h>
+
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -28,7 +32,7 @@ class MemoryManagerTest : public testing::Test {
 
   std::vector<int> getOccupiedSpotsForCustomManager(MemoryManager& manager) {
     std::vector<int> result;
-    for (int ii = 0; ii < manager.size(); ++ii) {
+    for (size_t ii = 0; ii < manager.size(); ++ii) {
         if (!manager.isAvailable(ii)) {
             result.push_back(ii);
         }
@@ -340,3 +344,961 @@ TEST_F(MemoryManagerTest, allocAfterFreeSmallExample) {
     EXPECT_EQ(getBlockSum(block3), 2);
     EXPECT_EQ(manager.getAvailableBytes(), 0);
 }
+
+TEST_F(MemoryManagerTest, blockSizeShrinksBitset) {
+    // 50 bytes in blocks of 16 is 3 whole blocks, the last 2 bytes are never handed out
+    MemoryManager manager(_buffer, BUFFER_SIZE, 16);
+    EXPECT_EQ(manager.getBlockSize(), 16);
+    EXPECT_EQ(manager.size(), 3);
+    EXPECT_EQ(manager.getUsableBytes(), 48);
+    EXPECT_EQ(manager.getAvailableBytes(), 48);
+    EXPECT_EQ(manager.getAvailabilityBitset().size(), 1);
+}
+
+TEST_F(MemoryManagerTest, allocRoundsUpToBlocks) {
+    MemoryManager manager(_buffer, BUFFER_SIZE, 8);
+
+    MemoryBlocks block1 = manager.Alloc(10);
+    EXPECT_EQ(block1.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(block1.allocations.size(), 1);
+    EXPECT_EQ(block1.allocations.front().first, _buffer);
+    EXPECT_EQ(getBlockSum(block1), 16);
+
+    MemoryBlocks block2 = manager.Alloc(1);
+    EXPECT_EQ(block2.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(block2.allocations.front().first, _buffer + 16);
+    EXPECT_EQ(getBlockSum(block2), 8);
+
+    std::vector<int> expectedOccupieds = { 0, 1, 2 };
+    EXPECT_EQ(getOccupiedSpotsForCustomManager(manager), expectedOccupieds);
+    EXPECT_EQ(manager.getAvailableBytes(), 24);
+
+    // only 3 blocks (24 bytes) left, so 25 bytes can't fit even though 26 raw bytes are unused
+    MemoryBlocks block3 = manager.Alloc(25);
+    EXPECT_EQ(block3.status, MemoryStatus::INSUFFICIENT_MEMORY);
+}
+
+TEST_F(MemoryManagerTest, freeWithBlocks) {
+    MemoryManager manager(_buffer, BUFFER_SIZE, 8);
+    MemoryBlocks block = manager.Alloc(30);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.getAvailableBytes(), 16);
+
+    // not on a block boundary
+    MemoryBlocks unaligned = MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+4, 8 } });
+    EXPECT_EQ(manager.Free(unaligned), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(manager.getAvailableBytes(), 16);
+
+    // past the last whole block, into the 2 tail bytes
+    MemoryBlocks tail = MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+40, 10 } });
+    EXPECT_EQ(manager.Free(tail), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+
+    // the requested size (rather than the rounded up one) frees the same blocks
+    MemoryBlocks requested = MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+8, 9 } });
+    EXPECT_EQ(manager.Free(requested), MemoryStatus::SUCCESS);
+    std::vector<int> expectedOccupieds = { 0, 3 };
+    EXPECT_EQ(getOccupiedSpotsForCustomManager(manager), expectedOccupieds);
+    EXPECT_EQ(manager.getAvailableBytes(), 32);
+}
+
+TEST_F(MemoryManagerTest, scansSkipWholeChars) {
+    // big enough that the scans go through the char-at-a-time fast paths, and deliberately not a multiple of 8
+    const int num_bytes = 203;
+    char buffer[num_bytes];
+    MemoryManager manager(buffer, num_bytes);
+
+    // fully used chars up to 100, then a hole of 3 that Alloc has to jump over the used chars to find
+    manager.markAllOccupied(0, 100);
+    manager.markAllOccupied(103, 40);
+    MemoryBlocks block = manager.Alloc(63);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { buffer+100, 3 }, { buffer+143, 60 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+
+    // that was everything, the padding bits past the end of the last char don't count as free
+    FreeSpaceStats stats = manager.GetFreeSpaceStats();
+    EXPECT_EQ(stats.free_bytes, 0);
+    EXPECT_EQ(manager.Alloc(1).status, MemoryStatus::OUT_OF_MEMORY);
+}
+
+TEST_F(MemoryManagerTest, freeRejectsOverflowingLengths) {
+    MemoryBlocks block = _manager->Alloc(10);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+
+    // ll + length would wrap around to something small & valid looking
+    MemoryBlocks huge = MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+2, SIZE_MAX - 1 } });
+    EXPECT_EQ(_manager->Free(huge), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(_manager->getAvailableBytes(), 40);
+}
+
+TEST_F(MemoryManagerTest, managesMoreThanFourGigabytes) {
+    // Reserve 8 GB of address space without backing it, the manager never touches the buffer itself
+    const size_t num_bytes = size_t(8) << 30;
+    void* reserved = mmap(nullptr, num_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        GTEST_SKIP() << "could not reserve 8 GB of address space";
+    }
+    char* buffer = static_cast<char*>(reserved);
+
+    {
+        // 1 MB blocks keep the bitset at 1 KB
+        const size_t block_size = 1 << 20;
+        MemoryManager manager(buffer, num_bytes, block_size);
+        EXPECT_EQ(manager.getUsableBytes(), num_bytes);
+
+        // a single request that doesn't fit in 32 bits, followed by one that lands past the 4 GB mark
+        const size_t big = (size_t(5) << 30) + 1;
+        MemoryBlocks first = manager.Alloc(big);
+        EXPECT_EQ(first.status, MemoryStatus::SUCCESS);
+        ASSERT_EQ(first.allocations.size(), 1);
+        EXPECT_EQ(first.allocations[0].first, buffer);
+        EXPECT_EQ(first.allocations[0].second, (size_t(5) << 30) + block_size);
+
+        MemoryBlocks second = manager.Alloc(block_size);
+        ASSERT_EQ(second.status, MemoryStatus::SUCCESS);
+        EXPECT_EQ(second.allocations[0].first, buffer + (size_t(5) << 30) + block_size);
+
+        EXPECT_EQ(manager.getAvailableBytes(), num_bytes - (size_t(5) << 30) - 2 * block_size);
+        EXPECT_EQ(manager.Free(first), MemoryStatus::SUCCESS);
+        FreeSpaceStats stats = manager.GetFreeSpaceStats();
+        EXPECT_EQ(stats.free_bytes, num_bytes - block_size);
+        EXPECT_EQ(stats.largest_free_run, (size_t(5) << 30) + block_size);
+    }
+
+    munmap(reserved, num_bytes);
+}
+
+TEST_F(MemoryManagerTest, allocAlignedFragments) {
+    alignas(64) char buffer[256];
+    MemoryManager manager(buffer, 256);
+
+    // leave free gaps at 0..5, 10..41 & 70..256. With alignment 16, the one at 10 can only be used from 16 onwards
+    manager.markAllOccupied(5, 5);
+    manager.markAllOccupied(41, 29);
+
+    MemoryBlocks block = manager.Alloc(40, 16);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { buffer, 5 }, { buffer+16, 25 }, { buffer+80, 10 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+    for (const auto& tuple : block.allocations) {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(tuple.first) % 16, 0);
+    }
+    EXPECT_EQ(getBlockSum(block), 40);
+
+    // bytes 10..16 were skipped over, not handed out
+    EXPECT_TRUE(manager.isAvailable(10));
+    EXPECT_TRUE(manager.isAvailable(15));
+    EXPECT_EQ(manager.getAvailableBytes(), 256 - 34 - 40);
+}
+
+TEST_F(MemoryManagerTest, allocAlignedContiguous) {
+    alignas(64) char buffer[256];
+    MemoryManager manager(buffer, 256);
+
+    // 60 free bytes at 4..64 aren't enough for 64 aligned bytes, the first place that works is 128
+    manager.markAllOccupied(0, 4);
+    manager.markAllOccupied(64, 8);
+    manager.markAllOccupied(140, 1);
+
+    MemoryBlocks block = manager.Alloc(64, 64, true);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { buffer+192, 64 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+
+    // the cursor is now at the end, so the next one has to wrap around to find 32..64
+    MemoryBlocks wrapped = manager.Alloc(32, 32, true);
+    EXPECT_EQ(wrapped.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedWrapped = { { buffer+32, 32 }, };
+    EXPECT_EQ(wrapped.allocations, expectedWrapped);
+}
+
+TEST_F(MemoryManagerTest, allocAlignedFailsCleanly) {
+    alignas(64) char buffer[128];
+    MemoryManager manager(buffer, 128);
+    manager.markAllOccupied(0, 1);
+    manager.markAllOccupied(64, 1);
+
+    // 126 bytes are free, but only 2 runs of 63 & neither starts on a 64 byte boundary
+    MemoryBlocks block = manager.Alloc(10, 64);
+    EXPECT_EQ(block.status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(manager.getAvailableBytes(), 126);
+
+    // 32 aligned bytes from 32 & 96 aren't one run
+    block = manager.Alloc(64, 32, true);
+    EXPECT_EQ(block.status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(manager.getAvailableBytes(), 126);
+    std::vector<int> expectedOccupieds = { 0, 64 };
+    EXPECT_EQ(getOccupiedSpotsForCustomManager(manager), expectedOccupieds);
+
+    EXPECT_EQ(manager.Alloc(10, 0).status, MemoryStatus::INVALID_ALIGNMENT);
+    EXPECT_EQ(manager.Alloc(10, 48).status, MemoryStatus::INVALID_ALIGNMENT);
+}
+
+TEST_F(MemoryManagerTest, allocAlignedWithBlocks) {
+    alignas(64) char buffer[200];
+
+    // 24 byte blocks from buffer+8 sit at 8, 32, 56, 80, ..., so every other block starts on 16 bytes, from block 1
+    MemoryManager manager(buffer+8, 192, 24);
+    MemoryBlocks block = manager.Alloc(30, 16, true);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { buffer+32, 48 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+
+    // 16 byte blocks from buffer+8 can never start on 16 bytes
+    MemoryManager misaligned(buffer+8, 192, 16);
+    EXPECT_EQ(misaligned.Alloc(16, 16).status, MemoryStatus::INVALID_ALIGNMENT);
+
+    // ... but alignment 8 is the same as no alignment at all
+    block = misaligned.Alloc(16, 8);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(block.allocations.front().first, buffer+8);
+}
+
+TEST_F(MemoryManagerTest, reallocGrowsInPlace) {
+    MemoryBlocks block = _manager->Alloc(10);
+    memset(block.allocations.front().first, 'x', 10);
+
+    EXPECT_EQ(_manager->Realloc(block, 25), MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer, 25 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+    EXPECT_EQ(block.allocations.front().first[9], 'x');
+    EXPECT_EQ(getOccupiedSpots().size(), 25);
+}
+
+TEST_F(MemoryManagerTest, reallocAppendsFragments) {
+    MemoryBlocks first = _manager->Alloc(10);
+    MemoryBlocks blocker = _manager->Alloc(5);
+
+    // 3 more fit nowhere next to first, so they come from after blocker
+    EXPECT_EQ(_manager->Realloc(first, 13), MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer, 10 }, { _buffer+15, 3 }, };
+    EXPECT_EQ(first.allocations, expectedAllocations);
+
+    // and now the last extent grows in place again
+    EXPECT_EQ(_manager->Realloc(first, 20), MemoryStatus::SUCCESS);
+    expectedAllocations = { { _buffer, 10 }, { _buffer+15, 10 }, };
+    EXPECT_EQ(first.allocations, expectedAllocations);
+
+    // too much leaves everything as it was
+    EXPECT_EQ(_manager->Realloc(first, 100), MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(first.allocations, expectedAllocations);
+    EXPECT_EQ(getOccupiedSpots().size(), 25);
+}
+
+TEST_F(MemoryManagerTest, reallocContiguousCopiesAsLastResort) {
+    MemoryBlocks first = _manager->Alloc(10);
+    MemoryBlocks blocker = _manager->Alloc(5);
+    memset(first.allocations.front().first, 'x', 10);
+
+    // in place would need the blocker's spot, so it moves to 15 and the old extent is freed
+    EXPECT_EQ(_manager->Realloc(first, 20, true), MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer+15, 20 }, };
+    EXPECT_EQ(first.allocations, expectedAllocations);
+    EXPECT_EQ(_buffer[24], 'x');
+    EXPECT_TRUE(_manager->isAvailable(0));
+    EXPECT_FALSE(_manager->isAvailable(10));
+
+    // when there's room right after, no copy
+    EXPECT_EQ(_manager->Realloc(first, 30, true), MemoryStatus::SUCCESS);
+    expectedAllocations = { { _buffer+15, 30 }, };
+    EXPECT_EQ(first.allocations, expectedAllocations);
+
+    // 10 free at the start & 5 at the end, but not 40 in a row
+    EXPECT_EQ(_manager->Realloc(first, 40, true), MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(first.allocations, expectedAllocations);
+}
+
+TEST_F(MemoryManagerTest, reallocContiguousConsolidatesSplitBlocks) {
+    MemoryBlocks first = _manager->Alloc(10);
+    MemoryBlocks blocker = _manager->Alloc(5);
+    EXPECT_EQ(_manager->Realloc(first, 20), MemoryStatus::SUCCESS);
+    ASSERT_EQ(first.allocations.size(), 2);
+    memset(first.allocations[0].first, 'a', 10);
+    memset(first.allocations[1].first, 'b', 10);
+
+    // shrinking would fit in the extents it has, but contiguous asks for one extent, so it still moves
+    EXPECT_EQ(_manager->Realloc(first, 12, true), MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer+25, 12 }, };
+    EXPECT_EQ(first.allocations, expectedAllocations);
+    EXPECT_EQ(_buffer[34], 'a');
+    EXPECT_EQ(_buffer[36], 'b');
+    std::vector<int> expectedSpots = { 10, 11, 12, 13, 14, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36 };
+    EXPECT_EQ(getOccupiedSpots(), expectedSpots);
+}
+
+TEST_F(MemoryManagerTest, reallocShrinks) {
+    MemoryBlocks first = _manager->Alloc(10);
+    MemoryBlocks blocker = _manager->Alloc(5);
+    EXPECT_EQ(_manager->Realloc(first, 20), MemoryStatus::SUCCESS);
+
+    // the cut lands in the first extent, so its tail & the whole second extent go
+    EXPECT_EQ(_manager->Realloc(first, 4), MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer, 4 }, };
+    EXPECT_EQ(first.allocations, expectedAllocations);
+    std::vector<int> expectedSpots = { 0, 1, 2, 3, 10, 11, 12, 13, 14 };
+    EXPECT_EQ(getOccupiedSpots(), expectedSpots);
+
+    EXPECT_EQ(_manager->Realloc(first, 0), MemoryStatus::SUCCESS);
+    EXPECT_TRUE(first.allocations.empty());
+    EXPECT_EQ(getOccupiedSpots().size(), 5);
+}
+
+TEST_F(MemoryManagerTest, reallocWithBlocks) {
+    MemoryManager manager(_buffer, BUFFER_SIZE, 8);
+    MemoryBlocks block = manager.Alloc(3);
+    EXPECT_EQ(manager.Realloc(block, 17), MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer, 24 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+
+    EXPECT_EQ(manager.Realloc(block, 9), MemoryStatus::SUCCESS);
+    expectedAllocations = { { _buffer, 16 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+    EXPECT_EQ(getOccupiedSpotsForCustomManager(manager).size(), 2);
+
+    MemoryBlocks outside(MemoryStatus::SUCCESS, { { _buffer+3, 8 } });
+    EXPECT_EQ(manager.Realloc(outside, 20), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+}
+
+TEST_F(MemoryManagerTest, freeByPointer) {
+    EXPECT_TRUE(_manager->setAllocationTracking(true));
+
+    MemoryBlocks first = _manager->Alloc(10);
+    MemoryBlocks second = _manager->Alloc(10);
+    MemoryBlocks third = _manager->Alloc(10);
+    EXPECT_EQ(_manager->Free(second), MemoryStatus::SUCCESS);
+
+    // 20 bytes split over the hole & the space after third
+    _manager->setNextByteLocation(10);
+    MemoryBlocks split = _manager->Alloc(20);
+    ASSERT_EQ(split.allocations.size(), 2);
+    EXPECT_EQ(_manager->SizeOf(_buffer+10), 20);
+    EXPECT_EQ(_manager->SizeOf(_buffer), 10);
+
+    // only the starts of allocations count, and only while they're allocated
+    EXPECT_EQ(_manager->SizeOf(_buffer+11), 0);
+    EXPECT_EQ(_manager->SizeOf(_buffer+30), 0);
+    EXPECT_EQ(_manager->Free(_buffer+11), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+
+    // freeing by pointer gives back every extent
+    EXPECT_EQ(_manager->Free(_buffer+10), MemoryStatus::SUCCESS);
+    std::vector<int> expectedSpots;
+    for (int ii = 0; ii < 10; ++ii) {
+        expectedSpots.push_back(ii);
+    }
+    for (int ii = 20; ii < 30; ++ii) {
+        expectedSpots.push_back(ii);
+    }
+    EXPECT_EQ(getOccupiedSpots(), expectedSpots);
+    EXPECT_EQ(_manager->Free(_buffer+10), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(_manager->Free(nullptr), MemoryStatus::SUCCESS);
+
+    // Free() on the original MemoryBlocks keeps the map in sync too
+    EXPECT_EQ(_manager->Free(first), MemoryStatus::SUCCESS);
+    EXPECT_EQ(_manager->SizeOf(_buffer), 0);
+    EXPECT_EQ(_manager->Free(_buffer), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+}
+
+TEST_F(MemoryManagerTest, trackingRejectsPartialFrees) {
+    EXPECT_TRUE(_manager->setAllocationTracking(true));
+    MemoryBlocks first = _manager->Alloc(10);
+    MemoryBlocks second = _manager->Alloc(10);
+    MemoryBlocks blocker = _manager->Alloc(10);
+    EXPECT_EQ(_manager->Free(second), MemoryStatus::SUCCESS);
+    _manager->setNextByteLocation(10);
+    MemoryBlocks third = _manager->Alloc(20);
+    ASSERT_EQ(third.allocations.size(), 2);
+
+    // the front of an allocation, its tail, and one of its extents on their own are all parts, so nothing happens
+    EXPECT_EQ(_manager->Free(MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer, 4 } })), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(_manager->Free(MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+5, 5 } })), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(_manager->Free(MemoryBlocks(MemoryStatus::SUCCESS, { third.allocations.front() })), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    MemoryBlocks tail(MemoryStatus::SUCCESS, { third.allocations.back() });
+    EXPECT_EQ(_manager->Realloc(tail, 1), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(_manager->getFreeBytes(), BUFFER_SIZE - 40);
+    EXPECT_EQ(_manager->SizeOf(_buffer), 10);
+    EXPECT_EQ(_manager->SizeOf(_buffer+10), 20);
+
+    // giving back part of one goes through Realloc, which keeps the entry right
+    EXPECT_EQ(_manager->Realloc(third, 5), MemoryStatus::SUCCESS);
+    EXPECT_EQ(_manager->SizeOf(_buffer+10), 5);
+    EXPECT_EQ(_manager->Free(_buffer+10), MemoryStatus::SUCCESS);
+    EXPECT_EQ(_manager->Free(first), MemoryStatus::SUCCESS);
+    EXPECT_EQ(_manager->Free(blocker), MemoryStatus::SUCCESS);
+    EXPECT_EQ(_manager->getFreeBytes(), BUFFER_SIZE);
+}
+
+TEST_F(MemoryManagerTest, ownsIsOneBitsetLookup) {
+    MemoryBlocks first = _manager->Alloc(10);
+    EXPECT_TRUE(_manager->Owns(_buffer));
+    EXPECT_TRUE(_manager->Owns(_buffer+9));
+    EXPECT_FALSE(_manager->Owns(_buffer+10));
+    EXPECT_FALSE(_manager->Owns(_buffer+BUFFER_SIZE));
+    EXPECT_FALSE(_manager->Owns(nullptr));
+
+    // there's no map without tracking, so no sizes & no Free(ptr) either
+    EXPECT_EQ(_manager->SizeOf(_buffer), 0);
+    EXPECT_EQ(_manager->Free(_buffer), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+
+    // and tracking can't start with allocations it doesn't know about
+    EXPECT_FALSE(_manager->setAllocationTracking(true));
+    EXPECT_EQ(_manager->Free(first), MemoryStatus::SUCCESS);
+    EXPECT_TRUE(_manager->setAllocationTracking(true));
+    EXPECT_TRUE(_manager->isTrackingAllocations());
+}
+
+TEST_F(MemoryManagerTest, reallocKeepsAllocationMap) {
+    MemoryManager manager(_buffer, BUFFER_SIZE, 5);
+    EXPECT_TRUE(manager.setAllocationTracking(true));
+    MemoryBlocks first = manager.Alloc(10);
+    MemoryBlocks blocker = manager.Alloc(5);
+
+    EXPECT_EQ(manager.Realloc(first, 17), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.SizeOf(_buffer), 20);
+
+    // moving it re-keys the entry
+    EXPECT_EQ(manager.Realloc(first, 20, true), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.SizeOf(_buffer), 0);
+    EXPECT_EQ(manager.SizeOf(first.allocations.front().first), 20);
+
+    // a failed Realloc leaves the entry alone
+    EXPECT_EQ(manager.Realloc(first, 100), MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(manager.SizeOf(first.allocations.front().first), 20);
+
+    EXPECT_EQ(manager.Realloc(first, 3), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.SizeOf(first.allocations.front().first), 5);
+    EXPECT_EQ(manager.Free(first.allocations.front().first), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.Free(_buffer+10), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.getFreeBytes(), BUFFER_SIZE);
+}
+
+TEST_F(MemoryManagerTest, compactBlocksRoundTrip) {
+    MemoryManager manager(_buffer, BUFFER_SIZE, 4);
+    EXPECT_TRUE(manager.canUseCompactBlocks());
+    MemoryBlocks first = manager.Alloc(8);
+    MemoryBlocks second = manager.Alloc(8);
+    manager.Free(first);
+    manager.setNextByteLocation(0);
+    MemoryBlocks split = manager.Alloc(15);
+    ASSERT_EQ(split.allocations.size(), 2);
+
+    CompactBlocks compact = manager.ToCompact(split);
+    EXPECT_EQ(compact.status, MemoryStatus::SUCCESS);
+    std::vector<uint32_t> expectedOffsets = { 0, 4 };
+    std::vector<uint32_t> expectedLengths = { 2, 2 };
+    EXPECT_EQ(compact.offsets, expectedOffsets);
+    EXPECT_EQ(compact.lengths, expectedLengths);
+    EXPECT_EQ(manager.FromCompact(compact).allocations, split.allocations);
+
+    EXPECT_EQ(manager.Free(compact), MemoryStatus::SUCCESS);
+    std::vector<int> expectedSpots = { 2, 3 };
+    EXPECT_EQ(getOccupiedSpotsForCustomManager(manager), expectedSpots);
+    static_assert(sizeof(uint32_t) * 2 < sizeof(std::pair<char*, size_t>), "compact extents should be smaller");
+}
+
+TEST_F(MemoryManagerTest, compactBlocksRejectBadExtents) {
+    MemoryManager manager(_buffer, BUFFER_SIZE, 4);
+
+    EXPECT_EQ(manager.ToCompact(MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+2, 4 } })).status, MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(manager.ToCompact(MemoryBlocks(MemoryStatus::SUCCESS, { { _buffer+48, 4 } })).status, MemoryStatus::INVALID_MEMORY_LOCATIONS);
+
+    CompactBlocks compact(MemoryStatus::SUCCESS);
+    compact.offsets = { 10 };
+    compact.lengths = { 3 };
+    EXPECT_EQ(manager.FromCompact(compact).status, MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(manager.Free(compact), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+
+    compact.lengths.push_back(1);
+    EXPECT_EQ(manager.FromCompact(compact).status, MemoryStatus::INVALID_MEMORY_LOCATIONS);
+}
+
+TEST_F(MemoryManagerTest, allocBoundedTakesNextFitWhenItFits) {
+    MemoryBlocks first = _manager->Alloc(10);
+    MemoryBlocks second = _manager->Alloc(10);
+    _manager->Free(first);
+
+    // the regular next-fit answer is 2 extents, which is within budget
+    _manager->setNextByteLocation(45);
+    MemoryBlocks block = _manager->AllocBounded(10, 2);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer+45, 5 }, { _buffer, 5 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+}
+
+TEST_F(MemoryManagerTest, allocBoundedPrefersLargestRuns) {
+    // X-X-X-...-X for the first 19 bytes, so free runs of 1 at 1, 3, ..., 17, then 2 free at 19, 10 used, and 19 free at 31
+    for (int ii = 0; ii < 19; ii += 2) {
+        _manager->markOccupied(ii, true);
+    }
+    _manager->markAllOccupied(21, 10);
+    _manager->setNextByteLocation(0);
+
+    // next-fit would start with the 1 byte slivers, so it's the 2 biggest runs instead
+    MemoryBlocks block = _manager->AllocBounded(21, 2);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer+19, 2 }, { _buffer+31, 19 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+
+    // plain Alloc() for comparison
+    EXPECT_EQ(_manager->Free(block), MemoryStatus::SUCCESS);
+    _manager->setNextByteLocation(0);
+    EXPECT_EQ(_manager->Alloc(21).allocations.size(), 11);
+}
+
+TEST_F(MemoryManagerTest, allocBoundedFailsCleanly) {
+    for (int ii = 0; ii < BUFFER_SIZE; ii += 2) {
+        _manager->markOccupied(ii, true);
+    }
+    auto before = _manager->getAvailabilityBitset();
+
+    // 25 free bytes, but only in 1 byte runs
+    EXPECT_EQ(_manager->AllocBounded(5, 4).status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(_manager->AllocBounded(1, 0).status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(_manager->getAvailabilityBitset(), before);
+
+    MemoryBlocks block = _manager->AllocBounded(4, 4);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(block.allocations.size(), 4);
+}
+
+TEST_F(MemoryManagerTest, minFragmentsBestFitsSingleExtent) {
+    // free runs of 3 at 0, 8 at 10, 5 at 20, and 25 at 25... minus 1 used at 25, so 24 at 26
+    _manager->markAllOccupied(3, 7);
+    _manager->markAllOccupied(18, 2);
+    _manager->markOccupied(25, true);
+    _manager->setAllocPolicy(AllocPolicy::MIN_FRAGMENTS);
+    std::vector<std::pair<size_t, size_t>> expectedExtents = { { 0, 3 }, { 10, 8 }, { 20, 5 }, { 26, 24 } };
+    EXPECT_EQ(_manager->getFreeExtents(), expectedExtents);
+
+    // smallest extent that fits, not the first one & not the biggest one
+    MemoryBlocks block = _manager->Alloc(4);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer+20, 4 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+
+    FreeSpaceStats stats = _manager->GetFreeSpaceStats();
+    EXPECT_EQ(stats.free_bytes, 36);
+    EXPECT_EQ(stats.free_runs, 4);
+    EXPECT_EQ(stats.largest_free_run, 24);
+}
+
+TEST_F(MemoryManagerTest, minFragmentsLargestFirst) {
+    // same layout as above
+    _manager->markAllOccupied(3, 7);
+    _manager->markAllOccupied(18, 2);
+    _manager->markOccupied(25, true);
+    _manager->setAllocPolicy(AllocPolicy::MIN_FRAGMENTS);
+
+    // 24 + 8 = 32, and the last 2 come from the 3 rather than the 5
+    MemoryBlocks block = _manager->Alloc(34);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer, 2 }, { _buffer+10, 8 }, { _buffer+26, 24 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+
+    // next-fit from 0 would have taken all 4 extents
+    std::vector<std::pair<size_t, size_t>> expectedExtents = { { 2, 1 }, { 20, 5 } };
+    EXPECT_EQ(_manager->getFreeExtents(), expectedExtents);
+
+    // freeing merges back into maximal extents
+    EXPECT_EQ(_manager->Free(block), MemoryStatus::SUCCESS);
+    expectedExtents = { { 0, 3 }, { 10, 8 }, { 20, 5 }, { 26, 24 } };
+    EXPECT_EQ(_manager->getFreeExtents(), expectedExtents);
+    EXPECT_EQ(_manager->Alloc(100).status, MemoryStatus::INSUFFICIENT_MEMORY);
+}
+
+TEST_F(MemoryManagerTest, freeExtentIndexMatchesBitset) {
+    for (AllocPolicy policy : { AllocPolicy::MIN_FRAGMENTS, AllocPolicy::TLSF }) {
+        MemoryManager manager(_buffer, BUFFER_SIZE, 1);
+        manager.setAllocPolicy(policy);
+
+        auto scanExtents = [&]() {
+            std::vector<std::pair<size_t, size_t>> extents;
+            for (size_t ii = 0; ii < manager.size(); ++ii) {
+                if (manager.isAvailable(ii)) {
+                    if (!extents.empty() && extents.back().first + extents.back().second == ii) {
+                        ++extents.back().second;
+                    } else {
+                        extents.push_back(std::pair(ii, size_t(1)));
+                    }
+                }
+            }
+            return extents;
+        };
+
+        // a fixed pseudo-random mix of allocs, frees and reallocs
+        std::vector<MemoryBlocks> live;
+        unsigned int state = 12345;
+        for (int step = 0; step < 2000; ++step) {
+            state = state * 1103515245 + 12345;
+            unsigned int roll = (state >> 16) % 10;
+            if (roll < 5 || live.empty()) {
+                MemoryBlocks block = manager.Alloc(1 + (state >> 20) % 12);
+                if (block.status == MemoryStatus::SUCCESS) {
+                    live.push_back(block);
+                }
+            } else if (roll < 8) {
+                size_t victim = (state >> 8) % live.size();
+                EXPECT_EQ(manager.Free(live[victim]), MemoryStatus::SUCCESS);
+                live.erase(live.begin() + victim);
+            } else {
+                size_t victim = (state >> 8) % live.size();
+                manager.Realloc(live[victim], 1 + (state >> 20) % 16);
+                if (live[victim].allocations.empty()) {
+                    live.erase(live.begin() + victim);
+                }
+            }
+            ASSERT_EQ(manager.getFreeExtents(), scanExtents()) << "step " << step;
+        }
+
+        // double frees & marking used blocks again don't confuse it either
+        if (!live.empty()) {
+            manager.Free(live.front());
+            manager.Free(live.front());
+            ASSERT_EQ(manager.getFreeExtents(), scanExtents());
+        }
+        manager.markAllOccupied(0, BUFFER_SIZE);
+        manager.markAllUnoccupied(10, 20);
+        ASSERT_EQ(manager.getFreeExtents(), scanExtents());
+
+        // and switching back to next-fit drops the index
+        manager.setAllocPolicy(AllocPolicy::NEXT_FIT);
+        EXPECT_TRUE(manager.getFreeExtents().empty());
+    }
+}
+
+TEST_F(MemoryManagerTest, tlsfCarvesAndCoalesces) {
+    // free runs of 3 at 0, 8 at 10, 5 at 20 and 24 at 26, like above
+    _manager->markAllOccupied(3, 7);
+    _manager->markAllOccupied(18, 2);
+    _manager->markOccupied(25, true);
+    _manager->setAllocPolicy(AllocPolicy::TLSF);
+
+    // sizes below 16 each have their own list, so 5 is an exact fit
+    MemoryBlocks block = _manager->Alloc(5);
+    std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer+20, 5 }, };
+    EXPECT_EQ(block.allocations, expectedAllocations);
+
+    // 6 & 7 have nothing, so it's the first non-empty list above: the 8 at 10, carved from the front
+    MemoryBlocks carved = _manager->Alloc(6);
+    expectedAllocations = { { _buffer+10, 6 }, };
+    EXPECT_EQ(carved.allocations, expectedAllocations);
+    std::vector<std::pair<size_t, size_t>> expectedExtents = { { 0, 3 }, { 16, 2 }, { 26, 24 } };
+    EXPECT_EQ(_manager->getFreeExtents(), expectedExtents);
+
+    // freeing merges with the neighbor on the right...
+    EXPECT_EQ(_manager->Free(carved), MemoryStatus::SUCCESS);
+    _manager->markOccupied(25, false);
+    expectedExtents = { { 0, 3 }, { 10, 8 }, { 25, 25 } };
+    EXPECT_EQ(_manager->getFreeExtents(), expectedExtents);
+
+    // ... and on both sides at once
+    EXPECT_EQ(_manager->Free(block), MemoryStatus::SUCCESS);
+    _manager->markAllUnoccupied(18, 2);
+    expectedExtents = { { 0, 3 }, { 10, 40 } };
+    EXPECT_EQ(_manager->getFreeExtents(), expectedExtents);
+
+    FreeSpaceStats stats = _manager->GetFreeSpaceStats();
+    EXPECT_EQ(stats.free_bytes, 43);
+    EXPECT_EQ(stats.free_runs, 2);
+    EXPECT_EQ(stats.largest_free_run, 40);
+}
+
+TEST_F(MemoryManagerTest, tlsfFallsBackToFragments) {
+    MemoryManager manager(_buffer, BUFFER_SIZE, 1);
+    manager.markAllOccupied(10, 5);
+    manager.markAllOccupied(30, 5);
+    manager.setAllocPolicy(AllocPolicy::TLSF);
+
+    // free runs are 10, 15 & 15, so 35 takes 2 whole ones and part of the last
+    MemoryBlocks block = manager.Alloc(35);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(block.allocations.size(), 3);
+    EXPECT_EQ(getBlockSum(block), 35);
+    EXPECT_EQ(manager.getAvailableBytes(), 5);
+    EXPECT_EQ(manager.Alloc(6).status, MemoryStatus::INSUFFICIENT_MEMORY);
+}
+
+TEST_F(MemoryManagerTest, segmentTreeFirstFit) {
+    // several leaves worth of blocks, all used except runs of 10 at 100, 300 at 1000 (across a leaf boundary) and
+    // 1000 at 3000
+    std::vector<char> buffer(5000);
+    MemoryManager manager(buffer.data(), buffer.size(), 1);
+    manager.markAllOccupied(0, 5000);
+    manager.markAllUnoccupied(100, 10);
+    manager.markAllUnoccupied(1000, 300);
+    manager.markAllUnoccupied(3000, 1000);
+    manager.setAllocPolicy(AllocPolicy::SEGMENT_TREE);
+
+    FreeSpaceStats stats = manager.GetFreeSpaceStats();
+    EXPECT_EQ(stats.free_bytes, 1310);
+    EXPECT_EQ(stats.free_runs, 3);
+    EXPECT_EQ(stats.largest_free_run, 1000);
+
+    // always the lowest run that fits
+    MemoryBlocks block = manager.Alloc(200);
+    ASSERT_EQ(block.allocations.size(), 1);
+    EXPECT_EQ(block.allocations.front().first, buffer.data() + 1000);
+    block = manager.Alloc(50);
+    ASSERT_EQ(block.allocations.size(), 1);
+    EXPECT_EQ(block.allocations.front().first, buffer.data() + 1200);
+    block = manager.Alloc(5);
+    ASSERT_EQ(block.allocations.size(), 1);
+    EXPECT_EQ(block.allocations.front().first, buffer.data() + 100);
+    block = manager.Alloc(1000);
+    ASSERT_EQ(block.allocations.size(), 1);
+    EXPECT_EQ(block.allocations.front().first, buffer.data() + 3000);
+
+    // 5 + 50 left in 2 runs, so that's fragments
+    block = manager.Alloc(55);
+    EXPECT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(block.allocations.size(), 2);
+    EXPECT_EQ(getBlockSum(block), 55);
+    EXPECT_EQ(manager.Alloc(1).status, MemoryStatus::OUT_OF_MEMORY);
+}
+
+TEST_F(MemoryManagerTest, segmentTreeMatchesBitset) {
+    std::vector<char> buffer(3000);
+    MemoryManager manager(buffer.data(), buffer.size(), 1);
+    manager.setAllocPolicy(AllocPolicy::SEGMENT_TREE);
+
+    auto scanStats = [&]() {
+        FreeSpaceStats stats = {0, 0, 0};
+        size_t run = 0;
+        for (size_t ii = 0; ii <= manager.size(); ++ii) {
+            if (ii < manager.size() && manager.isAvailable(ii)) {
+                ++run;
+                continue;
+            }
+            if (run > 0) {
+                stats.free_bytes += run;
+                ++stats.free_runs;
+                stats.largest_free_run = std::max(stats.largest_free_run, run);
+            }
+            run = 0;
+        }
+        return stats;
+    };
+
+    // a fixed pseudo-random mix of allocs & frees, with the tree's answers checked against the bitset every step
+    std::vector<MemoryBlocks> live;
+    unsigned int state = 6789;
+    for (int step = 0; step < 1000; ++step) {
+        state = state * 1103515245 + 12345;
+        if ((state >> 16) % 10 < 6 || live.empty()) {
+            MemoryBlocks block = manager.Alloc(1 + (state >> 20) % 200);
+            if (block.status == MemoryStatus::SUCCESS) {
+                live.push_back(block);
+            }
+        } else {
+            size_t victim = (state >> 8) % live.size();
+            EXPECT_EQ(manager.Free(live[victim]), MemoryStatus::SUCCESS);
+            live.erase(live.begin() + victim);
+        }
+
+        FreeSpaceStats stats = manager.GetFreeSpaceStats();
+        FreeSpaceStats expected = scanStats();
+        ASSERT_EQ(stats.free_bytes, expected.free_bytes) << "step " << step;
+        ASSERT_EQ(stats.free_runs, expected.free_runs) << "step " << step;
+        ASSERT_EQ(stats.largest_free_run, expected.largest_free_run) << "step " << step;
+
+        size_t begin = (state >> 4) % 3000;
+        size_t end = begin + (state >> 12) % 3000;
+        size_t expected_in_range = 0;
+        for (size_t ii = begin; ii < std::min<size_t>(end, 3000); ++ii) {
+            expected_in_range += manager.isAvailable(ii);
+        }
+        ASSERT_EQ(manager.GetFreeBytesInRange(begin, end), expected_in_range) << "step " << step;
+    }
+}
+
+TEST_F(MemoryManagerTest, freeBytesInRangeCountsPartialBlocks) {
+    for (AllocPolicy policy : { AllocPolicy::NEXT_FIT, AllocPolicy::SEGMENT_TREE }) {
+        std::vector<char> buffer(8 * 2000);
+        MemoryManager manager(buffer.data(), buffer.size(), 8);
+        manager.setAllocPolicy(policy);
+        manager.markAllOccupied(0, 1000);
+
+        EXPECT_EQ(manager.GetFreeBytesInRange(0, 8 * 1000), 0);
+        EXPECT_EQ(manager.GetFreeBytesInRange(0, 8 * 2000), 8 * 1000);
+        // a free block half in the range counts half
+        EXPECT_EQ(manager.GetFreeBytesInRange(8 * 1000 + 4, 8 * 1500 + 2), 8 * 500 - 4 + 2);
+        EXPECT_EQ(manager.GetFreeBytesInRange(8 * 1200 + 1, 8 * 1200 + 3), 2);
+        EXPECT_EQ(manager.GetFreeBytesInRange(8 * 1999, SIZE_MAX), 8);
+        EXPECT_EQ(manager.GetFreeBytesInRange(500, 100), 0);
+    }
+}
+
+TEST_F(MemoryManagerTest, parallelScanMatchesSingleThreaded) {
+    // two managers with the same random layout, one scanning on 4 threads. Block counts that aren't multiples of 64
+    // & next-fit locations in the middle of a char cover the chunk edges.
+    const size_t num_blocks = 20000 + 37;
+    std::vector<char> serial_buffer(num_blocks);
+    std::vector<char> parallel_buffer(num_blocks);
+    MemoryManager serial(serial_buffer.data(), num_blocks, 1);
+    MemoryManager parallel(parallel_buffer.data(), num_blocks, 1);
+    parallel.setParallelScan(4, 1);
+
+    unsigned int state = 424242;
+    for (int step = 0; step < 300; ++step) {
+        state = state * 1103515245 + 12345;
+        size_t size = 1 + (state >> 8) % 3000;
+        MemoryBlocks expected = serial.Alloc(size);
+        MemoryBlocks got = parallel.Alloc(size);
+        ASSERT_EQ(got.status, expected.status) << "step " << step;
+        ASSERT_EQ(got.allocations.size(), expected.allocations.size()) << "step " << step;
+        for (size_t ii = 0; ii < got.allocations.size(); ++ii) {
+            ASSERT_EQ(got.allocations[ii].first - parallel_buffer.data(), expected.allocations[ii].first - serial_buffer.data());
+            ASSERT_EQ(got.allocations[ii].second, expected.allocations[ii].second);
+        }
+        ASSERT_EQ(parallel.getNextByteLocation(), serial.getNextByteLocation()) << "step " << step;
+        ASSERT_EQ(parallel.getAvailableBytes(), serial.getAvailableBytes()) << "step " << step;
+        ASSERT_EQ(parallel.getAvailabilityBitset(), serial.getAvailabilityBitset()) << "step " << step;
+
+        // punch random holes into both, same ones
+        for (int hole = 0; hole < 8; ++hole) {
+            state = state * 1103515245 + 12345;
+            size_t start = (state >> 4) % num_blocks;
+            size_t length = std::min<size_t>(1 + (state >> 20) % 200, num_blocks - start);
+            serial.markAllUnoccupied(start, length);
+            parallel.markAllUnoccupied(start, length);
+        }
+    }
+
+    // everything there is, in one go
+    size_t rest = serial.getAvailableBytes();
+    MemoryBlocks expected = serial.Alloc(rest);
+    MemoryBlocks got = parallel.Alloc(rest);
+    ASSERT_EQ(got.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(got.allocations.size(), expected.allocations.size());
+    EXPECT_EQ(getBlockSum(got), rest);
+    EXPECT_EQ(parallel.getAvailableBytes(), 0);
+    EXPECT_EQ(parallel.Alloc(1).status, MemoryStatus::OUT_OF_MEMORY);
+}
+
+TEST_F(MemoryManagerTest, allocNearAppendsAfterHint) {
+    MemoryBlocks first = _manager->Alloc(5);
+    MemoryBlocks second = _manager->Alloc(5);
+    MemoryBlocks third = _manager->Alloc(5);
+    EXPECT_EQ(_manager->Free(second), MemoryStatus::SUCCESS);
+    EXPECT_EQ(_manager->getNextByteLocation(), 15);
+
+    // right after first, where plain Alloc() would have gone on from 15
+    char* hint = first.allocations.front().first;
+    MemoryBlocks near = _manager->AllocNear(3, hint);
+    ASSERT_EQ(near.status, MemoryStatus::SUCCESS);
+    ASSERT_EQ(near.allocations.size(), 1);
+    EXPECT_EQ(near.allocations.front().first, _buffer + 5);
+
+    // the next-fit location didn't move
+    EXPECT_EQ(_manager->getNextByteLocation(), 15);
+    MemoryBlocks plain = _manager->Alloc(2);
+    EXPECT_EQ(plain.allocations.front().first, _buffer + 15);
+
+    // hinting at the newest piece keeps appending: the 2 left at 8, then on past the used run at 10
+    MemoryBlocks more = _manager->AllocNear(4, near.allocations.front().first + 2);
+    ASSERT_EQ(more.status, MemoryStatus::SUCCESS);
+    ASSERT_EQ(more.allocations.size(), 2);
+    EXPECT_EQ(more.allocations[0], std::pair(_buffer + 8, size_t(2)));
+    EXPECT_EQ(more.allocations[1], std::pair(_buffer + 17, size_t(2)));
+    EXPECT_EQ(getOccupiedSpots().size(), 19);
+}
+
+TEST_F(MemoryManagerTest, allocNearWrapsAndFallsBack) {
+    // hint near the end: what's after it, then from the start of the buffer
+    _manager->markAllOccupied(0, 10);
+    _manager->markAllOccupied(40, 7);
+    MemoryBlocks wrapped = _manager->AllocNear(5, _buffer + 40);
+    ASSERT_EQ(wrapped.status, MemoryStatus::SUCCESS);
+    ASSERT_EQ(wrapped.allocations.size(), 2);
+    EXPECT_EQ(wrapped.allocations[0], std::pair(_buffer + 47, size_t(3)));
+    EXPECT_EQ(wrapped.allocations[1], std::pair(_buffer + 10, size_t(2)));
+
+    // no hint, or one outside the buffer, is plain Alloc()
+    char outside[4];
+    MemoryBlocks plain = _manager->AllocNear(1, nullptr);
+    EXPECT_EQ(plain.allocations.front().first, _buffer + 12);
+    plain = _manager->AllocNear(1, outside);
+    EXPECT_EQ(plain.allocations.front().first, _buffer + 13);
+    EXPECT_EQ(_manager->AllocNear(100, _buffer).status, MemoryStatus::INSUFFICIENT_MEMORY);
+}
+
+TEST_F(MemoryManagerTest, allocNearTakesFirstWholeRunUnderPolicies) {
+    for (AllocPolicy policy : { AllocPolicy::MIN_FRAGMENTS, AllocPolicy::TLSF, AllocPolicy::SEGMENT_TREE }) {
+        // free runs of 3 at 5, 10 at 10 and 28 at 22
+        MemoryManager manager(_buffer, BUFFER_SIZE, 1);
+        manager.markAllOccupied(0, 5);
+        manager.markAllOccupied(8, 2);
+        manager.markAllOccupied(20, 2);
+        manager.setAllocPolicy(policy);
+
+        // the 3 right after the hint are too few, so it's the next run that holds all of it
+        MemoryBlocks near = manager.AllocNear(5, _buffer + 1);
+        ASSERT_EQ(near.status, MemoryStatus::SUCCESS);
+        std::vector<std::pair<char*, size_t>> expectedAllocations = { { _buffer+10, 5 }, };
+        EXPECT_EQ(near.allocations, expectedAllocations);
+
+        // past the best fit (the 5 left at 15) when that's before the hint
+        near = manager.AllocNear(5, _buffer + 20);
+        expectedAllocations = { { _buffer+22, 5 }, };
+        EXPECT_EQ(near.allocations, expectedAllocations);
+
+        // nothing after the hint is big enough, so it's whatever the policy picks
+        near = manager.AllocNear(30, _buffer + 40);
+        EXPECT_EQ(near.status, MemoryStatus::SUCCESS);
+        EXPECT_EQ(manager.getFreeBytes(), 1);
+        EXPECT_EQ(manager.AllocNear(2, _buffer).status, MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+}
+
+TEST_F(MemoryManagerTest, allocNearMatchesScanUnderPolicies) {
+    // big enough for a segment tree with 8 leaves of 512 blocks, so runs across leaves & whole nodes get skipped too
+    std::vector<char> buffer(4096);
+    for (AllocPolicy policy : { AllocPolicy::MIN_FRAGMENTS, AllocPolicy::TLSF, AllocPolicy::SEGMENT_TREE }) {
+        MemoryManager manager(buffer.data(), buffer.size(), 1);
+        manager.setAllocPolicy(policy);
+
+        // the only run that fits starts in the leaf after the hint's, and ends in the node after that
+        manager.markAllOccupied(0, buffer.size());
+        manager.markAllUnoccupied(1000, 100);
+        MemoryBlocks near = manager.AllocNear(90, buffer.data() + 100);
+        ASSERT_EQ(near.status, MemoryStatus::SUCCESS);
+        EXPECT_EQ(near.allocations.front().first, buffer.data() + 1000);
+        manager.Free(near);
+
+        // one that starts in the hint's own leaf and only fits by running on into the next one
+        manager.markAllUnoccupied(480, 80);
+        near = manager.AllocNear(70, buffer.data() + 100);
+        ASSERT_EQ(near.status, MemoryStatus::SUCCESS);
+        EXPECT_EQ(near.allocations.front().first, buffer.data() + 480);
+        manager.Free(near);
+
+        // then free runs of all sizes, with every hinted alloc checked against a scan of the bitset
+        unsigned int state = 4242;
+        auto next = [&state]() {
+            state = state * 1103515245 + 12345;
+            return state >> 8;
+        };
+        for (int ii = 0; ii < 80; ++ii) {
+            manager.markAllUnoccupied(next() % 4000, 1 + next() % 96);
+        }
+        for (int step = 0; step < 1000; ++step) {
+            size_t hint = next() % buffer.size();
+            size_t size = 1 + next() % 128;
+            size_t expected = manager.size();
+            for (size_t ii = hint, run = 0; ii < manager.size(); ++ii) {
+                run = manager.isAvailable(ii) ? run + 1 : 0;
+                if (run == size) {
+                    expected = ii + 1 - size;
+                    break;
+                }
+            }
+
+            near = manager.AllocNear(size, buffer.data() + hint);
+            if (expected != manager.size()) {
+                ASSERT_EQ(near.allocations.size(), 1) << "step " << step;
+                EXPECT_EQ(near.allocations.front().first, buffer.data() + expected) << "step " << step;
+            }
+            if (near.status == MemoryStatus::SUCCESS) {
+                manager.Free(near);
+            }
+        }
+    }
+}
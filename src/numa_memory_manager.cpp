@@ -0,0 +1,202 @@
+#include "numa_memory_manager.h"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// Node ids with memory we're allowed to use, just {0} without NUMA support
+std::vector<int> memoryNodes() {
+    std::vector<int> nodes;
+#ifdef HAVE_LIBNUMA
+    if (numa_available() >= 0) {
+        for (int node = 0; node <= numa_max_node(); ++node) {
+            if (numa_bitmask_isbitset(numa_all_nodes_ptr, node)) {
+                nodes.push_back(node);
+            }
+        }
+    }
+#endif
+    if (nodes.empty()) {
+        nodes.push_back(0);
+    }
+    return nodes;
+}
+
+// Relative cost of node "from" touching memory on node "to", 10 being local (same scale as numa_distance())
+int nodeDistance(int from, int to) {
+#ifdef HAVE_LIBNUMA
+    if (numa_available() >= 0) {
+        int distance = numa_distance(from, to);
+        if (distance > 0) {
+            return distance;
+        }
+    }
+#endif
+    return from == to ? 10 : 20;
+}
+
+// Binds [start, start + num_bytes) to node, so pages get faulted in from that node's memory only. Memory that
+// isn't bound (no NUMA support, or mbind() said no) still works, it's just placed wherever the kernel likes.
+void bindToNode(char* start, size_t num_bytes, int node) {
+#ifdef HAVE_LIBNUMA
+    if (numa_available() < 0) {
+        return;
+    }
+    struct bitmask* mask = numa_allocate_nodemask();
+    numa_bitmask_setbit(mask, node);
+    mbind(start, num_bytes, MPOL_BIND, mask->maskp, mask->size + 1, 0);
+    numa_bitmask_free(mask);
+#else
+    (void)start;
+    (void)num_bytes;
+    (void)node;
+#endif
+}
+
+}  // namespace
+
+NumaMemoryManager::NumaMemoryManager(size_t bytes_per_node, size_t block_size, bool huge_pages)
+: _arenas()
+, _node_ids()
+, _remote_spills(0) {
+    for (int node : memoryNodes()) {
+        BackingStore backing = BackingStore::Reserve(bytes_per_node, huge_pages);
+        if (!backing.isMapped()) {
+            continue;
+        }
+        // the binding is a property of the mapping, so it sticks through the mprotect()s that commit it later &
+        // has to happen before anything gets faulted in
+        bindToNode(backing.data(), backing.size(), node);
+
+        NodeArena arena;
+        arena.node = node;
+        arena.start = backing.data();
+        arena.num_bytes = backing.size();
+        arena.manager = std::make_unique<MemoryManager>(std::move(backing), block_size);
+        _arenas.push_back(std::move(arena));
+        _node_ids.push_back(node);
+    }
+
+    for (auto& arena : _arenas) {
+        for (size_t ii = 0; ii < _arenas.size(); ++ii) {
+            if (_arenas[ii].node != arena.node) {
+                arena.spill_order.push_back(ii);
+            }
+        }
+        // stable, so equally distant nodes go in node id order
+        std::stable_sort(arena.spill_order.begin(), arena.spill_order.end(), [&](size_t aa, size_t bb) {
+            return nodeDistance(arena.node, _arenas[aa].node) < nodeDistance(arena.node, _arenas[bb].node);
+        });
+    }
+}
+
+int NumaMemoryManager::CurrentNode() {
+#ifdef HAVE_LIBNUMA
+    if (numa_available() >= 0) {
+        int cpu = sched_getcpu();
+        if (cpu >= 0) {
+            int node = numa_node_of_cpu(cpu);
+            if (node >= 0) {
+                return node;
+            }
+        }
+    }
+#endif
+    return 0;
+}
+
+int NumaMemoryManager::arenaOf(int node) const {
+    for (size_t ii = 0; ii < _arenas.size(); ++ii) {
+        if (_arenas[ii].node == node) {
+            return static_cast<int>(ii);
+        }
+    }
+    return -1;
+}
+
+MemoryBlocks NumaMemoryManager::Alloc(size_t size, int node) {
+    if (_arenas.empty()) {
+        return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+    }
+
+    int preferred = (node == kLocalNode) ? -1 : arenaOf(node);
+    if (preferred < 0) {
+        preferred = arenaOf(CurrentNode());
+    }
+    if (preferred < 0) {
+        // running on a node without memory of its own (CPU-only nodes exist), which makes everything remote anyway
+        preferred = 0;
+    }
+
+    const NodeArena& home = _arenas[preferred];
+    MemoryBlocks result = home.manager->Alloc(size);
+    if (result.status == MemoryStatus::SUCCESS) {
+        return result;
+    }
+
+    // OUT_OF_MEMORY is the home node's memory running out, which another node might still have
+    for (size_t ii : home.spill_order) {
+        result = _arenas[ii].manager->Alloc(size);
+        if (result.status == MemoryStatus::SUCCESS) {
+            ++_remote_spills;
+            return result;
+        }
+    }
+    return result;
+}
+
+int NumaMemoryManager::nodeOf(const char* ptr) const {
+    for (const auto& arena : _arenas) {
+        if (ptr >= arena.start && ptr < arena.start + arena.num_bytes) {
+            return arena.node;
+        }
+    }
+    return -1;
+}
+
+MemoryStatus NumaMemoryManager::Free(const MemoryBlocks& blocks) {
+    MemoryStatus status = MemoryStatus::SUCCESS;
+    MemoryBlocks batch(MemoryStatus::SUCCESS);
+    int batch_arena = -1;
+
+    auto flush = [&]() {
+        if (batch.allocations.empty()) {
+            return;
+        }
+        if (_arenas[batch_arena].manager->Free(batch) != MemoryStatus::SUCCESS) {
+            status = MemoryStatus::INVALID_MEMORY_LOCATIONS;
+        }
+        batch.allocations.clear();
+    };
+
+    // same batching as RegionAllocator::Free(), an Alloc() result never spans nodes so this is one Free() per call
+    for (const auto& tuple : blocks.allocations) {
+        int arena = arenaOf(nodeOf(tuple.first));
+        if (arena < 0) {
+            status = MemoryStatus::INVALID_MEMORY_LOCATIONS;
+            continue;
+        }
+        if (arena != batch_arena) {
+            flush();
+            batch_arena = arena;
+        }
+        batch.allocations.push_back(tuple);
+    }
+    flush();
+    return status;
+}
+
+FreeSpaceStats NumaMemoryManager::GetFreeSpaceStats(int node) const {
+    int arena = arenaOf(node);
+    if (arena < 0) {
+        return FreeSpaceStats{0, 0, 0};
+    }
+    return _arenas[arena].manager->GetFreeSpaceStats();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "memory_manager.h"
+
+// One arena per NUMA node, each its own MemoryManager over a reserved mapping bound to that node with mbind(). Alloc
+// serves the calling thread's local node by default, so the memory it hands out is a same-socket access away, and
+// only spills over to other nodes (nearest first) when the preferred one can't fit the request. Every request is
+// served from a single node, the allocations of one MemoryBlocks never span nodes.
+//
+// NUMA support comes from libnuma, when cmake finds it (HAVE_LIBNUMA). Without it, or on a kernel/machine without
+// NUMA, there is exactly one node (node 0) with no binding, and this behaves like a plain reserved MemoryManager.
+//
+// Like MemoryManager, this is NOT thread-safe. The usual setup is one of these per process behind a lock, or one
+// lock per node arena.
+class NumaMemoryManager {
+  public:
+    // Hint meaning "whatever node the calling thread runs on"
+    static constexpr int kLocalNode = -1;
+
+    // Reserves bytes_per_node on every node that has memory (see MemoryManager::CreateReserved(), nothing is
+    // committed up front). Check getNumNodes(), it's 0 if no arena could be reserved.
+    explicit NumaMemoryManager(size_t bytes_per_node, size_t block_size = 1, bool huge_pages = false);
+
+    // Allocate from node (a node id, not an index) or the local node, spilling to the nearest other nodes if that
+    // one is out of space. An unknown node counts as kLocalNode.
+    MemoryBlocks Alloc(size_t size, int node = kLocalNode);
+
+    // Frees blocks from any mix of nodes
+    MemoryStatus Free(const MemoryBlocks& blocks);
+
+    // Node ids that have an arena, in increasing order
+    const std::vector<int>& getNodes() const { return _node_ids; }
+    size_t getNumNodes() const { return _node_ids.size(); }
+
+    // Node the memory at ptr belongs to, or -1 if it isn't in any arena
+    int nodeOf(const char* ptr) const;
+
+    // Free space in one node's arena (all zeros for unknown nodes)
+    FreeSpaceStats GetFreeSpaceStats(int node) const;
+
+    // Successful Allocs that had to be served by a node other than the preferred one
+    uint64_t getRemoteSpills() const { return _remote_spills; }
+
+    // Node the calling thread is running on right now (0 without NUMA support)
+    static int CurrentNode();
+
+  private:
+    struct NodeArena {
+        int node;
+        char* start;
+        size_t num_bytes;
+        std::unique_ptr<MemoryManager> manager;
+
+        // other arena indices, nearest node first
+        std::vector<size_t> spill_order;
+    };
+
+    // Arena index for a node id, or -1
+    int arenaOf(int node) const;
+
+    std::vector<NodeArena> _arenas;
+    std::vector<int> _node_ids;
+    uint64_t _remote_spills;
+};
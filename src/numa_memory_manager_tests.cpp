@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "numa_memory_manager.h"
+
+// These run on whatever the machine has. On a single node box (or without libnuma) that's node 0 only, and the
+// spill tests check the "nowhere to spill to" side instead.
+
+#define NUMA_ARENA_SIZE (1 << 20)
+
+namespace {
+
+// Node Alloc(size) without a hint should land on
+int expectedLocalNode(const NumaMemoryManager& manager) {
+    int current = NumaMemoryManager::CurrentNode();
+    for (int node : manager.getNodes()) {
+        if (node == current) {
+            return node;
+        }
+    }
+    return manager.getNodes().front();
+}
+
+}  // namespace
+
+TEST(NumaMemoryManagerTest, servesLocalNode) {
+    NumaMemoryManager manager(NUMA_ARENA_SIZE, 64);
+    ASSERT_GE(manager.getNumNodes(), 1);
+
+    MemoryBlocks block = manager.Alloc(1000);
+    ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+    ASSERT_EQ(block.allocations.size(), 1);
+    EXPECT_EQ(block.allocations.front().second, 1024);
+    EXPECT_EQ(manager.nodeOf(block.allocations.front().first), expectedLocalNode(manager));
+    memset(block.allocations.front().first, 'x', 1024);
+    EXPECT_EQ(manager.getRemoteSpills(), 0);
+}
+
+TEST(NumaMemoryManagerTest, explicitNodeHint) {
+    NumaMemoryManager manager(NUMA_ARENA_SIZE, 64);
+    for (int node : manager.getNodes()) {
+        MemoryBlocks block = manager.Alloc(100, node);
+        ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+        EXPECT_EQ(manager.nodeOf(block.allocations.front().first), node);
+        EXPECT_EQ(manager.GetFreeSpaceStats(node).free_bytes, NUMA_ARENA_SIZE - 128);
+    }
+    EXPECT_EQ(manager.getRemoteSpills(), 0);
+
+    // a node that doesn't exist is the same as no hint
+    MemoryBlocks block = manager.Alloc(100, 4096);
+    ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.nodeOf(block.allocations.front().first), expectedLocalNode(manager));
+}
+
+TEST(NumaMemoryManagerTest, spillsOnlyWhenExhausted) {
+    NumaMemoryManager manager(NUMA_ARENA_SIZE, 64);
+    int home = manager.getNodes().front();
+
+    MemoryBlocks all = manager.Alloc(NUMA_ARENA_SIZE, home);
+    ASSERT_EQ(all.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.GetFreeSpaceStats(home).free_bytes, 0);
+    EXPECT_EQ(manager.getRemoteSpills(), 0);
+
+    MemoryBlocks spilled = manager.Alloc(100, home);
+    if (manager.getNumNodes() == 1) {
+        EXPECT_EQ(spilled.status, MemoryStatus::OUT_OF_MEMORY);
+        EXPECT_EQ(manager.getRemoteSpills(), 0);
+    } else {
+        ASSERT_EQ(spilled.status, MemoryStatus::SUCCESS);
+        EXPECT_NE(manager.nodeOf(spilled.allocations.front().first), home);
+        EXPECT_EQ(manager.getRemoteSpills(), 1);
+    }
+
+    // once there's room at home again, requests go back there
+    EXPECT_EQ(manager.Free(all), MemoryStatus::SUCCESS);
+    MemoryBlocks back_home = manager.Alloc(100, home);
+    ASSERT_EQ(back_home.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.nodeOf(back_home.allocations.front().first), home);
+}
+
+TEST(NumaMemoryManagerTest, freeGoesToOwningNode) {
+    NumaMemoryManager manager(NUMA_ARENA_SIZE, 64);
+
+    MemoryBlocks blocks(MemoryStatus::SUCCESS);
+    for (int node : manager.getNodes()) {
+        MemoryBlocks block = manager.Alloc(4096, node);
+        ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+        blocks.allocations.insert(blocks.allocations.end(), block.allocations.begin(), block.allocations.end());
+    }
+    EXPECT_EQ(manager.Free(blocks), MemoryStatus::SUCCESS);
+    for (int node : manager.getNodes()) {
+        EXPECT_EQ(manager.GetFreeSpaceStats(node).free_bytes, NUMA_ARENA_SIZE);
+    }
+
+    // memory that isn't in any arena gets rejected
+    char outside[64];
+    EXPECT_EQ(manager.nodeOf(outside), -1);
+    EXPECT_EQ(manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {{outside, 64}})), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "memory_manager.h"
+
+// MemoryManager with everything fixed at compile time: N bytes of buffer living inside the object itself, handed
+// out in blocks of Granularity bytes, with the bitset a std::array of 64-bit words. There's no heap allocation
+// anywhere, no pointer to chase to get to the bitset, and the bitset scans are for loops over all kNumWords words
+// (skipping the ones out of range), so their trip count is a constant & for small N (say a 4 KB scratch arena, one
+// word with Granularity 64) the compiler can unroll them completely.
+//
+// Same next-fit Alloc() & Free() semantics as MemoryManager, minus everything optional (policies, tracing, release,
+// allocation map). Everything that doesn't take or return a MemoryBlocks is constexpr, so a manager can be built &
+// queried at compile time, eg to lay out a table or to static_assert on allocation behavior. Alloc(),
+// AllocContiguous() & Free() can't be: MemoryBlocks holds a std::vector, which C++17 doesn't allow in constant
+// expressions. They're thin wrappers around AllocRun() & FreeRun(), which are. C++17 also wants every member
+// initialized in a constexpr constructor, so the buffer starts out zeroed.
+//
+// NOT thread-safe, same as MemoryManager.
+template <size_t N, size_t Granularity = 1>
+class StaticMemoryManager {
+    static_assert(Granularity > 0, "Granularity has to be at least 1 byte");
+    static_assert(N >= Granularity, "the buffer needs room for at least one block");
+
+  public:
+    static constexpr size_t kNumBlocks = N / Granularity;
+
+    constexpr StaticMemoryManager()
+    : _buffer{}
+    , _bitset{}
+    , _available_blocks(kNumBlocks)
+    , _next_block_location(0) {
+        // the bits past the last block are permanently used, so no scan ever needs to check for the end of the bitset
+        // in the middle of a word
+        if (kNumBlocks % 64 != 0) {
+            _bitset[kNumWords - 1] = ~uint64_t(0) << (kNumBlocks % 64);
+        }
+    }
+
+    // Same as MemoryManager::Alloc(size): next-fit, possibly in several extents, rounded up to whole blocks
+    MemoryBlocks Alloc(size_t size) {
+        size_t num_blocks = blocksFor(size);
+        if (_available_blocks == 0) {
+            return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+        }
+        if (num_blocks > _available_blocks) {
+            return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+        }
+
+        std::vector<std::pair<char*, size_t>> allocations;
+        size_t count = 0;
+        size_t ii = _next_block_location;
+        while (count < num_blocks) {
+            // there's something available, so wrapping around at most once is safe
+            ii = findNextAvailable(ii);
+            if (ii == kNumBlocks) {
+                ii = findNextAvailable(0);
+            }
+            size_t current_count = availableRunLength(ii, num_blocks - count);
+            markRange(ii, current_count, true);
+            allocations.push_back(std::pair(_buffer.data() + ii * Granularity, current_count * Granularity));
+            count += current_count;
+            ii += current_count;
+        }
+        advanceNextFit(ii);
+        return MemoryBlocks(MemoryStatus::SUCCESS, allocations);
+    }
+
+    // size bytes as exactly one extent, or nothing
+    MemoryBlocks AllocContiguous(size_t size) {
+        if (_available_blocks == 0) {
+            return MemoryBlocks(MemoryStatus::OUT_OF_MEMORY);
+        }
+        size_t num_blocks = blocksFor(size);
+        size_t start = AllocRun(num_blocks);
+        if (start == kNumBlocks) {
+            return MemoryBlocks(MemoryStatus::INSUFFICIENT_MEMORY);
+        }
+        return MemoryBlocks(MemoryStatus::SUCCESS, {std::pair(_buffer.data() + start * Granularity, num_blocks * Granularity)});
+    }
+
+    // Same as MemoryManager::Free(): extents have to start on a block boundary, lengths get rounded up
+    MemoryStatus Free(const MemoryBlocks& blocks) {
+        bool found_bad_locations = false;
+        for (const auto& tuple : blocks.allocations) {
+            std::ptrdiff_t offset = tuple.first - _buffer.data();
+            if (offset < 0 || static_cast<size_t>(offset) >= kUsableBytes) {
+                found_bad_locations = true;
+                continue;
+            }
+            size_t ll = static_cast<size_t>(offset);
+            if ((ll % Granularity) != 0 || tuple.second > kUsableBytes - ll) {
+                found_bad_locations = true;
+                continue;
+            }
+            FreeRun(ll / Granularity, blocksFor(tuple.second));
+        }
+        return found_bad_locations ? MemoryStatus::INVALID_MEMORY_LOCATIONS : MemoryStatus::SUCCESS;
+    }
+
+    // NOTE: The calls below work in blocks, and are usable in constant expressions.
+
+    // First fit for num_blocks contiguous blocks starting at the next-fit location (wrapping around), marked used.
+    // Returns the first block, or kNumBlocks if there's no run that long (with nothing marked).
+    constexpr size_t AllocRun(size_t num_blocks) {
+        if (num_blocks == 0 || num_blocks > _available_blocks) {
+            return kNumBlocks;
+        }
+        size_t origin = _next_block_location;
+        for (int pass = 0; pass < 2; ++pass) {
+            size_t ii = (pass == 0) ? origin : 0;
+            size_t end = (pass == 0) ? kNumBlocks : origin;
+            while ((ii = findNextAvailable(ii)) < end) {
+                size_t run = availableRunLength(ii, num_blocks);
+                if (run == num_blocks) {
+                    markRange(ii, num_blocks, true);
+                    advanceNextFit(ii + num_blocks);
+                    return ii;
+                }
+                ii += run;
+            }
+        }
+        return kNumBlocks;
+    }
+
+    // Marks count blocks from start unused, false (with nothing changed) if that's past the end of the buffer.
+    // Blocks that were already free stay free, same as Free().
+    constexpr bool FreeRun(size_t start, size_t count) {
+        if (start >= kNumBlocks || count > kNumBlocks - start) {
+            return false;
+        }
+        bool out_of_memory = (_available_blocks == 0);
+        markRange(start, count, false);
+        if (out_of_memory && _available_blocks > 0) {
+            _next_block_location = findNextAvailable(start);
+        }
+        return true;
+    }
+
+    // true if block ii is unused
+    constexpr bool isAvailable(size_t ii) const { return ((_bitset[ii / 64] >> (ii % 64)) & 1) == 0; }
+
+    constexpr size_t getFreeBytes() const { return _available_blocks * Granularity; }
+    static constexpr size_t getUsableBytes() { return kUsableBytes; }
+    static constexpr size_t getBlockSize() { return Granularity; }
+
+    constexpr char* getBuffer() { return _buffer.data(); }
+
+  private:
+    static constexpr size_t kNumWords = (kNumBlocks + 63) / 64;
+    static constexpr size_t kUsableBytes = kNumBlocks * Granularity;
+
+    static constexpr size_t blocksFor(size_t size) { return (size / Granularity) + ((size % Granularity) != 0); }
+
+    // First available block at or after ii, or kNumBlocks if there is none. A word at a time. The used tail bits
+    // mean nothing past the end of the buffer ever shows up as available.
+    constexpr size_t findNextAvailable(size_t ii) const {
+        for (size_t ww = 0; ww < kNumWords; ++ww) {
+            if (ww < ii / 64) {
+                continue;
+            }
+            uint64_t free_bits = ~_bitset[ww];
+            if (ww == ii / 64) {
+                free_bits &= ~uint64_t(0) << (ii % 64);
+            }
+            if (free_bits != 0) {
+                return ww * 64 + static_cast<size_t>(__builtin_ctzll(free_bits));
+            }
+        }
+        return kNumBlocks;
+    }
+
+    // How many blocks starting at ii are available, capped at limit. A word at a time, and the used tail bits stop
+    // it at the end of the buffer.
+    constexpr size_t availableRunLength(size_t ii, size_t limit) const {
+        size_t run = 0;
+        for (size_t ww = 0; ww < kNumWords && run < limit; ++ww) {
+            if (ww < ii / 64) {
+                continue;
+            }
+            size_t bit = (ww == ii / 64) ? ii % 64 : 0;
+            uint64_t used_bits = _bitset[ww] >> bit;
+            if (used_bits != 0) {
+                run += static_cast<size_t>(__builtin_ctzll(used_bits));
+                break;
+            }
+            run += 64 - bit;
+        }
+        return run < limit ? run : limit;
+    }
+
+    // Sets (aa true) or clears count bits from start, whole words at a time in the middle, and keeps the count of
+    // available blocks right for bits that were already in that state
+    constexpr void markRange(size_t start, size_t count, bool aa) {
+        size_t end = start + count;
+        for (size_t ww = 0; ww < kNumWords; ++ww) {
+            size_t lo = ww * 64;
+            if (lo + 64 <= start || lo >= end) {
+                continue;
+            }
+            size_t bit = (start > lo) ? start - lo : 0;
+            size_t width = ((end - lo < 64) ? end - lo : 64) - bit;
+            uint64_t mask = (width == 64) ? ~uint64_t(0) : ((uint64_t(1) << width) - 1) << bit;
+            uint64_t& word = _bitset[ww];
+            uint64_t flipped = (aa ? ~word : word) & mask;
+            size_t changed = static_cast<size_t>(__builtin_popcountll(flipped));
+            if (aa) {
+                word |= mask;
+                _available_blocks -= changed;
+            } else {
+                word &= ~mask;
+                _available_blocks += changed;
+            }
+        }
+    }
+
+    // Next-fit location for the next Alloc(): the first available block from ii on, wrapping around
+    constexpr void advanceNextFit(size_t ii) {
+        if (_available_blocks == 0) {
+            return;
+        }
+        ii = findNextAvailable(ii);
+        _next_block_location = (ii == kNumBlocks) ? findNextAvailable(0) : ii;
+    }
+
+    alignas(std::max_align_t) std::array<char, N> _buffer;
+
+    // for each bit here, 0 means unused, 1 means used (block ii is bit ii % 64 of word ii / 64)
+    std::array<uint64_t, kNumWords> _bitset;
+    size_t _available_blocks;
+    size_t _next_block_location;
+};
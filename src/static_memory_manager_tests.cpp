@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "static_memory_manager.h"
+
+// 16 blocks of 16 bytes, laid out at compile time
+constexpr StaticMemoryManager<256, 16> buildLayout() {
+    StaticMemoryManager<256, 16> manager;
+    manager.AllocRun(4);  // blocks 0-3
+    manager.AllocRun(4);  // blocks 4-7
+    manager.AllocRun(8);  // blocks 8-15
+    manager.FreeRun(4, 4);
+    return manager;
+}
+
+constexpr StaticMemoryManager<256, 16> kLayout = buildLayout();
+static_assert(kLayout.getFreeBytes() == 4 * 16);
+static_assert(!kLayout.isAvailable(3) && kLayout.isAvailable(4) && kLayout.isAvailable(7) && !kLayout.isAvailable(8));
+
+constexpr size_t allocAfterWrap() {
+    // 100 blocks, so the last word is partly past the end of the buffer
+    StaticMemoryManager<100> manager;
+    manager.AllocRun(90);
+    manager.FreeRun(0, 10);
+    // 10 at the end doesn't fit 20, and neither does wrapping around to the 10 at the front
+    if (manager.AllocRun(20) != decltype(manager)::kNumBlocks) {
+        return 0;
+    }
+    return manager.AllocRun(10);
+}
+static_assert(allocAfterWrap() == 90);
+
+constexpr bool runsAcrossWords() {
+    // 200 blocks is 4 words. A run of 70 from block 60 spans three of them, and freeing the middle of it leaves a
+    // hole that straddles the word boundary at 64.
+    StaticMemoryManager<200> manager;
+    if (manager.AllocRun(60) != 0 || manager.AllocRun(70) != 60) {
+        return false;
+    }
+    manager.FreeRun(62, 5);
+    if (manager.getFreeBytes() != 200 - 130 + 5 || manager.isAvailable(61) || !manager.isAvailable(66)) {
+        return false;
+    }
+    // the 70 at the end go first (next fit), then the hole is the only run of 5 left
+    return manager.AllocRun(70) == 130 && manager.AllocRun(5) == 62 && manager.AllocRun(1) == decltype(manager)::kNumBlocks;
+}
+static_assert(runsAcrossWords());
+
+TEST(StaticMemoryManagerTest, constexprLayoutIsUsableAtRuntime) {
+    StaticMemoryManager<256, 16> manager = kLayout;
+    MemoryBlocks block = manager.AllocContiguous(64);
+    ASSERT_EQ(block.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(block.allocations.front().first, manager.getBuffer() + 4 * 16);
+    EXPECT_EQ(manager.Alloc(1).status, MemoryStatus::OUT_OF_MEMORY);
+}
+
+TEST(StaticMemoryManagerTest, allocsNextFitAcrossFragments) {
+    StaticMemoryManager<4096, 64> manager;
+    EXPECT_EQ(manager.getUsableBytes(), 4096);
+
+    MemoryBlocks first = manager.Alloc(100);
+    MemoryBlocks second = manager.Alloc(64);
+    MemoryBlocks third = manager.Alloc(64);
+    ASSERT_EQ(first.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(first.allocations.front().second, 128);
+    EXPECT_EQ(second.allocations.front().first, manager.getBuffer() + 128);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(manager.getBuffer()) % alignof(std::max_align_t), 0);
+    EXPECT_EQ(manager.getFreeBytes(), 4096 - 256);
+
+    // --XX------...: the rest of the buffer first, then the hole at the front
+    EXPECT_EQ(manager.Free(first), MemoryStatus::SUCCESS);
+    MemoryBlocks rest = manager.Alloc(4096 - 128);
+    ASSERT_EQ(rest.status, MemoryStatus::SUCCESS);
+    ASSERT_EQ(rest.allocations.size(), 2);
+    EXPECT_EQ(rest.allocations[0].first, manager.getBuffer() + 256);
+    EXPECT_EQ(rest.allocations[1].first, manager.getBuffer());
+    EXPECT_EQ(rest.allocations[1].second, 128);
+    memset(rest.allocations[0].first, 'x', rest.allocations[0].second);
+
+    EXPECT_EQ(manager.Alloc(1).status, MemoryStatus::OUT_OF_MEMORY);
+    EXPECT_EQ(manager.Free(second), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.Alloc(65).status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(manager.Alloc(64).status, MemoryStatus::SUCCESS);
+}
+
+TEST(StaticMemoryManagerTest, contiguousNeedsOneRun) {
+    StaticMemoryManager<200> manager;
+    ASSERT_EQ(manager.AllocContiguous(100).status, MemoryStatus::SUCCESS);
+    MemoryBlocks middle = manager.AllocContiguous(50);
+    ASSERT_EQ(manager.AllocContiguous(50).status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.Free(middle), MemoryStatus::SUCCESS);
+
+    EXPECT_EQ(manager.AllocContiguous(51).status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(manager.getFreeBytes(), 50);
+    MemoryBlocks exact = manager.AllocContiguous(50);
+    ASSERT_EQ(exact.status, MemoryStatus::SUCCESS);
+    EXPECT_EQ(exact.allocations.front().first, manager.getBuffer() + 100);
+}
+
+TEST(StaticMemoryManagerTest, freeRejectsBadLocations) {
+    StaticMemoryManager<1024, 64> manager;
+    MemoryBlocks block = manager.Alloc(128);
+    char outside[16];
+
+    EXPECT_EQ(manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {{outside, 16}})), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {{manager.getBuffer() + 1, 63}})), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {{manager.getBuffer(), 1025}})), MemoryStatus::INVALID_MEMORY_LOCATIONS);
+    EXPECT_EQ(manager.getFreeBytes(), 1024 - 128);
+
+    // freeing with the requested size rounds up, same as MemoryManager
+    EXPECT_EQ(manager.Free(MemoryBlocks(MemoryStatus::SUCCESS, {{manager.getBuffer(), 100}})), MemoryStatus::SUCCESS);
+    EXPECT_EQ(manager.getFreeBytes(), 1024);
+}
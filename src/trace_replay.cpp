@@ -0,0 +1,155 @@
+#include "trace_replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A live piece of a recorded allocation: `length` recorded bytes starting at the map key, which are logical bytes
+// [logical_start, logical_start + length) of allocation alloc_id
+struct RecordedSegment {
+    uint64_t length;
+    uint64_t alloc_id;
+    uint64_t logical_start;
+};
+
+// What the replayed manager handed out for a recorded allocation, and how many of its recorded bytes are still live
+struct ReplayedAllocation {
+    std::vector<std::pair<char*, size_t>> extents;
+    uint64_t live_bytes;
+};
+
+// Appends the physical ranges holding logical bytes [start, start + count) of a replayed allocation to out
+void translateLogical(const std::vector<std::pair<char*, size_t>>& extents, uint64_t start, uint64_t count, MemoryBlocks& out) {
+    uint64_t logical = 0;
+    for (const auto& tuple : extents) {
+        if (count == 0) {
+            return;
+        }
+        uint64_t extent_end = logical + tuple.second;
+        if (start < extent_end) {
+            uint64_t skip = start - logical;
+            size_t take = static_cast<size_t>(std::min<uint64_t>(count, tuple.second - skip));
+            out.allocations.push_back(std::pair(tuple.first + skip, take));
+            start += take;
+            count -= take;
+        }
+        logical = extent_end;
+    }
+}
+
+}  // namespace
+
+ReplayResult ReplayTrace(TraceReader& reader, MemoryManager& manager, uint64_t sample_every) {
+    ReplayResult result = {};
+
+    std::map<uint64_t, RecordedSegment> recorded;
+    std::unordered_map<uint64_t, ReplayedAllocation> replayed;
+    uint64_t next_alloc_id = 0;
+
+    TraceEvent event;
+    while (reader.next(event)) {
+        ++result.events;
+
+        if (event.op == TraceOp::ALLOC) {
+            uint64_t alloc_id = next_alloc_id++;
+            ++result.allocs;
+            if (event.status != MemoryStatus::SUCCESS) {
+                ++result.recorded_failed_allocs;
+            }
+
+            auto start = Clock::now();
+            MemoryBlocks blocks = manager.Alloc(event.size);
+            result.alloc_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+            uint64_t logical = 0;
+            for (const auto& extent : event.extents) {
+                if (extent.second > 0) {
+                    recorded[extent.first] = RecordedSegment{extent.second, alloc_id, logical};
+                    logical += extent.second;
+                }
+            }
+
+            if (blocks.status == MemoryStatus::SUCCESS) {
+                result.fragments += blocks.allocations.size();
+                result.requested_bytes += event.size;
+                for (const auto& tuple : blocks.allocations) {
+                    result.granted_bytes += tuple.second;
+                }
+                replayed[alloc_id] = ReplayedAllocation{std::move(blocks.allocations), logical};
+            } else {
+                ++result.failed_allocs;
+            }
+        } else {
+            MemoryBlocks to_free(MemoryStatus::SUCCESS);
+            for (const auto& extent : event.extents) {
+                uint64_t ll = extent.first;
+                uint64_t rr = extent.first + extent.second;
+                uint64_t covered = 0;
+
+                // first segment that could overlap [ll, rr) is the one starting at or right before ll
+                auto it = recorded.upper_bound(ll);
+                if (it != recorded.begin()) {
+                    --it;
+                }
+                while (it != recorded.end() && it->first < rr) {
+                    uint64_t seg_ll = it->first;
+                    uint64_t seg_rr = seg_ll + it->second.length;
+                    uint64_t overlap_ll = std::max(ll, seg_ll);
+                    uint64_t overlap_rr = std::min(rr, seg_rr);
+                    if (overlap_ll >= overlap_rr) {
+                        ++it;
+                        continue;
+                    }
+
+                    RecordedSegment segment = it->second;
+                    covered += overlap_rr - overlap_ll;
+                    auto found = replayed.find(segment.alloc_id);
+                    if (found != replayed.end()) {
+                        translateLogical(found->second.extents, segment.logical_start + (overlap_ll - seg_ll),
+                                         overlap_rr - overlap_ll, to_free);
+                        found->second.live_bytes -= overlap_rr - overlap_ll;
+                        if (found->second.live_bytes == 0) {
+                            replayed.erase(found);
+                        }
+                    }
+
+                    // cut the freed bytes out of the segment, keeping whatever is left on either side
+                    it = recorded.erase(it);
+                    if (seg_ll < overlap_ll) {
+                        recorded[seg_ll] = RecordedSegment{overlap_ll - seg_ll, segment.alloc_id, segment.logical_start};
+                    }
+                    if (overlap_rr < seg_rr) {
+                        it = recorded.emplace(overlap_rr, RecordedSegment{seg_rr - overlap_rr, segment.alloc_id,
+                                                                         segment.logical_start + (overlap_rr - seg_ll)}).first;
+                        ++it;
+                    }
+                }
+                result.unmapped_free_bytes += extent.second - covered;
+            }
+
+            if (!to_free.allocations.empty()) {
+                ++result.frees;
+                auto start = Clock::now();
+                MemoryStatus status = manager.Free(to_free);
+                result.free_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+                if (status != MemoryStatus::SUCCESS) {
+                    ++result.failed_frees;
+                }
+            }
+        }
+
+        if (sample_every > 0 && result.events % sample_every == 0) {
+            result.worst_fragmentation = std::max(result.worst_fragmentation, manager.GetFreeSpaceStats().fragmentation());
+        }
+    }
+
+    result.final_stats = manager.GetFreeSpaceStats();
+    result.worst_fragmentation = std::max(result.worst_fragmentation, result.final_stats.fragmentation());
+    return result;
+}
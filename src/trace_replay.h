@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+#include "allocation_trace.h"
+#include "memory_manager.h"
+
+// Deterministic replay of a recorded trace (see allocation_trace.h) against a MemoryManager, which can be set up
+// with whatever buffer size & policy you want to evaluate.
+//
+// The replayed manager will usually hand out different offsets than the recorded one did, so frees can't be
+// replayed by offset. Instead every recorded allocation is treated as a logical run of bytes, and a recorded
+// Free() of some bytes is translated into a Free() of the same logical bytes in the replayed allocation. This
+// also works for partial frees like the X-X-X example in main.cpp, as long as the replayed manager's block size
+// lets them start on a block boundary (the ones that don't end up in failed_frees).
+//
+// Allocations that failed in the recording are still replayed (a better policy might satisfy them), but since
+// the trace never frees them, they stay live until the end of the replay.
+
+struct ReplayResult {
+    uint64_t events;
+
+    uint64_t allocs;
+    // replayed Alloc() calls not returning SUCCESS, and how many of those had failed in the recording too
+    uint64_t failed_allocs;
+    uint64_t recorded_failed_allocs;
+    // total extents handed out by successful replayed Alloc() calls
+    uint64_t fragments;
+
+    // bytes asked for by, and bytes handed out to, successful replayed Alloc() calls. The difference is internal
+    // fragmentation from rounding up to the manager's block size.
+    uint64_t requested_bytes;
+    uint64_t granted_bytes;
+
+    uint64_t frees;
+    uint64_t failed_frees;
+    // recorded frees of bytes that no live allocation owned (double frees, freeing never-allocated memory, or bytes
+    // of an allocation that failed during replay)
+    uint64_t unmapped_free_bytes;
+
+    // Time spent inside Alloc() & Free() only, not in trace parsing or bookkeeping
+    double alloc_seconds;
+    double free_seconds;
+
+    // Worst fragmentation seen when sampling, and the state of the manager after the last event
+    double worst_fragmentation;
+    FreeSpaceStats final_stats;
+};
+
+// sample_every > 0 takes a GetFreeSpaceStats() snapshot every that many events (which is O(buffer size) each, so
+// don't go crazy on big buffers), to track worst_fragmentation. 0 only looks at the final state.
+ReplayResult ReplayTrace(TraceReader& reader, MemoryManager& manager, uint64_t sample_every = 0);
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "memory_manager.h"
+
+// Typed front end over MemoryManager for buffers of fixed-size records. The manager underneath runs with
+// block_size = sizeof(T), so every bit in its bitset is exactly one element: allocations come in whole elements,
+// and no fragment can ever start or end in the middle of one. Fragments come back as Span<T>s instead of
+// (char*, length) pairs.
+//
+// Like Alloc(), the memory handed out is NOT constructed. That's a non-issue for trivially copyable records, and
+// for anything else the caller needs to placement-new into the spans (and destroy before freeing).
+
+// count elements of T starting at data, the typed version of one MemoryBlocks extent
+template <typename T>
+struct Span {
+    T* data;
+    size_t count;
+
+    T* begin() const { return data; }
+    T* end() const { return data + count; }
+    size_t size() const { return count; }
+    T& operator[](size_t ii) const { return data[ii]; }
+
+    bool operator==(const Span& other) const { return data == other.data && count == other.count; }
+};
+
+template <typename T>
+struct TypedBlocks {
+    MemoryStatus status;
+    std::vector<Span<T>> spans;
+
+    TypedBlocks()
+    : status(MemoryStatus::UNKNOWN)
+    , spans() {}
+
+    TypedBlocks(MemoryStatus s)
+    : status(s)
+    , spans() {}
+
+    TypedBlocks(MemoryStatus s, const std::vector<Span<T>>& a)
+    : status(s)
+    , spans(a) {}
+};
+
+template <typename T>
+class TypedMemoryManager {
+  public:
+    // buffer is num_elements T's of contiguous memory. If num_elements * sizeof(T) doesn't fit in a size_t, it
+    // can't be a real buffer, and the manager ends up empty the same as MemoryManager does for a null buffer.
+    TypedMemoryManager(T* buffer, size_t num_elements)
+    : _buffer(buffer)
+    , _manager(fitsInBytes(num_elements) ? reinterpret_cast<char*>(buffer) : nullptr,
+               fitsInBytes(num_elements) ? num_elements * sizeof(T) : 0, sizeof(T)) {}
+
+    // Allocate count elements, possibly split over several spans (same next-fit behavior as MemoryManager::Alloc)
+    TypedBlocks<T> Alloc(size_t count) {
+        if (!fitsInBytes(count)) {
+            return TypedBlocks<T>(MemoryStatus::INSUFFICIENT_MEMORY);
+        }
+        return toTyped(_manager.Alloc(count * sizeof(T)));
+    }
+
+    // Allocate count elements as a single span, or nothing
+    TypedBlocks<T> AllocContiguous(size_t count) {
+        if (!fitsInBytes(count)) {
+            return TypedBlocks<T>(MemoryStatus::INSUFFICIENT_MEMORY);
+        }
+        // the buffer is a T*, so every block is already aligned for T & this never trips over the alignment
+        return toTyped(_manager.Alloc(count * sizeof(T), alignof(T), true));
+    }
+
+    // Free up previously allocated spans, partial spans are fine as long as they're whole elements (which a Span<T>
+    // can't help but be)
+    MemoryStatus Free(const TypedBlocks<T>& blocks) {
+        MemoryBlocks bytes(blocks.status);
+        bytes.allocations.reserve(blocks.spans.size());
+        for (const auto& span : blocks.spans) {
+            bytes.allocations.push_back(std::pair(reinterpret_cast<char*>(span.data), span.count * sizeof(T)));
+        }
+        return _manager.Free(bytes);
+    }
+
+    // Same as MemoryManager::GetFreeSpaceStats(), so still in bytes. Divide by sizeof(T) for elements.
+    FreeSpaceStats GetFreeSpaceStats() const { return _manager.GetFreeSpaceStats(); }
+
+    size_t size() const { return _manager.getUsableBytes() / sizeof(T); }
+
+    // The byte-level manager underneath, eg to hook up a TraceRecorder
+    MemoryManager& getManager() { return _manager; }
+
+  private:
+    // whether count T's is a byte count a size_t can hold
+    static bool fitsInBytes(size_t count) { return count <= SIZE_MAX / sizeof(T); }
+
+    TypedBlocks<T> toTyped(const MemoryBlocks& bytes) const {
+        TypedBlocks<T> result(bytes.status);
+        result.spans.reserve(bytes.allocations.size());
+        for (const auto& tuple : bytes.allocations) {
+            // block_size is sizeof(T), so extents always start & end on element boundaries
+            T* data = _buffer + (tuple.first - reinterpret_cast<char*>(_buffer)) / sizeof(T);
+            result.spans.push_back(Span<T>{data, tuple.second / sizeof(T)});
+        }
+        return result;
+    }
+
+    T* _buffer;
+    MemoryManager _manager;
+};
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "typed_memory_manager.h"
+
+#define TYPED_BUFFER_SIZE 10
+
+namespace {
+
+// 48 bytes, like the records we actually store
+struct Record {
+    uint64_t key;
+    double values[5];
+};
+
+}  // namespace
+
+class TypedMemoryManagerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    _manager.reset(new TypedMemoryManager<Record>(_buffer, TYPED_BUFFER_SIZE));
+  }
+
+  Record _buffer[TYPED_BUFFER_SIZE];
+  std::unique_ptr<TypedMemoryManager<Record>> _manager;
+};
+
+TEST_F(TypedMemoryManagerTest, allocatesWholeElements) {
+    EXPECT_EQ(sizeof(Record), 48);
+    EXPECT_EQ(_manager->size(), TYPED_BUFFER_SIZE);
+
+    TypedBlocks<Record> blocks = _manager->Alloc(3);
+    EXPECT_EQ(blocks.status, MemoryStatus::SUCCESS);
+    std::vector<Span<Record>> expectedSpans = { { _buffer, 3 } };
+    EXPECT_EQ(blocks.spans, expectedSpans);
+
+    // spans are usable as-is
+    for (Record& record : blocks.spans.front()) {
+        record.key = 7;
+    }
+    EXPECT_EQ(_buffer[2].key, 7);
+
+    FreeSpaceStats stats = _manager->GetFreeSpaceStats();
+    EXPECT_EQ(stats.free_bytes, 7 * sizeof(Record));
+}
+
+TEST_F(TypedMemoryManagerTest, fragmentsNeverSplitElements) {
+    // the X-X-X example from main.cpp, with records instead of bytes
+    std::vector<TypedBlocks<Record>> singles;
+    for (int ii = 0; ii < TYPED_BUFFER_SIZE; ++ii) {
+        singles.push_back(_manager->Alloc(1));
+    }
+    for (int ii = 1; ii < TYPED_BUFFER_SIZE; ii += 2) {
+        EXPECT_EQ(_manager->Free(singles[ii]), MemoryStatus::SUCCESS);
+    }
+
+    TypedBlocks<Record> blocks = _manager->Alloc(2);
+    EXPECT_EQ(blocks.status, MemoryStatus::SUCCESS);
+    std::vector<Span<Record>> expectedSpans = { { _buffer+1, 1 }, { _buffer+3, 1 } };
+    EXPECT_EQ(blocks.spans, expectedSpans);
+
+    // can't get 2 in a row anymore
+    EXPECT_EQ(_manager->AllocContiguous(2).status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(_manager->AllocContiguous(1).status, MemoryStatus::SUCCESS);
+}
+
+TEST_F(TypedMemoryManagerTest, freesPartialSpans) {
+    TypedBlocks<Record> blocks = _manager->AllocContiguous(6);
+    EXPECT_EQ(blocks.status, MemoryStatus::SUCCESS);
+    ASSERT_EQ(blocks.spans.size(), 1);
+
+    // give back the middle 2 records only
+    TypedBlocks<Record> middle(MemoryStatus::SUCCESS, { { blocks.spans.front().data + 2, 2 } });
+    EXPECT_EQ(_manager->Free(middle), MemoryStatus::SUCCESS);
+
+    FreeSpaceStats stats = _manager->GetFreeSpaceStats();
+    EXPECT_EQ(stats.free_bytes, 6 * sizeof(Record));
+    EXPECT_EQ(stats.free_runs, 2);
+}
+
+TEST_F(TypedMemoryManagerTest, rejectsOverflowingCounts) {
+    EXPECT_EQ(_manager->Alloc(SIZE_MAX / 2).status, MemoryStatus::INSUFFICIENT_MEMORY);
+    EXPECT_EQ(_manager->AllocContiguous(SIZE_MAX / 2).status, MemoryStatus::INSUFFICIENT_MEMORY);
+}
+
+TEST(TypedMemoryManagerSizeTest, overflowingBufferSizeMakesAnEmptyManager) {
+    // SIZE_MAX / 2 records is way more bytes than a size_t holds, and must not wrap around to a small buffer
+    Record buffer[1];
+    TypedMemoryManager<Record> manager(buffer, SIZE_MAX / 2);
+    EXPECT_EQ(manager.size(), 0);
+    EXPECT_EQ(manager.Alloc(1).status, MemoryStatus::OUT_OF_MEMORY);
+
+    // same as an untyped manager on a null buffer
+    MemoryManager untyped(nullptr, 1024);
+    EXPECT_EQ(untyped.getUsableBytes(), 0);
+    EXPECT_EQ(untyped.Alloc(1).status, MemoryStatus::OUT_OF_MEMORY);
+}
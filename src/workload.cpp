@@ -0,0 +1,311 @@
+#include "workload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Past this many distinct sizes, the zipf table stops being worth it & gets capped (the tail weights are tiny anyways)
+const size_t kMaxZipfSizes = 1 << 20;
+
+struct LiveAllocation {
+    uint64_t id;
+    size_t size;
+    size_t granted;
+    MemoryBlocks blocks;
+};
+
+struct ThreadState {
+    std::vector<uint64_t> alloc_latencies;
+    std::vector<uint64_t> free_latencies;
+    uint64_t allocs = 0;
+    uint64_t failed_allocs = 0;
+    uint64_t frees = 0;
+    uint64_t fragments = 0;
+    uint64_t live_bytes = 0;
+    uint64_t live_granted_bytes = 0;
+    std::vector<LiveAllocation> live;
+};
+
+uint64_t elapsedNanos(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+LatencySummary summarize(std::vector<uint64_t>& samples) {
+    LatencySummary summary = {samples.size(), 0, 0, 0, 0, 0};
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double pp) { return samples[static_cast<size_t>(pp * (samples.size() - 1))]; };
+    summary.p50 = at(0.50);
+    summary.p90 = at(0.90);
+    summary.p99 = at(0.99);
+    summary.p999 = at(0.999);
+    summary.max = samples.back();
+    return summary;
+}
+
+void updatePeak(std::atomic<uint64_t>& peak, uint64_t value) {
+    uint64_t current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void runThread(ConcurrentAllocator& allocator, const WorkloadConfig& config, unsigned int seed, ThreadState& state,
+               std::atomic<uint64_t>& global_live, std::atomic<uint64_t>& global_peak) {
+    WorkloadGenerator generator(config, seed);
+
+    // min-heap of (step the allocation dies on, id). Allocations killed early by churn stay in here & get skipped
+    // when they come up, which is cheaper than digging them out of the heap.
+    using Death = std::pair<uint64_t, uint64_t>;
+    std::priority_queue<Death, std::vector<Death>, std::greater<Death>> deaths;
+    std::unordered_map<uint64_t, size_t> index_of;
+    uint64_t next_id = 0;
+
+    state.alloc_latencies.reserve(config.ops);
+    state.free_latencies.reserve(config.ops);
+
+    auto release = [&](uint64_t id) {
+        auto found = index_of.find(id);
+        if (found == index_of.end()) {
+            return;
+        }
+        size_t index = found->second;
+        index_of.erase(found);
+
+        LiveAllocation item = std::move(state.live[index]);
+        if (index + 1 != state.live.size()) {
+            state.live[index] = std::move(state.live.back());
+            index_of[state.live[index].id] = index;
+        }
+        state.live.pop_back();
+
+        auto start = Clock::now();
+        allocator.Free(item.blocks);
+        state.free_latencies.push_back(elapsedNanos(start));
+        ++state.frees;
+        state.live_bytes -= item.size;
+        state.live_granted_bytes -= item.granted;
+        global_live.fetch_sub(item.size, std::memory_order_relaxed);
+    };
+
+    for (uint64_t step = 0; step < static_cast<uint64_t>(config.ops); ++step) {
+        while (!deaths.empty() && deaths.top().first <= step) {
+            release(deaths.top().second);
+            deaths.pop();
+        }
+
+        if (!state.live.empty() && generator.nextPercent() < config.churn_percent) {
+            release(state.live[generator.nextIndex(state.live.size())].id);
+        }
+
+        size_t size = generator.nextSize();
+        auto start = Clock::now();
+        MemoryBlocks blocks = allocator.Alloc(size);
+        state.alloc_latencies.push_back(elapsedNanos(start));
+
+        if (blocks.status != MemoryStatus::SUCCESS) {
+            ++state.failed_allocs;
+            continue;
+        }
+        ++state.allocs;
+        state.fragments += blocks.allocations.size();
+
+        size_t granted = 0;
+        for (const auto& tuple : blocks.allocations) {
+            granted += tuple.second;
+        }
+
+        uint64_t id = next_id++;
+        index_of[id] = state.live.size();
+        state.live.push_back({id, size, granted, std::move(blocks)});
+        deaths.push({step + 1 + generator.nextLifetime(), id});
+
+        state.live_bytes += size;
+        state.live_granted_bytes += granted;
+        updatePeak(global_peak, global_live.fetch_add(size, std::memory_order_relaxed) + size);
+    }
+}
+
+}  // namespace
+
+WorkloadConfig DefaultWorkloadConfig() {
+    WorkloadConfig config;
+    config.distribution = SizeDistribution::UNIFORM;
+    config.min_size = 16;
+    config.max_size = 4096;
+    config.zipf_skew = 1.0;
+    config.bimodal_small_percent = 90;
+    config.lifetime = LifetimeProfile::EXPONENTIAL;
+    config.mean_lifetime = 1000;
+    config.churn_percent = 0;
+    config.ops = 100000;
+    config.seed = 42;
+    return config;
+}
+
+bool ParseSizeDistribution(const std::string& name, SizeDistribution& out) {
+    if (name == "uniform") {
+        out = SizeDistribution::UNIFORM;
+    } else if (name == "zipf") {
+        out = SizeDistribution::ZIPF;
+    } else if (name == "bimodal") {
+        out = SizeDistribution::BIMODAL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseLifetimeProfile(const std::string& name, LifetimeProfile& out) {
+    if (name == "fixed") {
+        out = LifetimeProfile::FIXED;
+    } else if (name == "exponential") {
+        out = LifetimeProfile::EXPONENTIAL;
+    } else if (name == "bimodal") {
+        out = LifetimeProfile::BIMODAL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseAllocPolicy(const std::string& name, AllocPolicy& out) {
+    if (name == "next-fit") {
+        out = AllocPolicy::NEXT_FIT;
+    } else if (name == "min-fragments") {
+        out = AllocPolicy::MIN_FRAGMENTS;
+    } else if (name == "tlsf") {
+        out = AllocPolicy::TLSF;
+    } else if (name == "segment-tree") {
+        out = AllocPolicy::SEGMENT_TREE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadConfig& config, unsigned int seed)
+: _config(config)
+, _rng(seed) {
+    if (_config.distribution == SizeDistribution::ZIPF) {
+        size_t count = std::min(_config.max_size - _config.min_size + 1, kMaxZipfSizes);
+        _zipf_cdf.reserve(count);
+        double total = 0.0;
+        for (size_t kk = 0; kk < count; ++kk) {
+            total += 1.0 / std::pow(kk + 1, _config.zipf_skew);
+            _zipf_cdf.push_back(total);
+        }
+    }
+}
+
+size_t WorkloadGenerator::nextSize() {
+    switch (_config.distribution) {
+        case SizeDistribution::ZIPF: {
+            std::uniform_real_distribution<double> dist(0.0, _zipf_cdf.back());
+            auto it = std::lower_bound(_zipf_cdf.begin(), _zipf_cdf.end(), dist(_rng));
+            size_t rank = std::min<size_t>(it - _zipf_cdf.begin(), _zipf_cdf.size() - 1);
+            return _config.min_size + rank;
+        }
+        case SizeDistribution::BIMODAL: {
+            size_t span = _config.max_size - _config.min_size;
+            if (nextPercent() < _config.bimodal_small_percent) {
+                std::uniform_int_distribution<size_t> small(_config.min_size, _config.min_size + span / 16);
+                return small(_rng);
+            }
+            std::uniform_int_distribution<size_t> large(_config.max_size - span / 4, _config.max_size);
+            return large(_rng);
+        }
+        case SizeDistribution::UNIFORM:
+        default: {
+            std::uniform_int_distribution<size_t> dist(_config.min_size, _config.max_size);
+            return dist(_rng);
+        }
+    }
+}
+
+int WorkloadGenerator::nextLifetime() {
+    int mean = std::max(1, _config.mean_lifetime);
+    switch (_config.lifetime) {
+        case LifetimeProfile::EXPONENTIAL: {
+            std::exponential_distribution<double> dist(1.0 / mean);
+            return static_cast<int>(dist(_rng));
+        }
+        case LifetimeProfile::BIMODAL: {
+            if (nextPercent() < 90) {
+                return std::max(1, mean / 10);
+            }
+            return mean * 10;
+        }
+        case LifetimeProfile::FIXED:
+        default:
+            return mean;
+    }
+}
+
+int WorkloadGenerator::nextPercent() {
+    std::uniform_int_distribution<int> dist(0, 99);
+    return dist(_rng);
+}
+
+size_t WorkloadGenerator::nextIndex(size_t count) {
+    std::uniform_int_distribution<size_t> dist(0, count - 1);
+    return dist(_rng);
+}
+
+WorkloadResult RunWorkload(ConcurrentAllocator& allocator, const WorkloadConfig& config, int threads) {
+    threads = std::max(1, threads);
+    std::vector<ThreadState> states(threads);
+    std::atomic<uint64_t> global_live(0);
+    std::atomic<uint64_t> global_peak(0);
+
+    auto start = Clock::now();
+    if (threads == 1) {
+        runThread(allocator, config, config.seed, states[0], global_live, global_peak);
+    } else {
+        std::vector<std::thread> workers;
+        for (int tt = 0; tt < threads; ++tt) {
+            workers.emplace_back([&, tt]() {
+                runThread(allocator, config, config.seed + tt, states[tt], global_live, global_peak);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    WorkloadResult result = {};
+    result.seconds = seconds;
+    result.peak_live_bytes = global_peak.load();
+    result.stats = allocator.GetFreeSpaceStats();
+
+    std::vector<uint64_t> alloc_latencies;
+    std::vector<uint64_t> free_latencies;
+    for (auto& state : states) {
+        result.allocs += state.allocs;
+        result.failed_allocs += state.failed_allocs;
+        result.frees += state.frees;
+        result.fragments += state.fragments;
+        result.live_bytes += state.live_bytes;
+        result.live_granted_bytes += state.live_granted_bytes;
+        alloc_latencies.insert(alloc_latencies.end(), state.alloc_latencies.begin(), state.alloc_latencies.end());
+        free_latencies.insert(free_latencies.end(), state.free_latencies.begin(), state.free_latencies.end());
+
+        // hand everything back, outside of the measurement
+        for (const auto& item : state.live) {
+            allocator.Free(item.blocks);
+        }
+    }
+    result.alloc_latency = summarize(alloc_latencies);
+    result.free_latency = summarize(free_latencies);
+    return result;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "concurrency_schemes.h"
+#include "memory_manager.h"
+
+// Synthetic workloads for sizing arenas without writing any C++ (see `MemoryManager bench`).
+//
+// A workload is a stream of allocations. Every allocation gets a size from a SizeDistribution and a lifetime from
+// a LifetimeProfile, where the lifetime counts how many of the thread's later allocations it survives. So the live
+// set settles around (mean lifetime) allocations per thread. On top of that, churn is the percentage of steps on
+// which a random live allocation dies early, punching holes into otherwise long-lived data, which is what
+// fragments real arenas.
+
+enum class SizeDistribution {
+    UNIFORM,
+    // rank-based: size min_size + k is picked with weight 1 / (k + 1)^zipf_skew, so small sizes dominate
+    ZIPF,
+    // bimodal_small_percent of requests come from the bottom 1/16th of [min_size, max_size], the rest from the top quarter
+    BIMODAL,
+};
+
+enum class LifetimeProfile {
+    // every allocation lives exactly mean_lifetime allocations
+    FIXED,
+    // exponentially distributed around mean_lifetime, lots of short-lived with a long tail
+    EXPONENTIAL,
+    // 90% die quickly (mean_lifetime / 10), the other 10% stick around (mean_lifetime * 10)
+    BIMODAL,
+};
+
+struct WorkloadConfig {
+    SizeDistribution distribution;
+    size_t min_size;
+    size_t max_size;
+    double zipf_skew;
+    int bimodal_small_percent;
+
+    LifetimeProfile lifetime;
+    int mean_lifetime;
+    int churn_percent;
+
+    // allocations per thread
+    int ops;
+    unsigned int seed;
+};
+
+// Default settings, so callers (and tests) only need to override what they care about
+WorkloadConfig DefaultWorkloadConfig();
+
+bool ParseSizeDistribution(const std::string& name, SizeDistribution& out);
+bool ParseLifetimeProfile(const std::string& name, LifetimeProfile& out);
+// Command line name of an AllocPolicy ("next-fit", ...)
+bool ParseAllocPolicy(const std::string& name, AllocPolicy& out);
+
+// Draws request sizes & lifetimes for one thread. Each thread gets its own, so there is no sharing on the hot path.
+class WorkloadGenerator {
+  public:
+    WorkloadGenerator(const WorkloadConfig& config, unsigned int seed);
+
+    size_t nextSize();
+    int nextLifetime();
+
+    // 0..99, used for the churn roll
+    int nextPercent();
+
+    // 0..count-1, picks which live allocation churn kills. count needs to be > 0
+    size_t nextIndex(size_t count);
+
+  private:
+    const WorkloadConfig& _config;
+    std::mt19937 _rng;
+
+    // cumulative weights over [min_size, max_size], only built for ZIPF
+    std::vector<double> _zipf_cdf;
+};
+
+struct LatencySummary {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+struct WorkloadResult {
+    double seconds;
+    uint64_t allocs;
+    uint64_t failed_allocs;
+    uint64_t frees;
+    uint64_t fragments;
+
+    // bytes requested by allocations still live at the end of the run, before everything gets freed
+    uint64_t live_bytes;
+    uint64_t peak_live_bytes;
+
+    // bytes actually handed out for those same live allocations. Anything above live_bytes is internal
+    // fragmentation from rounding requests up to whole blocks.
+    uint64_t live_granted_bytes;
+
+    LatencySummary alloc_latency;
+    LatencySummary free_latency;
+
+    // taken at the end of the run, while the final live set is still allocated
+    FreeSpaceStats stats;
+};
+
+// Runs config.ops allocations on each of `threads` threads against allocator, then frees everything that is still
+// live so the allocator is back where it started. Latencies are in nanoseconds.
+WorkloadResult RunWorkload(ConcurrentAllocator& allocator, const WorkloadConfig& config, int threads);
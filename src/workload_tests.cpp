@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "concurrency_schemes.h"
+#include "workload.h"
+
+#define WORKLOAD_BUFFER_SIZE (1 << 20)
+
+class WorkloadTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    _buffer.reset(new char[WORKLOAD_BUFFER_SIZE]);
+    _config = DefaultWorkloadConfig();
+    _config.min_size = 10;
+    _config.max_size = 1000;
+    _config.ops = 2000;
+    _config.mean_lifetime = 50;
+  }
+
+  std::unique_ptr<char[]> _buffer;
+  WorkloadConfig _config;
+};
+
+TEST_F(WorkloadTest, parsesNames) {
+    SizeDistribution distribution;
+    EXPECT_TRUE(ParseSizeDistribution("zipf", distribution));
+    EXPECT_EQ(distribution, SizeDistribution::ZIPF);
+    EXPECT_FALSE(ParseSizeDistribution("gaussian", distribution));
+
+    LifetimeProfile lifetime;
+    EXPECT_TRUE(ParseLifetimeProfile("bimodal", lifetime));
+    EXPECT_EQ(lifetime, LifetimeProfile::BIMODAL);
+    EXPECT_FALSE(ParseLifetimeProfile("forever", lifetime));
+
+    AllocPolicy policy;
+    EXPECT_TRUE(ParseAllocPolicy("next-fit", policy));
+    EXPECT_EQ(policy, AllocPolicy::NEXT_FIT);
+    EXPECT_TRUE(ParseAllocPolicy("min-fragments", policy));
+    EXPECT_EQ(policy, AllocPolicy::MIN_FRAGMENTS);
+    EXPECT_TRUE(ParseAllocPolicy("tlsf", policy));
+    EXPECT_EQ(policy, AllocPolicy::TLSF);
+    EXPECT_TRUE(ParseAllocPolicy("segment-tree", policy));
+    EXPECT_EQ(policy, AllocPolicy::SEGMENT_TREE);
+    EXPECT_FALSE(ParseAllocPolicy("worst-fit", policy));
+}
+
+TEST_F(WorkloadTest, sizesStayInRange) {
+    for (auto distribution : { SizeDistribution::UNIFORM, SizeDistribution::ZIPF, SizeDistribution::BIMODAL }) {
+        _config.distribution = distribution;
+        WorkloadGenerator generator(_config, 7);
+        for (int ii = 0; ii < 1000; ++ii) {
+            size_t size = generator.nextSize();
+            EXPECT_GE(size, _config.min_size);
+            EXPECT_LE(size, _config.max_size);
+        }
+    }
+}
+
+TEST_F(WorkloadTest, zipfFavorsSmallSizes) {
+    _config.distribution = SizeDistribution::ZIPF;
+    WorkloadGenerator generator(_config, 7);
+    int smallest = 0;
+    for (int ii = 0; ii < 1000; ++ii) {
+        if (generator.nextSize() == _config.min_size) {
+            ++smallest;
+        }
+    }
+    // with skew 1 over ~1000 sizes, the smallest size alone has weight 1/H(991), a bit over 13%
+    EXPECT_GT(smallest, 80);
+}
+
+TEST_F(WorkloadTest, bimodalHasTwoModes) {
+    _config.distribution = SizeDistribution::BIMODAL;
+    WorkloadGenerator generator(_config, 7);
+    size_t span = _config.max_size - _config.min_size;
+    for (int ii = 0; ii < 1000; ++ii) {
+        size_t size = generator.nextSize();
+        bool small = size <= _config.min_size + span / 16;
+        bool large = size >= _config.max_size - span / 4;
+        EXPECT_TRUE(small || large);
+    }
+}
+
+TEST_F(WorkloadTest, runLeavesAllocatorEmpty) {
+    _config.churn_percent = 20;
+    SingleMutexAllocator allocator(_buffer.get(), WORKLOAD_BUFFER_SIZE);
+
+    WorkloadResult result = RunWorkload(allocator, _config, 2);
+
+    EXPECT_EQ(result.allocs, 2 * 2000);
+    EXPECT_EQ(result.failed_allocs, 0);
+    EXPECT_EQ(result.alloc_latency.count, 2 * 2000);
+    EXPECT_GT(result.frees, 0);
+    EXPECT_GE(result.peak_live_bytes, result.live_bytes);
+    EXPECT_EQ(result.stats.free_bytes + result.live_bytes, WORKLOAD_BUFFER_SIZE);
+
+    FreeSpaceStats after = allocator.GetFreeSpaceStats();
+    EXPECT_EQ(after.free_bytes, WORKLOAD_BUFFER_SIZE);
+    EXPECT_EQ(after.free_runs, 1);
+}